@@ -5,7 +5,7 @@
  * Written by Chad Trabant
  *   IRIS Data Management Center
  *
- * modified: 2015.108
+ * modified: 2026.290
  ***************************************************************************/
 
 #include <errno.h>
@@ -17,6 +17,7 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "tracelist.h"
 
 static int ms_fread (char *buf, int size, int num, FILE *stream);
 
@@ -940,10 +941,12 @@ ms_readtracelist_selection (MSTraceList **ppmstl, const char *msfile,
       }
     }
 
-    /* Add to trace list */
-    mstl_addmsr (*ppmstl, msr, dataquality, 1, timetol, sampratetol);
+    /* Add to trace list, keeping room in the sample buffers until done */
+    mstl_addmsr_bulk (*ppmstl, msr, dataquality, 1, timetol, sampratetol);
   }
 
+  mstl_endbulk (*ppmstl);
+
   /* Reset return code to MS_NOERROR on successful read by ms_readmsr() */
   if (retcode == MS_ENDOFFILE)
     retcode = MS_NOERROR;
@@ -538,6 +538,7 @@ typedef struct MSTraceSeg_s {
   void           *prvtptr;           /* Private pointer for general use, unused by libmseed */
   struct MSTraceSeg_s *prev;         /* Pointer to previous segment */
   struct MSTraceSeg_s *next;         /* Pointer to next segment */
+  struct MSTraceSegNode_s *node;     /* Node in segment index, internal to mstl_addmsr() */
 }
 MSTraceSeg;
 
@@ -557,6 +558,7 @@ typedef struct MSTraceID_s {
   struct MSTraceSeg_s *first;        /* Pointer to first of list of segments */
   struct MSTraceSeg_s *last;         /* Pointer to last of list of segments */
   struct MSTraceID_s *next;          /* Pointer to next trace */
+  struct MSTraceSegNode_s *segindex; /* Index of segments, internal to mstl_addmsr() */
 }
 MSTraceID;
 
@@ -565,9 +567,23 @@ typedef struct MSTraceList_s {
   int32_t             numtraces;     /* Number of traces in list */
   struct MSTraceID_s *traces;        /* Pointer to list of traces */
   struct MSTraceID_s *last;          /* Pointer to last used trace in list */
+  struct MSTraceIDIndex_s *index;    /* Index of traces, internal to mstl_addmsr() */
 }
 MSTraceList;
 
+/* Incremental packer of a continuous series, see msr_packer_init() */
+typedef struct MSPacker_s {
+  MSRecord           *msr;           /* Record template, start time of pending samples */
+  void              (*record_handler) (char *, int, void *);
+  void               *handlerdata;   /* Data passed to record_handler */
+  void               *samples;       /* Buffer of samples pending packing */
+  int64_t             offset;        /* Offset of first pending sample in buffer */
+  int64_t             numsamples;    /* Number of samples pending packing */
+  int64_t             maxsamples;    /* Number of samples allocated for buffer */
+  void               *rectemplate;   /* Packed record header of the series, private */
+}
+MSPacker;
+
 /* Data selection structure time window definition containers */
 typedef struct SelectTime_s {
   hptime_t starttime;    /* Earliest data for matching channels */
@@ -620,6 +636,13 @@ extern int           msr_pack (MSRecord *msr, void (*record_handler) (char *, in
 
 extern int           msr_pack_header (MSRecord *msr, flag normalize, flag verbose);
 
+extern MSPacker*     msr_packer_init (MSRecord *msr, void (*record_handler) (char *, int, void *),
+				      void *handlerdata);
+extern int           msr_packer_push (MSPacker *packer, void *samples, int64_t numsamples,
+				      int64_t *packedsamples, flag verbose);
+extern int           msr_packer_flush (MSPacker *packer, int64_t *packedsamples, flag verbose);
+extern void          msr_packer_free (MSPacker **ppacker);
+
 extern int           msr_unpack_data (MSRecord *msr, int swapflag, flag verbose);
 
 extern MSRecord*     msr_init (MSRecord *msr);
@@ -7,7 +7,7 @@
  * Written by Chad Trabant,
  *   IRIS Data Management Center
  *
- * modified: 2015.273
+ * modified: 2026.289
  ***************************************************************************/
 
 #include <stdio.h>
@@ -18,24 +18,55 @@
 #include "libmseed.h"
 #include "packdata.h"
 
+/* Packed header template of a series of records, see msr_pack_template() */
+typedef struct PackTemplate_s
+{
+  char *rawrec;                   /* Record buffer holding the packed header */
+  int rawreclen;                  /* Bytes allocated for rawrec, if allocated */
+  flag ready;                     /* Flag indicating the header is packed */
+  flag headerswapflag;
+  flag dataswapflag;
+  int samplesize;
+  int dataoffset;                 /* Offset to encoded data in rawrec */
+  int maxdatabytes;               /* Maximum data bytes per record */
+  int maxsamples;                 /* Maximum samples per record */
+  struct blkt_1001_s *HPblkt1001; /* Blockette 1001 in rawrec, if present */
+  hptime_t daystart;              /* Start of day of btime, HPTERROR if unknown */
+  BTime btime;                    /* Start time last converted */
+  char srcname[50];
+} PackTemplate;
+
 /* Function(s) internal to this file */
 static int msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
                                 flag swapflag, flag normalize,
                                 struct blkt_1001_s **blkt1001,
                                 char *srcname, flag verbose);
-static int msr_update_header (MSRecord *msr, char *rawrec, flag swapflag,
-                              struct blkt_1001_s *blkt1001,
-                              char *srcname, flag verbose);
+static int msr_pack_begin (MSRecord *msr, PackTemplate *tmpl, flag verbose);
+static int msr_pack_template (MSRecord *msr, PackTemplate *tmpl, flag verbose);
+static int msr_pack_records (MSRecord *msr, PackTemplate *tmpl,
+                             void (*record_handler) (char *, int, void *),
+                             void *handlerdata, int64_t *packedsamples,
+                             flag flush, flag verbose);
+static int msr_update_header (MSRecord *msr, PackTemplate *tmpl, flag verbose);
 static int msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
                           int32_t *lastintsample, flag comphistory,
                           char sampletype, flag encoding, flag swapflag,
                           char *srcname, flag verbose);
+static int msr_packer_pack (MSPacker *packer, void *samples, int64_t numsamples,
+                            flag flush, int64_t *packedsamples, flag verbose);
+static void msr_packer_skip (MSPacker *packer, int64_t numsamples);
 
 /* Header and data byte order flags controlled by environment variables */
 /* -2 = not checked, -1 = checked but not set, or 0 = LE and 1 = BE */
 flag packheaderbyteorder = -2;
 flag packdatabyteorder   = -2;
 
+/* Flag indicating the ENCODE_DEBUG environment variable was checked */
+static flag encodedebugchecked = 0;
+
+/* Records up to this length are packed in a buffer on the stack */
+#define STACKRECLEN 8192
+
 /***************************************************************************
  * msr_pack:
  *
@@ -71,26 +102,13 @@ int
 msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
           void *handlerdata, int64_t *packedsamples, flag flush, flag verbose)
 {
-  uint16_t *HPnumsamples;
-  uint16_t *HPdataoffset;
-  struct blkt_1001_s *HPblkt1001 = NULL;
+  PackTemplate tmpl;
+  int recordcnt;
 
-  char *rawrec;
-  char *envvariable;
-  char srcname[50];
-
-  flag headerswapflag = 0;
-  flag dataswapflag   = 0;
-
-  int samplesize;
-  int headerlen;
-  int dataoffset;
-  int maxdatabytes;
-  int maxsamples;
-  int recordcnt = 0;
-  int packsamples, packoffset;
-  int64_t totalpackedsamples;
-  hptime_t segstarttime;
+  union {
+    double align;
+    char data[STACKRECLEN];
+  } stackrec;
 
   if (!msr)
     return -1;
@@ -101,6 +119,49 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     return -1;
   }
 
+  if (msr_pack_begin (msr, &tmpl, verbose) < 0)
+    return -1;
+
+  /* Use the stack for the data record unless it is larger */
+  if (msr->reclen <= STACKRECLEN)
+    tmpl.rawrec = stackrec.data;
+  else
+    tmpl.rawrec = (char *)malloc (msr->reclen);
+
+  if (tmpl.rawrec == NULL)
+  {
+    ms_log (2, "msr_pack(%s): Cannot allocate memory\n", tmpl.srcname);
+    return -1;
+  }
+
+  if (msr_pack_template (msr, &tmpl, verbose) < 0)
+    recordcnt = -1;
+  else
+    recordcnt = msr_pack_records (msr, &tmpl, record_handler, handlerdata,
+                                  packedsamples, flush, verbose);
+
+  if (tmpl.rawrec != stackrec.data)
+    free (tmpl.rawrec);
+
+  return recordcnt;
+} /* End of msr_pack() */
+
+/***************************************************************************
+ * msr_pack_begin:
+ *
+ * Prepare an MSRecord for packing with msr_pack(): apply default
+ * values, check the values and determine the byte swapping needed.
+ * The source name, sample size and byte swapping flags are set in the
+ * template, the record buffer of the template is not used.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msr_pack_begin (MSRecord *msr, PackTemplate *tmpl, flag verbose)
+{
+  char *envvariable;
+  char *srcname = tmpl->srcname;
+
   /* Allocate stream processing state space if needed */
   if (!msr->ststate)
   {
@@ -120,9 +181,6 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     return MS_GENERROR;
   }
 
-  /* Track original segment start time for new start time calculation */
-  segstarttime = msr->starttime;
-
   /* Read possible environmental variables that force byteorder */
   if (packheaderbyteorder == -2)
   {
@@ -206,9 +264,9 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     return -1;
   }
 
-  samplesize = ms_samplesize (msr->sampletype);
+  tmpl->samplesize = ms_samplesize (msr->sampletype);
 
-  if (!samplesize)
+  if (!tmpl->samplesize)
   {
     ms_log (2, "msr_pack(%s): Unknown sample type '%c'\n",
             srcname, msr->sampletype);
@@ -224,46 +282,57 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     return -1;
   }
 
-  /* Allocate space for data record */
-  rawrec = (char *)malloc (msr->reclen);
-
-  if (rawrec == NULL)
-  {
-    ms_log (2, "msr_pack(%s): Cannot allocate memory\n", srcname);
-    return -1;
-  }
-
-  /* Set header pointers to known offsets into FSDH */
-  HPnumsamples = (uint16_t *)(rawrec + 30);
-  HPdataoffset = (uint16_t *)(rawrec + 44);
-
   /* Check to see if byte swapping is needed */
+  tmpl->headerswapflag = tmpl->dataswapflag = 0;
+
   if (msr->byteorder != ms_bigendianhost ())
-    headerswapflag = dataswapflag = 1;
+    tmpl->headerswapflag = tmpl->dataswapflag = 1;
 
   /* Check if byte order is forced */
   if (packheaderbyteorder >= 0)
   {
-    headerswapflag = (msr->byteorder != packheaderbyteorder) ? 1 : 0;
+    tmpl->headerswapflag = (msr->byteorder != packheaderbyteorder) ? 1 : 0;
   }
 
   if (packdatabyteorder >= 0)
   {
-    dataswapflag = (msr->byteorder != packdatabyteorder) ? 1 : 0;
+    tmpl->dataswapflag = (msr->byteorder != packdatabyteorder) ? 1 : 0;
   }
 
   if (verbose > 2)
   {
-    if (headerswapflag && dataswapflag)
+    if (tmpl->headerswapflag && tmpl->dataswapflag)
       ms_log (1, "%s: Byte swapping needed for packing of header and data samples\n", srcname);
-    else if (headerswapflag)
+    else if (tmpl->headerswapflag)
       ms_log (1, "%s: Byte swapping needed for packing of header\n", srcname);
-    else if (dataswapflag)
+    else if (tmpl->dataswapflag)
       ms_log (1, "%s: Byte swapping needed for packing of data samples\n", srcname);
     else
       ms_log (1, "%s: Byte swapping NOT needed for packing\n", srcname);
   }
 
+  return 0;
+} /* End of msr_pack_begin() */
+
+/***************************************************************************
+ * msr_pack_template:
+ *
+ * Pack the header and blockettes of an MSRecord prepared with
+ * msr_pack_begin() into the record buffer of a template, which must
+ * hold at least MSRecord->reclen bytes, and determine the data offset
+ * and the maximum number of samples per record.  A Blockette 1000 will
+ * be added if one is not present.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+msr_pack_template (MSRecord *msr, PackTemplate *tmpl, flag verbose)
+{
+  uint16_t *HPdataoffset;
+  char *srcname = tmpl->srcname;
+  int headerlen;
+  int dataoffset;
+
   /* Add a blank 1000 Blockette if one is not present, the blockette values
      will be populated in msr_pack_header_raw()/msr_normalize_header() */
   if (!msr->Blkt1000)
@@ -277,18 +346,17 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     if (!msr_addblockette (msr, (char *)&blkt1000, sizeof (struct blkt_1000_s), 1000, 0))
     {
       ms_log (2, "msr_pack(%s): Error adding 1000 Blockette\n", srcname);
-      free (rawrec);
       return -1;
     }
   }
 
-  headerlen = msr_pack_header_raw (msr, rawrec, msr->reclen, headerswapflag, 1,
-                                   &HPblkt1001, srcname, verbose);
+  tmpl->HPblkt1001 = NULL;
+  headerlen = msr_pack_header_raw (msr, tmpl->rawrec, msr->reclen, tmpl->headerswapflag, 1,
+                                   &tmpl->HPblkt1001, srcname, verbose);
 
   if (headerlen == -1)
   {
     ms_log (2, "msr_pack(%s): Error packing header\n", srcname);
-    free (rawrec);
     return -1;
   }
 
@@ -300,33 +368,73 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
       dataoffset += 64;
 
     /* Zero memory between blockettes and data if any */
-    memset (rawrec + headerlen, 0, dataoffset - headerlen);
+    memset (tmpl->rawrec + headerlen, 0, dataoffset - headerlen);
   }
   else
   {
     dataoffset = headerlen;
   }
 
+  HPdataoffset  = (uint16_t *)(tmpl->rawrec + 44);
   *HPdataoffset = (uint16_t)dataoffset;
-  if (headerswapflag)
+  if (tmpl->headerswapflag)
     ms_gswap2 (HPdataoffset);
 
   /* Determine the max data bytes and sample count */
-  maxdatabytes = msr->reclen - dataoffset;
+  tmpl->dataoffset   = dataoffset;
+  tmpl->maxdatabytes = msr->reclen - dataoffset;
 
   if (msr->encoding == DE_STEIM1)
   {
-    maxsamples = (int)(maxdatabytes / 64) * STEIM1_FRAME_MAX_SAMPLES;
+    tmpl->maxsamples = (int)(tmpl->maxdatabytes / 64) * STEIM1_FRAME_MAX_SAMPLES;
   }
   else if (msr->encoding == DE_STEIM2)
   {
-    maxsamples = (int)(maxdatabytes / 64) * STEIM2_FRAME_MAX_SAMPLES;
+    tmpl->maxsamples = (int)(tmpl->maxdatabytes / 64) * STEIM2_FRAME_MAX_SAMPLES;
+  }
+  else if (msr->encoding == DE_INT16)
+  {
+    tmpl->maxsamples = tmpl->maxdatabytes / 2;
   }
   else
   {
-    maxsamples = maxdatabytes / samplesize;
+    tmpl->maxsamples = tmpl->maxdatabytes / tmpl->samplesize;
   }
 
+  /* The start time packed is not used by msr_update_header() */
+  tmpl->daystart = HPTERROR;
+
+  return 0;
+} /* End of msr_pack_template() */
+
+/***************************************************************************
+ * msr_pack_records:
+ *
+ * Pack the samples of an MSRecord into records using the header
+ * packed in a template, see msr_pack() for details.  Only the values
+ * that change between records are updated in the packed header.
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+static int
+msr_pack_records (MSRecord *msr, PackTemplate *tmpl,
+                  void (*record_handler) (char *, int, void *),
+                  void *handlerdata, int64_t *packedsamples, flag flush, flag verbose)
+{
+  uint16_t *HPnumsamples;
+  char *rawrec    = tmpl->rawrec;
+  char *srcname   = tmpl->srcname;
+  int recordcnt   = 0;
+  int packsamples, packoffset;
+  int64_t totalpackedsamples;
+  hptime_t segstarttime;
+
+  /* Track original segment start time for new start time calculation */
+  segstarttime = msr->starttime;
+
+  /* Set header pointer to known offset into FSDH */
+  HPnumsamples = (uint16_t *)(rawrec + 30);
+
   /* Pack samples into records */
   *HPnumsamples      = 0;
   totalpackedsamples = 0;
@@ -334,27 +442,26 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   if (packedsamples)
     *packedsamples = 0;
 
-  while ((msr->numsamples - totalpackedsamples) > maxsamples || flush)
+  while ((msr->numsamples - totalpackedsamples) > tmpl->maxsamples || flush)
   {
-    packsamples = msr_pack_data (rawrec + dataoffset,
+    packsamples = msr_pack_data (rawrec + tmpl->dataoffset,
                                  (char *)msr->datasamples + packoffset,
-                                 (int)(msr->numsamples - totalpackedsamples), maxdatabytes,
+                                 (int)(msr->numsamples - totalpackedsamples), tmpl->maxdatabytes,
                                  &msr->ststate->lastintsample, msr->ststate->comphistory,
-                                 msr->sampletype, msr->encoding, dataswapflag,
+                                 msr->sampletype, msr->encoding, tmpl->dataswapflag,
                                  srcname, verbose);
 
     if (packsamples < 0)
     {
       ms_log (2, "msr_pack(%s): Error packing data samples\n", srcname);
-      free (rawrec);
       return -1;
     }
 
-    packoffset += packsamples * samplesize;
+    packoffset += packsamples * tmpl->samplesize;
 
     /* Update number of samples */
     *HPnumsamples = (uint16_t)packsamples;
-    if (headerswapflag)
+    if (tmpl->headerswapflag)
       ms_gswap2 (HPnumsamples);
 
     if (verbose > 0)
@@ -373,7 +480,7 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
     if (msr->samprate > 0)
       msr->starttime = segstarttime + (hptime_t) (totalpackedsamples / msr->samprate * HPTMODULUS + 0.5);
 
-    msr_update_header (msr, rawrec, headerswapflag, HPblkt1001, srcname, verbose);
+    msr_update_header (msr, tmpl, verbose);
 
     recordcnt++;
     msr->ststate->packedrecords++;
@@ -389,10 +496,8 @@ msr_pack (MSRecord *msr, void (*record_handler) (char *, int, void *),
   if (verbose > 2)
     ms_log (1, "%s: Packed %d total samples\n", srcname, totalpackedsamples);
 
-  free (rawrec);
-
   return recordcnt;
-} /* End of msr_pack() */
+} /* End of msr_pack_records() */
 
 /***************************************************************************
  * msr_pack_header:
@@ -501,6 +606,369 @@ msr_pack_header (MSRecord *msr, flag normalize, flag verbose)
   return headerlen;
 } /* End of msr_pack_header() */
 
+/***************************************************************************
+ * msr_packer_init:
+ *
+ * Initialize a packer of a continuous series of data samples.
+ * Samples are pushed to the packer with msr_packer_push() in any
+ * amount, records are packed as they are filled and passed to
+ * record_handler as done by msr_pack().  The samples not yet packed
+ * are kept by the packer, so they are not moved or reallocated by the
+ * caller for each record as with mst_pack().
+ *
+ * The MSRecord is used as the record header template, the packer
+ * takes ownership of it and frees it with msr_packer_free().  If msr
+ * is NULL a new template is allocated.  The template must not hold
+ * data samples.  Before samples are pushed the caller should set the
+ * source name, sample rate, sample type, record length, encoding and
+ * byte order of the template, defaults are applied as for msr_pack().
+ * The template start time is the time of the first sample pending
+ * packing and is advanced as records are packed, it should be set by
+ * the caller when starting a series.
+ *
+ * The header and blockettes of the template are packed once for each
+ * series, at the first push after initialization or a flush, and only
+ * the start time, sequence number, sample count and Blockette 1001
+ * values are updated for each record.  Other changes to the template
+ * take effect after the next flush.
+ *
+ * Returns a pointer to a MSPacker on success and NULL on error.
+ ***************************************************************************/
+MSPacker *
+msr_packer_init (MSRecord *msr, void (*record_handler) (char *, int, void *),
+                 void *handlerdata)
+{
+  MSPacker *packer;
+
+  if (!record_handler)
+  {
+    ms_log (2, "msr_packer_init(): record_handler() function pointer not set!\n");
+    return NULL;
+  }
+
+  if (!(packer = (MSPacker *)calloc (1, sizeof (MSPacker))))
+  {
+    ms_log (2, "msr_packer_init(): Cannot allocate memory\n");
+    return NULL;
+  }
+
+  if (!msr && !(msr = msr_init (NULL)))
+  {
+    ms_log (2, "msr_packer_init(): Cannot initialize MSRecord\n");
+    free (packer);
+    return NULL;
+  }
+
+  packer->msr            = msr;
+  packer->record_handler = record_handler;
+  packer->handlerdata    = handlerdata;
+
+  return packer;
+} /* End of msr_packer_init() */
+
+/***************************************************************************
+ * msr_packer_push:
+ *
+ * Add data samples to the series of a packer and pack the records
+ * filled.  The samples must be of the sample type of the packer
+ * template and continue the samples already pushed.
+ *
+ * When no samples are pending the records are packed directly from
+ * the supplied samples and only the samples remaining are kept,
+ * otherwise the samples are appended to the pending samples and
+ * packed from there.  The buffer of pending samples is reused, moving
+ * the samples remaining after packing to its start only when it is
+ * full, so each call copies at most the supplied samples and the
+ * samples of a partial record.
+ *
+ * If packedsamples is not NULL it will be set to the number of
+ * samples packed.  On error the samples pending are discarded.
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+int
+msr_packer_push (MSPacker *packer, void *samples, int64_t numsamples,
+                 int64_t *packedsamples, flag verbose)
+{
+  void *newsamples;
+  int64_t maxsamples;
+  int64_t packed    = 0;
+  int recordcnt     = 0;
+  int packedrecords = 0;
+  int samplesize;
+  flag direct;
+
+  if (packedsamples)
+    *packedsamples = 0;
+
+  if (!packer || numsamples < 0 || (numsamples > 0 && !samples))
+    return -1;
+
+  if (numsamples == 0)
+    return 0;
+
+  if (!(samplesize = ms_samplesize (packer->msr->sampletype)))
+  {
+    ms_log (2, "msr_packer_push(): Unknown sample type '%c'\n", packer->msr->sampletype);
+    return -1;
+  }
+
+  /* Pack directly from the supplied samples if none are pending */
+  direct = (packer->numsamples == 0);
+
+  if (direct)
+  {
+    recordcnt = msr_packer_pack (packer, samples, numsamples, 0, &packed, verbose);
+
+    if (packedsamples)
+      *packedsamples = packed;
+
+    if (recordcnt < 0)
+    {
+      msr_packer_skip (packer, numsamples - packed);
+      return -1;
+    }
+
+    samples = (char *)samples + (packed * samplesize);
+    numsamples -= packed;
+    packedrecords = recordcnt;
+
+    if (numsamples == 0)
+      return packedrecords;
+  }
+
+  /* Make room at the end of the buffer, moving the pending samples
+   * to the start or growing it */
+  if (packer->offset + packer->numsamples + numsamples > packer->maxsamples)
+  {
+    if (packer->offset > 0)
+    {
+      memmove (packer->samples,
+               (char *)packer->samples + (packer->offset * samplesize),
+               (size_t) (packer->numsamples * samplesize));
+      packer->offset = 0;
+    }
+
+    if (packer->numsamples + numsamples > packer->maxsamples)
+    {
+      maxsamples = packer->numsamples + numsamples;
+      maxsamples += maxsamples / 2;
+
+      if (!(newsamples = realloc (packer->samples, (size_t) (maxsamples * samplesize))))
+      {
+        ms_log (2, "msr_packer_push(): Cannot allocate memory\n");
+        msr_packer_skip (packer, packer->numsamples + numsamples);
+        return -1;
+      }
+
+      packer->samples    = newsamples;
+      packer->maxsamples = maxsamples;
+    }
+  }
+
+  memcpy ((char *)packer->samples + ((packer->offset + packer->numsamples) * samplesize),
+          samples, (size_t) (numsamples * samplesize));
+  packer->numsamples += numsamples;
+
+  /* Pack the records filled from the pending samples */
+  if (!direct)
+  {
+    recordcnt = msr_packer_pack (packer,
+                                 (char *)packer->samples + (packer->offset * samplesize),
+                                 packer->numsamples, 0, &packed, verbose);
+
+    if (packedsamples)
+      *packedsamples += packed;
+
+    packer->offset += packed;
+    packer->numsamples -= packed;
+
+    if (recordcnt < 0)
+    {
+      msr_packer_skip (packer, packer->numsamples);
+      return -1;
+    }
+
+    if (packer->numsamples == 0)
+      packer->offset = 0;
+
+    packedrecords += recordcnt;
+  }
+
+  return packedrecords;
+} /* End of msr_packer_push() */
+
+/***************************************************************************
+ * msr_packer_flush:
+ *
+ * Pack all samples pending in a packer, the last record will probably
+ * not be filled.  The stream state of the template is kept, so
+ * following samples continue the compression history of the series.
+ * To start a new series the caller should clear the stream state and
+ * set the template start time.
+ *
+ * If packedsamples is not NULL it will be set to the number of
+ * samples packed.  On error the samples pending are discarded.
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+int
+msr_packer_flush (MSPacker *packer, int64_t *packedsamples, flag verbose)
+{
+  int64_t packed = 0;
+  int recordcnt;
+  int samplesize;
+
+  if (packedsamples)
+    *packedsamples = 0;
+
+  if (!packer)
+    return -1;
+
+  if (packer->numsamples == 0)
+  {
+    msr_packer_skip (packer, 0);
+    return 0;
+  }
+
+  samplesize = ms_samplesize (packer->msr->sampletype);
+
+  recordcnt = msr_packer_pack (packer,
+                               (char *)packer->samples + (packer->offset * samplesize),
+                               packer->numsamples, 1, &packed, verbose);
+
+  if (packedsamples)
+    *packedsamples = packed;
+
+  /* Samples remaining after an error are discarded */
+  msr_packer_skip (packer, packer->numsamples - packed);
+
+  packer->offset     = 0;
+  packer->numsamples = 0;
+
+  return recordcnt;
+} /* End of msr_packer_flush() */
+
+/***************************************************************************
+ * msr_packer_free:
+ *
+ * Free all memory associated with a MSPacker including the template
+ * MSRecord, any samples pending are discarded.
+ ***************************************************************************/
+void
+msr_packer_free (MSPacker **ppacker)
+{
+  if (ppacker != NULL && *ppacker != 0)
+  {
+    if ((*ppacker)->samples)
+      free ((*ppacker)->samples);
+
+    if ((*ppacker)->rectemplate)
+    {
+      free (((PackTemplate *)(*ppacker)->rectemplate)->rawrec);
+      free ((*ppacker)->rectemplate);
+    }
+
+    msr_free (&(*ppacker)->msr);
+
+    free (*ppacker);
+
+    *ppacker = NULL;
+  }
+} /* End of msr_packer_free() */
+
+/***************************************************************************
+ * msr_packer_pack:
+ *
+ * Pack samples with the template of a packer using msr_pack().  The
+ * number of samples packed is returned in packedsamples, also when
+ * records were packed before an error.
+ *
+ * Returns the number of records created on success and -1 on error.
+ ***************************************************************************/
+static int
+msr_packer_pack (MSPacker *packer, void *samples, int64_t numsamples,
+                 flag flush, int64_t *packedsamples, flag verbose)
+{
+  MSRecord *msr      = packer->msr;
+  PackTemplate *tmpl = (PackTemplate *)packer->rectemplate;
+  char *rawrec;
+  int recordcnt = -1;
+
+  *packedsamples = 0;
+
+  if (!tmpl)
+  {
+    if (!(tmpl = (PackTemplate *)calloc (1, sizeof (PackTemplate))))
+    {
+      ms_log (2, "msr_packer_pack(): Cannot allocate memory\n");
+      return -1;
+    }
+
+    packer->rectemplate = tmpl;
+  }
+
+  msr->datasamples = samples;
+  msr->numsamples  = numsamples;
+
+  /* Pack the header of the series once, otherwise update the values
+   * that change between records as the start time may have been set */
+  if (!tmpl->ready)
+  {
+    if (msr_pack_begin (msr, tmpl, verbose) == 0)
+    {
+      if (tmpl->rawreclen < msr->reclen)
+      {
+        if ((rawrec = (char *)realloc (tmpl->rawrec, msr->reclen)))
+        {
+          tmpl->rawrec    = rawrec;
+          tmpl->rawreclen = msr->reclen;
+        }
+        else
+        {
+          ms_log (2, "msr_packer_pack(%s): Cannot allocate memory\n", tmpl->srcname);
+        }
+      }
+
+      if (tmpl->rawreclen >= msr->reclen && msr_pack_template (msr, tmpl, verbose) == 0)
+        tmpl->ready = 1;
+    }
+  }
+  else
+  {
+    msr_update_header (msr, tmpl, verbose);
+  }
+
+  if (tmpl->ready)
+    recordcnt = msr_pack_records (msr, tmpl, packer->record_handler, packer->handlerdata,
+                                  packedsamples, flush, verbose);
+
+  msr->datasamples = 0;
+  msr->numsamples  = 0;
+
+  return (recordcnt < 0) ? -1 : recordcnt;
+} /* End of msr_packer_pack() */
+
+/***************************************************************************
+ * msr_packer_skip:
+ *
+ * Advance the template start time of a packer past samples that are
+ * discarded and clear the samples pending.  The packed header is
+ * packed again for the next series.
+ ***************************************************************************/
+static void
+msr_packer_skip (MSPacker *packer, int64_t numsamples)
+{
+  if (numsamples > 0 && packer->msr->samprate > 0)
+    packer->msr->starttime += (hptime_t) (numsamples / packer->msr->samprate * HPTMODULUS + 0.5);
+
+  packer->offset     = 0;
+  packer->numsamples = 0;
+
+  if (packer->rectemplate)
+    ((PackTemplate *)packer->rectemplate)->ready = 0;
+} /* End of msr_packer_skip() */
+
 /***************************************************************************
  * msr_pack_header_raw:
  *
@@ -835,52 +1303,87 @@ msr_pack_header_raw (MSRecord *msr, char *rawrec, int maxheaderlen,
 /***************************************************************************
  * msr_update_header:
  *
- * Update the header values that change between records: start time,
- * sequence number, etc.
+ * Update the header values that change between records in the header
+ * packed in a template: start time, sequence number, etc.
+ *
+ * The sequence number digits are set directly and a start time within
+ * the day of the last start time converted is set arithmetically, a
+ * full conversion with ms_hptime2btime() is only needed for the first
+ * record and when a record starts on a following day.
  *
  * Returns 0 on success or -1 on error.
  ***************************************************************************/
 static int
-msr_update_header (MSRecord *msr, char *rawrec, flag swapflag,
-                   struct blkt_1001_s *blkt1001, char *srcname, flag verbose)
+msr_update_header (MSRecord *msr, PackTemplate *tmpl, flag verbose)
 {
   struct fsdh_s *fsdh;
   hptime_t hptimems;
+  hptime_t dayoffset;
   int8_t usecoffset;
-  char seqnum[7];
+  int seqnum;
+  int daysec;
+  int idx;
 
-  if (!msr || !rawrec)
+  if (!msr || !tmpl->rawrec)
     return -1;
 
   if (verbose > 2)
-    ms_log (1, "%s: Updating fixed section of data header\n", srcname);
+    ms_log (1, "%s: Updating fixed section of data header\n", tmpl->srcname);
 
-  fsdh = (struct fsdh_s *)rawrec;
+  fsdh = (struct fsdh_s *)tmpl->rawrec;
 
   /* Pack values into the fixed section of header */
-  snprintf (seqnum, 7, "%06d", msr->sequence_number);
-  memcpy (fsdh->sequence_number, seqnum, 6);
+  seqnum = msr->sequence_number;
+  for (idx = 5; idx >= 0; idx--)
+  {
+    fsdh->sequence_number[idx] = (char)('0' + seqnum % 10);
+    seqnum /= 10;
+  }
 
   /* Get start time rounded to tenths of milliseconds and microsecond offset */
   ms_hptime2tomsusecoffset (msr->starttime, &hptimems, &usecoffset);
 
+  /* Update start time within the day of the last conversion or convert it */
+  dayoffset = hptimems - tmpl->daystart;
+
+  if (tmpl->daystart != HPTERROR && dayoffset >= 0 && dayoffset < (hptime_t)86400 * HPTMODULUS)
+  {
+    daysec = (int)(dayoffset / HPTMODULUS);
+
+    tmpl->btime.hour  = (uint8_t) (daysec / 3600);
+    tmpl->btime.min   = (uint8_t) ((daysec / 60) % 60);
+    tmpl->btime.sec   = (uint8_t) (daysec % 60);
+    tmpl->btime.fract = (uint16_t) ((dayoffset % HPTMODULUS) / (HPTMODULUS / 10000));
+  }
+  else if (ms_hptime2btime (hptimems, &tmpl->btime) == 0)
+  {
+    daysec = tmpl->btime.hour * 3600 + tmpl->btime.min * 60 + tmpl->btime.sec;
+
+    tmpl->daystart = hptimems - (hptime_t)daysec * HPTMODULUS -
+                     (hptime_t)tmpl->btime.fract * (HPTMODULUS / 10000);
+  }
+  else
+  {
+    tmpl->daystart = HPTERROR;
+  }
+
   /* Update fixed-section start time */
-  ms_hptime2btime (hptimems, &(fsdh->start_time));
+  memcpy (&fsdh->start_time, &tmpl->btime, sizeof (BTime));
 
   /* Swap byte order? */
-  if (swapflag)
+  if (tmpl->headerswapflag)
   {
     MS_SWAPBTIME (&fsdh->start_time);
   }
 
   /* Update microsecond offset value if Blockette 1001 is present */
-  if (msr->Blkt1001 && blkt1001)
+  if (msr->Blkt1001 && tmpl->HPblkt1001)
   {
     /* Update microseconds offset in blockette chain entry */
     msr->Blkt1001->usec = usecoffset;
 
     /* Update microseconds offset in packed header */
-    blkt1001->usec = usecoffset;
+    tmpl->HPblkt1001->usec = usecoffset;
   }
 
   return 0;
@@ -910,9 +1413,14 @@ msr_pack_data (void *dest, void *src, int maxsamples, int maxdatabytes,
   int32_t *intbuff;
   int32_t d0;
 
-  /* Check for encode debugging environment variable */
-  if (getenv ("ENCODE_DEBUG"))
-    encodedebug = 1;
+  /* Check for encode debugging environment variable once */
+  if (!encodedebugchecked)
+  {
+    if (getenv ("ENCODE_DEBUG"))
+      encodedebug = 1;
+
+    encodedebugchecked = 1;
+  }
 
   /* Decide if this is a format that we can encode */
   switch (encoding)
@@ -2,7 +2,7 @@
  * Routines for packing text/ASCII, INT_16, INT_32, FLOAT_32, FLOAT_64,
  * STEIM1 and STEIM2 data records.
  *
- * modified: 2017.053
+ * modified: 2026.289
  ************************************************************************/
 
 #include <memory.h>
@@ -12,6 +12,14 @@
 #include "libmseed.h"
 #include "packdata.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STEIM_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* Number of differences determined at a time by the Steim encoders */
+#define STEIM_DIFFCHUNK 256
+
 /* Control for printing debugging information */
 int encodedebug = 0;
 
@@ -218,6 +226,128 @@ msr_encode_float64 (double *input, int samplecount, double *output,
   else                                                \
     RESULT = 32;
 
+/* Width classes of differences for the Steim encoders, the number of
+ * these limits the magnitude of a difference reaches (as a positive
+ * value, negative values complemented).
+ *
+ * Steim1: 0 = 8 bits, 1 = 16 bits and 2 = 32 bits.
+ *
+ * Steim2: 0 = 4 bits, 1 = 5 bits, 2 = 6 bits, 3 = 8 bits, 4 = 10 bits,
+ * 5 = 15 bits, 6 = 30 bits and 7 = too large.  A word of N differences
+ * can hold differences of classes up to 7 - N. */
+static const int32_t steim1limits[2] = {128, 32768};
+static const int32_t steim2limits[7] = {8, 16, 32, 128, 512, 16384, 536870912};
+
+/* Packings of Steim1 words allowed by the class of the difference at
+ * each index of a word: bit N-1 is set if a word of N differences can
+ * hold it, words of N <= index do not include it */
+static const uint8_t steim1fit[4][3] = {
+    {0x0B, 0x03, 0x01},
+    {0x0B, 0x03, 0x01},
+    {0x0B, 0x03, 0x03},
+    {0x0B, 0x03, 0x03}};
+
+/* Number of differences in a Steim1 word for the packings allowed */
+static const uint8_t steim1count[16] = {
+    0, 1, 2, 2, 0, 1, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4};
+
+/* Packings of Steim2 words allowed by the class of the difference at
+ * each index of a word: bit N-1 is set if a word of N differences can
+ * hold it, words of N <= index do not include it */
+static const uint8_t steim2fit[7][8] = {
+    {0x7F, 0x3F, 0x1F, 0x0F, 0x07, 0x03, 0x01, 0x00},
+    {0x7F, 0x3F, 0x1F, 0x0F, 0x07, 0x03, 0x01, 0x01},
+    {0x7F, 0x3F, 0x1F, 0x0F, 0x07, 0x03, 0x03, 0x03},
+    {0x7F, 0x3F, 0x1F, 0x0F, 0x07, 0x07, 0x07, 0x07},
+    {0x7F, 0x3F, 0x1F, 0x0F, 0x0F, 0x0F, 0x0F, 0x0F},
+    {0x7F, 0x3F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F, 0x1F},
+    {0x7F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F}};
+
+/* Number of differences in a Steim2 word for the packings allowed,
+ * the most differences allowed, 0 if none */
+static const uint8_t steim2count[128] = {
+    0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4,
+    5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5, 5,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6, 6,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7};
+
+/************************************************************************
+ * steim_class:
+ *
+ * Return the width class of a difference for the specified limits,
+ * see steim1limits and steim2limits.
+ ************************************************************************/
+static uint8_t
+steim_class (int32_t diff, const int32_t *limits, int limitcount)
+{
+  int32_t magnitude = diff ^ (diff >> 31);
+  uint8_t class     = 0;
+
+  while (class < limitcount && magnitude >= limits[class])
+    class++;
+
+  return class;
+} /* End of steim_class() */
+
+/************************************************************************
+ * steim_diffs:
+ *
+ * Determine the differences between count + 1 successive input
+ * samples and their width classes for the specified limits, see
+ * steim1limits and steim2limits.  With SSE2 16 differences are
+ * determined at a time.
+ ************************************************************************/
+static void
+steim_diffs (int32_t *input, int count, int32_t *diffs, uint8_t *classes,
+             const int32_t *limits, int limitcount)
+{
+  int idx = 0;
+
+#if defined(STEIM_SSE2)
+  __m128i d[4];
+  __m128i c[4];
+  __m128i limit;
+  int vidx;
+  int lidx;
+
+  for (; idx + 16 <= count; idx += 16)
+  {
+    for (vidx = 0; vidx < 4; vidx++)
+    {
+      d[vidx] = _mm_sub_epi32 (_mm_loadu_si128 ((__m128i *)(input + idx + vidx * 4 + 1)),
+                               _mm_loadu_si128 ((__m128i *)(input + idx + vidx * 4)));
+      _mm_storeu_si128 ((__m128i *)(diffs + idx + vidx * 4), d[vidx]);
+
+      /* Complement negative values, then count the limits reached */
+      d[vidx] = _mm_xor_si128 (d[vidx], _mm_srai_epi32 (d[vidx], 31));
+      c[vidx] = _mm_setzero_si128 ();
+    }
+
+    for (lidx = 0; lidx < limitcount; lidx++)
+    {
+      limit = _mm_set1_epi32 (limits[lidx] - 1);
+
+      for (vidx = 0; vidx < 4; vidx++)
+        c[vidx] = _mm_sub_epi32 (c[vidx], _mm_cmpgt_epi32 (d[vidx], limit));
+    }
+
+    _mm_storeu_si128 ((__m128i *)(classes + idx),
+                      _mm_packs_epi16 (_mm_packs_epi32 (c[0], c[1]),
+                                       _mm_packs_epi32 (c[2], c[3])));
+  }
+#endif
+
+  for (; idx < count; idx++)
+  {
+    diffs[idx]   = input[idx + 1] - input[idx];
+    classes[idx] = steim_class (diffs[idx], limits, limitcount);
+  }
+} /* End of steim_diffs() */
+
 /************************************************************************
  * msr_encode_steim1:
  *
@@ -237,9 +367,13 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
 {
   int32_t *frameptr;   /* Frame pointer in output */
   int32_t *Xnp = NULL; /* Reverse integration constant, aka last sample */
-  int32_t diffs[4];
-  int32_t bitwidth[4];
+  int32_t diffbuf[STEIM_DIFFCHUNK];
+  uint8_t classbuf[STEIM_DIFFCHUNK];
+  int32_t *diffs;      /* Differences not yet packed */
+  uint8_t *classes;    /* Width classes of diffs */
   int diffcount     = 0;
+  int fillcount;
+  int fit;
   int inputidx      = 0;
   int outputsamples = 0;
   int maxframes     = outputlength / 64;
@@ -266,9 +400,11 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
             samplecount, maxframes, swapflag);
 
   /* Add first difference to buffers */
-  diffs[0] = diff0;
-  BITWIDTH (diffs[0], bitwidth[0]);
-  diffcount = 1;
+  diffs      = diffbuf;
+  classes    = classbuf;
+  diffs[0]   = diff0;
+  classes[0] = steim_class (diff0, steim1limits, 2);
+  diffcount  = 1;
 
   for (frameidx = 0; frameidx < maxframes && outputsamples < samplecount; frameidx++)
   {
@@ -303,36 +439,71 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
 
     for (widx = startnibble; widx < 16 && outputsamples < samplecount; widx++)
     {
-      if (diffcount < 4)
+      if (diffcount < 16 && inputidx < (samplecount - 1))
       {
-        /* Shift diffs and related bit widths to beginning of buffers */
+        /* Move diffs not packed to beginning of buffers and add new diffs */
         for (idx = 0; idx < diffcount; idx++)
         {
-          diffs[idx]    = diffs[packedsamples + idx];
-          bitwidth[idx] = bitwidth[packedsamples + idx];
+          diffbuf[idx]  = diffs[idx];
+          classbuf[idx] = classes[idx];
         }
 
-        /* Add new diffs and determine bit width needed to represent */
-        for (idx = diffcount; idx < 4 && inputidx < (samplecount - 1); idx++, inputidx++)
-        {
-          diffs[idx] = *(input + inputidx + 1) - *(input + inputidx);
-          BITWIDTH (diffs[idx], bitwidth[idx]);
-          diffcount++;
-        }
+        diffs   = diffbuf;
+        classes = classbuf;
+
+        fillcount = STEIM_DIFFCHUNK - diffcount;
+        if (fillcount > (samplecount - 1) - inputidx)
+          fillcount = (samplecount - 1) - inputidx;
+
+        steim_diffs (input + inputidx, fillcount, diffs + diffcount, classes + diffcount,
+                     steim1limits, 2);
+
+        inputidx += fillcount;
+        diffcount += fillcount;
       }
 
-      /* Determine optimal packing by checking, in-order:
+#if defined(STEIM_SSE2)
+      /* Pack 4 words of 4 x 8-bit differences at once if the next 16
+       * differences are all 8-bit, the bytes are stored in order */
+      if (widx <= 12 && diffcount >= 16 && !encodedebug &&
+          _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_loadu_si128 ((__m128i *)classes),
+                                             _mm_setzero_si128 ())) == 0xFFFF)
+      {
+        _mm_storeu_si128 ((__m128i *)&frameptr[widx],
+                          _mm_packs_epi16 (_mm_packs_epi32 (_mm_loadu_si128 ((__m128i *)diffs),
+                                                            _mm_loadu_si128 ((__m128i *)(diffs + 4))),
+                                           _mm_packs_epi32 (_mm_loadu_si128 ((__m128i *)(diffs + 8)),
+                                                            _mm_loadu_si128 ((__m128i *)(diffs + 12)))));
+
+        /* 2-bit nibbles are 0b01 (0x1) */
+        frameptr[0] |= 0x55ul << (24 - 2 * widx);
+
+        widx += 3;
+        diffs += 16;
+        classes += 16;
+        diffcount -= 16;
+        outputsamples += 16;
+        continue;
+      }
+#endif
+
+      /* Determine optimal packing, the most differences fitting in:
        * 4 x 8-bit differences
        * 2 x 16-bit differences
-       * 1 x 32-bit difference */
+       * 1 x 32-bit difference
+       * from the packings allowed by each difference */
+
+      fit = (diffcount < 4) ? (1 << diffcount) - 1 : 0x0F;
 
-      word          = (union dword *)&frameptr[widx];
-      packedsamples = 0;
+      for (idx = 0; idx < 4 && idx < diffcount && (fit >> idx); idx++)
+        fit &= steim1fit[idx][classes[idx]];
+
+      packedsamples = steim1count[fit];
+
+      word = (union dword *)&frameptr[widx];
 
       /* 4 x 8-bit differences */
-      if (diffcount == 4 &&
-          bitwidth[0] <= 8 && bitwidth[1] <= 8 &&
-          bitwidth[2] <= 8 && bitwidth[3] <= 8)
+      if (packedsamples == 4)
       {
         if (encodedebug)
           ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
@@ -345,12 +516,9 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
 
         /* 2-bit nibble is 0b01 (0x1) */
         frameptr[0] |= 0x1ul << (30 - 2 * widx);
-
-        packedsamples = 4;
       }
       /* 2 x 16-bit differences */
-      else if (diffcount >= 2 &&
-               bitwidth[0] <= 16 && bitwidth[1] <= 16)
+      else if (packedsamples == 2)
       {
         if (encodedebug)
           ms_log (1, "  W%02d: 2=2x16b  %d  %d\n", widx, diffs[0], diffs[1]);
@@ -366,8 +534,6 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
 
         /* 2-bit nibble is 0b10 (0x2) */
         frameptr[0] |= 0x2ul << (30 - 2 * widx);
-
-        packedsamples = 2;
       }
       /* 1 x 32-bit difference */
       else
@@ -386,6 +552,8 @@ msr_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
         packedsamples = 1;
       }
 
+      diffs += packedsamples;
+      classes += packedsamples;
       diffcount -= packedsamples;
       outputsamples += packedsamples;
     } /* Done with words in frame */
@@ -428,9 +596,14 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
 {
   uint32_t *frameptr;  /* Frame pointer in output */
   int32_t *Xnp = NULL; /* Reverse integration constant, aka last sample */
-  int32_t diffs[7];
-  int32_t bitwidth[7];
+  int32_t diffbuf[STEIM_DIFFCHUNK];
+  uint8_t classbuf[STEIM_DIFFCHUNK];
+  int32_t *diffs;      /* Differences not yet packed */
+  uint8_t *classes;    /* Width classes of diffs */
+  uint32_t wordvalue;  /* Encoded word */
   int diffcount     = 0;
+  int fillcount;
+  int fit;
   int inputidx      = 0;
   int outputsamples = 0;
   int maxframes     = outputlength / 64;
@@ -457,9 +630,11 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
             samplecount, maxframes, swapflag);
 
   /* Add first difference to buffers */
+  diffs    = diffbuf;
+  classes  = classbuf;
   diffs[0] = diff0;
-  BITWIDTH (diffs[0], bitwidth[0]);
-  diffcount = 1;
+  classes[0] = steim_class (diff0, steim2limits, 7);
+  diffcount  = 1;
 
   for (frameidx = 0; frameidx < maxframes && outputsamples < samplecount; frameidx++)
   {
@@ -494,113 +669,118 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
 
     for (widx = startnibble; widx < 16 && outputsamples < samplecount; widx++)
     {
-      if (diffcount < 7)
+      if (diffcount < 7 && inputidx < (samplecount - 1))
       {
-        /* Shift diffs and related bit widths to beginning of buffers */
+        /* Move diffs not packed to beginning of buffers and add new diffs */
         for (idx = 0; idx < diffcount; idx++)
         {
-          diffs[idx]    = diffs[packedsamples + idx];
-          bitwidth[idx] = bitwidth[packedsamples + idx];
+          diffbuf[idx]  = diffs[idx];
+          classbuf[idx] = classes[idx];
         }
 
-        /* Add new diffs and determine bit width needed to represent */
-        for (idx = diffcount; idx < 7 && inputidx < (samplecount - 1); idx++, inputidx++)
-        {
-          diffs[idx] = *(input + inputidx + 1) - *(input + inputidx);
-          BITWIDTH (diffs[idx], bitwidth[idx]);
-          diffcount++;
-        }
+        diffs   = diffbuf;
+        classes = classbuf;
+
+        fillcount = STEIM_DIFFCHUNK - diffcount;
+        if (fillcount > (samplecount - 1) - inputidx)
+          fillcount = (samplecount - 1) - inputidx;
+
+        steim_diffs (input + inputidx, fillcount, diffs + diffcount, classes + diffcount,
+                     steim2limits, 7);
+
+        inputidx += fillcount;
+        diffcount += fillcount;
       }
 
-      /* Determine optimal packing by checking, in-order:
+      /* Determine optimal packing, the most differences fitting in:
        * 7 x 4-bit differences
        * 6 x 5-bit differences
        * 5 x 6-bit differences
        * 4 x 8-bit differences
        * 3 x 10-bit differences
        * 2 x 15-bit differences
-       * 1 x 30-bit difference */
+       * 1 x 30-bit difference
+       * from the packings allowed by each difference */
+
+      if (diffcount >= 7 &&
+          !(classes[0] | classes[1] | classes[2] | classes[3] | classes[4] | classes[5] | classes[6]))
+      {
+        packedsamples = 7;
+      }
+      else
+      {
+        fit = (diffcount < 7) ? (1 << diffcount) - 1 : 0x7F;
 
-      packedsamples = 0;
+        for (idx = 0; idx < 7 && idx < diffcount && (fit >> idx); idx++)
+          fit &= steim2fit[idx][classes[idx]];
+
+        packedsamples = steim2count[fit];
+      }
 
       /* 7 x 4-bit differences */
-      if (diffcount == 7 && bitwidth[0] <= 4 &&
-          bitwidth[1] <= 4 && bitwidth[2] <= 4 && bitwidth[3] <= 4 &&
-          bitwidth[4] <= 4 && bitwidth[5] <= 4 && bitwidth[6] <= 4)
+      if (packedsamples == 7)
       {
         if (encodedebug)
           ms_log (1, "  W%02d: 11,10=7x4b  %d  %d  %d  %d  %d  %d  %d\n",
                   widx, diffs[0], diffs[1], diffs[2], diffs[3], diffs[4], diffs[5], diffs[6]);
 
         /* Mask the values, shift to proper location and set in word */
-        frameptr[widx] = ((uint32_t)diffs[6] & 0xFul);
-        frameptr[widx] |= ((uint32_t)diffs[5] & 0xFul) << 4;
-        frameptr[widx] |= ((uint32_t)diffs[4] & 0xFul) << 8;
-        frameptr[widx] |= ((uint32_t)diffs[3] & 0xFul) << 12;
-        frameptr[widx] |= ((uint32_t)diffs[2] & 0xFul) << 16;
-        frameptr[widx] |= ((uint32_t)diffs[1] & 0xFul) << 20;
-        frameptr[widx] |= ((uint32_t)diffs[0] & 0xFul) << 24;
+        wordvalue = ((uint32_t)diffs[6] & 0xFul);
+        wordvalue |= ((uint32_t)diffs[5] & 0xFul) << 4;
+        wordvalue |= ((uint32_t)diffs[4] & 0xFul) << 8;
+        wordvalue |= ((uint32_t)diffs[3] & 0xFul) << 12;
+        wordvalue |= ((uint32_t)diffs[2] & 0xFul) << 16;
+        wordvalue |= ((uint32_t)diffs[1] & 0xFul) << 20;
+        wordvalue |= ((uint32_t)diffs[0] & 0xFul) << 24;
 
         /* 2-bit decode nibble is 0b10 (0x2) */
-        frameptr[widx] |= 0x2ul << 30;
+        wordvalue |= 0x2ul << 30;
 
         /* 2-bit nibble is 0b11 (0x3) */
         frameptr[0] |= 0x3ul << (30 - 2 * widx);
-
-        packedsamples = 7;
       }
       /* 6 x 5-bit differences */
-      else if (diffcount >= 6 &&
-               bitwidth[0] <= 5 && bitwidth[1] <= 5 && bitwidth[2] <= 5 &&
-               bitwidth[3] <= 5 && bitwidth[4] <= 5 && bitwidth[5] <= 5)
+      else if (packedsamples == 6)
       {
         if (encodedebug)
           ms_log (1, "  W%02d: 11,01=6x5b  %d  %d  %d  %d  %d  %d\n",
                   widx, diffs[0], diffs[1], diffs[2], diffs[3], diffs[4], diffs[5]);
 
         /* Mask the values, shift to proper location and set in word */
-        frameptr[widx] = ((uint32_t)diffs[5] & 0x1Ful);
-        frameptr[widx] |= ((uint32_t)diffs[4] & 0x1Ful) << 5;
-        frameptr[widx] |= ((uint32_t)diffs[3] & 0x1Ful) << 10;
-        frameptr[widx] |= ((uint32_t)diffs[2] & 0x1Ful) << 15;
-        frameptr[widx] |= ((uint32_t)diffs[1] & 0x1Ful) << 20;
-        frameptr[widx] |= ((uint32_t)diffs[0] & 0x1Ful) << 25;
+        wordvalue = ((uint32_t)diffs[5] & 0x1Ful);
+        wordvalue |= ((uint32_t)diffs[4] & 0x1Ful) << 5;
+        wordvalue |= ((uint32_t)diffs[3] & 0x1Ful) << 10;
+        wordvalue |= ((uint32_t)diffs[2] & 0x1Ful) << 15;
+        wordvalue |= ((uint32_t)diffs[1] & 0x1Ful) << 20;
+        wordvalue |= ((uint32_t)diffs[0] & 0x1Ful) << 25;
 
         /* 2-bit decode nibble is 0b01 (0x1) */
-        frameptr[widx] |= 0x1ul << 30;
+        wordvalue |= 0x1ul << 30;
 
         /* 2-bit nibble is 0b11 (0x3) */
         frameptr[0] |= 0x3ul << (30 - 2 * widx);
-
-        packedsamples = 6;
       }
       /* 5 x 6-bit differences */
-      else if (diffcount >= 5 &&
-               bitwidth[0] <= 6 && bitwidth[1] <= 6 && bitwidth[2] <= 6 &&
-               bitwidth[3] <= 6 && bitwidth[4] <= 6)
+      else if (packedsamples == 5)
       {
         if (encodedebug)
           ms_log (1, "  W%02d: 11,00=5x6b  %d  %d  %d  %d  %d\n",
                   widx, diffs[0], diffs[1], diffs[2], diffs[3], diffs[4]);
 
         /* Mask the values, shift to proper location and set in word */
-        frameptr[widx] = ((uint32_t)diffs[4] & 0x3Ful);
-        frameptr[widx] |= ((uint32_t)diffs[3] & 0x3Ful) << 6;
-        frameptr[widx] |= ((uint32_t)diffs[2] & 0x3Ful) << 12;
-        frameptr[widx] |= ((uint32_t)diffs[1] & 0x3Ful) << 18;
-        frameptr[widx] |= ((uint32_t)diffs[0] & 0x3Ful) << 24;
+        wordvalue = ((uint32_t)diffs[4] & 0x3Ful);
+        wordvalue |= ((uint32_t)diffs[3] & 0x3Ful) << 6;
+        wordvalue |= ((uint32_t)diffs[2] & 0x3Ful) << 12;
+        wordvalue |= ((uint32_t)diffs[1] & 0x3Ful) << 18;
+        wordvalue |= ((uint32_t)diffs[0] & 0x3Ful) << 24;
 
         /* 2-bit decode nibble is 0b00, nothing to set */
 
         /* 2-bit nibble is 0b11 (0x3) */
         frameptr[0] |= 0x3ul << (30 - 2 * widx);
-
-        packedsamples = 5;
       }
       /* 4 x 8-bit differences */
-      else if (diffcount >= 4 &&
-               bitwidth[0] <= 8 && bitwidth[1] <= 8 &&
-               bitwidth[2] <= 8 && bitwidth[3] <= 8)
+      else if (packedsamples == 4)
       {
         if (encodedebug)
           ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
@@ -615,68 +795,57 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
 
         /* 2-bit nibble is 0b01, only need to set 2nd bit */
         frameptr[0] |= 0x1ul << (30 - 2 * widx);
-
-        packedsamples = 4;
       }
       /* 3 x 10-bit differences */
-      else if (diffcount >= 3 &&
-               bitwidth[0] <= 10 && bitwidth[1] <= 10 && bitwidth[2] <= 10)
+      else if (packedsamples == 3)
       {
         if (encodedebug)
           ms_log (1, "  W%02d: 10,11=3x10b  %d  %d  %d\n",
                   widx, diffs[0], diffs[1], diffs[2]);
 
         /* Mask the values, shift to proper location and set in word */
-        frameptr[widx] = ((uint32_t)diffs[2] & 0x3FFul);
-        frameptr[widx] |= ((uint32_t)diffs[1] & 0x3FFul) << 10;
-        frameptr[widx] |= ((uint32_t)diffs[0] & 0x3FFul) << 20;
+        wordvalue = ((uint32_t)diffs[2] & 0x3FFul);
+        wordvalue |= ((uint32_t)diffs[1] & 0x3FFul) << 10;
+        wordvalue |= ((uint32_t)diffs[0] & 0x3FFul) << 20;
 
         /* 2-bit decode nibble is 0b11 (0x3) */
-        frameptr[widx] |= 0x3ul << 30;
+        wordvalue |= 0x3ul << 30;
 
         /* 2-bit nibble is 0b10 (0x2) */
         frameptr[0] |= 0x2ul << (30 - 2 * widx);
-
-        packedsamples = 3;
       }
       /* 2 x 15-bit differences */
-      else if (diffcount >= 2 &&
-               bitwidth[0] <= 15 && bitwidth[1] <= 15)
+      else if (packedsamples == 2)
       {
         if (encodedebug)
           ms_log (1, "  W%02d: 10,10=2x15b  %d  %d\n",
                   widx, diffs[0], diffs[1]);
 
         /* Mask the values, shift to proper location and set in word */
-        frameptr[widx] = ((uint32_t)diffs[1] & 0x7FFFul);
-        frameptr[widx] |= ((uint32_t)diffs[0] & 0x7FFFul) << 15;
+        wordvalue = ((uint32_t)diffs[1] & 0x7FFFul);
+        wordvalue |= ((uint32_t)diffs[0] & 0x7FFFul) << 15;
 
         /* 2-bit decode nibble is 0b10 (0x2) */
-        frameptr[widx] |= 0x2ul << 30;
+        wordvalue |= 0x2ul << 30;
 
         /* 2-bit nibble is 0b10 (0x2) */
         frameptr[0] |= 0x2ul << (30 - 2 * widx);
-
-        packedsamples = 2;
       }
       /* 1 x 30-bit difference */
-      else if (diffcount >= 1 &&
-               bitwidth[0] <= 30)
+      else if (packedsamples == 1)
       {
         if (encodedebug)
           ms_log (1, "  W%02d: 10,01=1x30b  %d\n",
                   widx, diffs[0]);
 
         /* Mask the value and set in word */
-        frameptr[widx] = ((uint32_t)diffs[0] & 0x3FFFFFFFul);
+        wordvalue = ((uint32_t)diffs[0] & 0x3FFFFFFFul);
 
         /* 2-bit decode nibble is 0b01 (0x1) */
-        frameptr[widx] |= 0x1ul << 30;
+        wordvalue |= 0x1ul << 30;
 
         /* 2-bit nibble is 0b10 (0x2) */
         frameptr[0] |= 0x2ul << (30 - 2 * widx);
-
-        packedsamples = 1;
       }
       else
       {
@@ -685,10 +854,17 @@ msr_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
         return -1;
       }
 
-      /* Swap encoded word except for 4x8-bit samples */
-      if (swapflag && packedsamples != 4)
-        ms_gswap4a (&frameptr[widx]);
+      /* Set encoded word, swapped if needed, except for 4x8-bit samples */
+      if (packedsamples != 4)
+      {
+        frameptr[widx] = wordvalue;
+
+        if (swapflag)
+          ms_gswap4a (&frameptr[widx]);
+      }
 
+      diffs += packedsamples;
+      classes += packedsamples;
       diffcount -= packedsamples;
       outputsamples += packedsamples;
     } /* Done with words in frame */
@@ -5,7 +5,7 @@
  *
  * Written by Chad Trabant, IRIS Data Management Center
  *
- * modified 2016.275
+ * modified 2026.289
  ***************************************************************************/
 
 #include <errno.h>
@@ -23,9 +23,12 @@ static flag verbose  = 0;
 static int reclen    = -1;
 static int encoding  = -1;
 static int byteorder = -1;
+static int pushcount = 0;
 static char *outfile = NULL;
 
 static int parameter_proc (int argcount, char **argvec);
+static int packpushed (MSRecord *msr);
+static void record_handler (char *record, int reclen, void *handlerdata);
 static void print_stderr (char *message);
 static void usage (void);
 
@@ -177,19 +180,95 @@ main (int argc, char **argv)
 
   msr->samplecnt = msr->numsamples;
 
-  rv = msr_writemseed (msr, outfile, 1, reclen, encoding, byteorder, verbose);
+  if (pushcount > 0)
+  {
+    /* The MSRecord is freed with the packer */
+    rv  = packpushed (msr);
+    msr = NULL;
+  }
+  else
+    rv = msr_writemseed (msr, outfile, 1, reclen, encoding, byteorder, verbose);
 
   if (rv < 0)
     ms_log (2, "Error (%d) writing miniSEED to %s\n", rv, outfile);
 
   /* Make sure everything is cleaned up */
-  if (msr->datasamples == sindata || msr->datasamples == textdata)
+  if (msr && (msr->datasamples == sindata || msr->datasamples == textdata))
     msr->datasamples = NULL;
   msr_free (&msr);
 
   return 0;
 } /* End of main() */
 
+/***************************************************************************
+ * packpushed:
+ *
+ * Pack the data samples of a MSRecord by pushing them to a packer in
+ * chunks of pushcount samples.  The MSRecord is used as the packer
+ * template and is freed with the packer.
+ *
+ * Returns the number of records packed on success, and -1 on failure
+ ***************************************************************************/
+static int
+packpushed (MSRecord *msr)
+{
+  MSPacker *packer;
+  FILE *ofp;
+  char *datasamples = (char *)msr->datasamples;
+  int64_t numsamples = msr->numsamples;
+  int64_t offset;
+  int64_t count;
+  int samplesize = ms_samplesize (msr->sampletype);
+  int recordcnt  = 0;
+  int rv;
+
+  if (strcmp (outfile, "-") == 0)
+    ofp = stdout;
+  else if (!(ofp = fopen (outfile, "wb")))
+    return -1;
+
+  msr->reclen      = reclen;
+  msr->datasamples = NULL;
+  msr->numsamples  = 0;
+
+  if (!(packer = msr_packer_init (msr, record_handler, ofp)))
+    return -1;
+
+  for (offset = 0; offset < numsamples; offset += count)
+  {
+    count = (numsamples - offset < pushcount) ? numsamples - offset : pushcount;
+
+    if ((rv = msr_packer_push (packer, datasamples + offset * samplesize, count, NULL, verbose)) < 0)
+      break;
+
+    recordcnt += rv;
+  }
+
+  if (offset >= numsamples && (rv = msr_packer_flush (packer, NULL, verbose)) >= 0)
+    recordcnt += rv;
+
+  msr_packer_free (&packer);
+
+  if (ofp != stdout)
+    fclose (ofp);
+
+  if (datasamples != (char *)sindata && datasamples != textdata)
+    free (datasamples);
+
+  return (rv < 0) ? -1 : recordcnt;
+} /* End of packpushed() */
+
+/***************************************************************************
+ * record_handler:
+ * Write a packed record to the output file.
+ ***************************************************************************/
+static void
+record_handler (char *record, int reclen, void *handlerdata)
+{
+  if (fwrite (record, reclen, 1, (FILE *)handlerdata) != 1)
+    ms_log (2, "Error writing record to output file\n");
+} /* End of record_handler() */
+
 /***************************************************************************
  * parameter_proc:
  *
@@ -231,6 +310,10 @@ parameter_proc (int argcount, char **argvec)
     {
       byteorder = strtol (argvec[++optind], NULL, 10);
     }
+    else if (strcmp (argvec[optind], "-p") == 0)
+    {
+      pushcount = strtol (argvec[++optind], NULL, 10);
+    }
     else if (strcmp (argvec[optind], "-o") == 0)
     {
       outfile = argvec[++optind];
@@ -284,6 +367,7 @@ usage (void)
            " -r bytes       Specify record length in bytes\n"
            " -e encoding    Specify encoding format\n"
            " -b byteorder   Specify byte order for packing, MSBF: 1, LSBF: 0\n"
+           " -p count       Pack with a packer, pushing count samples at a time\n"
            "\n"
            " -o outfile     Specify the output file, required\n"
            "\n"
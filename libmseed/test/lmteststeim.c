@@ -0,0 +1,1311 @@
+/***************************************************************************
+ * lmteststeim.c
+ *
+ * A program for libmseed Steim encoding and decoding tests.  Series of
+ * samples with differences of varied bit widths are encoded with the
+ * library encoders and with reference copies of the original encoders,
+ * the encoded frames must be identical.  For decoding the encoded
+ * frames, some of them corrupted, are decoded with the library decoders
+ * and reference copies of the original decoders, the samples must be
+ * identical.  Optionally the throughput of both is reported.
+ *
+ * Written by Chad Trabant, IRIS Data Management Center
+ *
+ * modified 2026.289
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <libmseed.h>
+#include <packdata.h>
+#include <unpackdata.h>
+
+#define VERSION "[libmseed " LIBMSEED_VERSION " example]"
+#define PACKAGE "lmteststeim"
+
+#define SERIESCOUNT 4000
+#define MAXSAMPLES 3000
+#define MAXOUTPUT 8192
+#define MAXDECODED (MAXOUTPUT / 64 * 15 * 7)
+
+/* Extract bit range, as in unpackdata.c */
+#define EXTRACTBITRANGE(VALUE, STARTBIT, LENGTH) ((VALUE >> STARTBIT) & ((1U << LENGTH) - 1))
+
+static int encoding  = 11;
+static flag benchmark = 0;
+static flag decoding  = 0;
+
+static int parameter_proc (int argcount, char **argvec);
+static uint32_t randomvalue (void);
+static int32_t randomdiff (int bits);
+static int makeseries (int32_t *series, int32_t *diff0);
+static int encode (flag reference, int32_t *input, int samplecount, int32_t *output,
+                   int outputlength, int32_t diff0, int swapflag);
+static int decodetests (void);
+static int decode (flag reference, int32_t *input, int inputlength, int samplecount,
+                   int32_t *output, int outputlength, int swapflag);
+static void throughput (flag reference);
+static int ref_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
+                              int outputlength, int32_t diff0, int swapflag);
+static int ref_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
+                              int outputlength, int32_t diff0, int swapflag);
+static int ref_decode_steim1 (int32_t *input, int inputlength, int samplecount,
+                              int32_t *output, int outputlength, char *srcname,
+                              int swapflag);
+static int ref_decode_steim2 (int32_t *input, int inputlength, int samplecount,
+                              int32_t *output, int outputlength, char *srcname,
+                              int swapflag);
+static void discard (char *message);
+static void usage (void);
+
+/* Bit widths of differences in series, around the Steim limits */
+static int diffbits[] = {1, 3, 4, 5, 6, 7, 8, 9, 10, 11, 14, 15, 16, 17, 29, 30, 31};
+#define DIFFBITSCOUNT (int)(sizeof (diffbits) / sizeof (diffbits[0]))
+
+/* Output lengths, multiples of 64 bytes and others */
+static int outputlengths[] = {64, 100, 128, 448, 512, 960, 4032, 4096, 8192};
+#define OUTPUTLENGTHCOUNT (int)(sizeof (outputlengths) / sizeof (outputlengths[0]))
+
+/* State of the random number generator, fixed for repeatable series */
+static uint32_t randomstate = 2026;
+
+int
+main (int argc, char **argv)
+{
+  int32_t series[MAXSAMPLES];
+  int32_t output[MAXOUTPUT / 4];
+  int32_t refoutput[MAXOUTPUT / 4];
+  int32_t diff0;
+  int samplecount;
+  int outputlength;
+  int swapflag;
+  int encoded  = 0;
+  int rejected = 0;
+  int differ   = 0;
+  int idx;
+  int rv;
+  int refrv;
+
+  /* Discard libmseed messages, rejected series are counted */
+  ms_loginit (discard, NULL, discard, NULL);
+
+  if (parameter_proc (argc, argv) < 0)
+    return -1;
+
+  if (encoding != DE_STEIM1 && encoding != DE_STEIM2)
+  {
+    fprintf (stderr, "Unsupported encoding: %d\n", encoding);
+    return 1;
+  }
+
+  if (decoding)
+    return decodetests ();
+
+  for (idx = 0; idx < SERIESCOUNT; idx++)
+  {
+    samplecount  = makeseries (series, &diff0);
+    outputlength = outputlengths[randomvalue () % OUTPUTLENGTHCOUNT];
+    swapflag     = idx % 2;
+
+    memset (output, 0xA5, sizeof (output));
+    memset (refoutput, 0xA5, sizeof (refoutput));
+
+    rv    = encode (0, series, samplecount, output, outputlength, diff0, swapflag);
+    refrv = encode (1, series, samplecount, refoutput, outputlength, diff0, swapflag);
+
+    if (rv != refrv || (rv >= 0 && memcmp (output, refoutput, outputlength)))
+    {
+      if (differ < 10)
+        printf ("Series %d differs: %d samples, output length %d, swap %d, "
+                "encoded %d samples, reference %d samples\n",
+                idx, samplecount, outputlength, swapflag, rv, refrv);
+      differ++;
+    }
+    else if (rv < 0)
+    {
+      rejected++;
+    }
+    else
+    {
+      encoded++;
+    }
+  }
+
+  printf ("Encoding %d: %d series identical, %d rejected by both, %d differ\n",
+          encoding, encoded, rejected, differ);
+
+  if (benchmark)
+  {
+    throughput (0);
+    throughput (1);
+  }
+
+  return (differ) ? 1 : 0;
+} /* End of main() */
+
+/***************************************************************************
+ * randomvalue:
+ *
+ * Return a pseudo-random value from a linear congruential generator,
+ * the same sequence on all platforms.
+ ***************************************************************************/
+static uint32_t
+randomvalue (void)
+{
+  randomstate = randomstate * 1664525u + 1013904223u;
+
+  return randomstate >> 8;
+} /* End of randomvalue() */
+
+/***************************************************************************
+ * randomdiff:
+ *
+ * Return a random difference representable in the specified number of
+ * bits, the limits of the range are returned more often.
+ ***************************************************************************/
+static int32_t
+randomdiff (int bits)
+{
+  int32_t max = (int32_t) ((1u << (bits - 1)) - 1);
+
+  switch (randomvalue () % 8)
+  {
+  case 0:
+    return max;
+  case 1:
+    return -max - 1;
+  default:
+    return (int32_t) (randomvalue () % ((uint32_t)max * 2 + 2)) - max - 1;
+  }
+} /* End of randomdiff() */
+
+/***************************************************************************
+ * makeseries:
+ *
+ * Generate a series of samples with differences mostly of one bit
+ * width and occasionally of another, the first difference (relating
+ * the series to a previous sample) is set in diff0.  Samples are kept
+ * within 31 bits so that all differences are within 32 bits.
+ *
+ * Returns the number of samples in the series.
+ ***************************************************************************/
+static int
+makeseries (int32_t *series, int32_t *diff0)
+{
+  int samplecount = 1 + randomvalue () % MAXSAMPLES;
+  int bits        = diffbits[randomvalue () % DIFFBITSCOUNT];
+  int otherbits   = diffbits[randomvalue () % DIFFBITSCOUNT];
+  int otherrate   = 1 + randomvalue () % 200;
+  int32_t diff;
+  int32_t value;
+  int idx;
+
+  /* Wide differences are rare in real data, limit them to some series */
+  if (otherbits > 30 && randomvalue () % 4)
+    otherbits = 30;
+
+  value   = (int32_t) (randomvalue () % 2000) - 1000;
+  *diff0  = randomdiff (bits);
+
+  for (idx = 0; idx < samplecount; idx++)
+  {
+    series[idx] = value;
+
+    diff = randomdiff ((randomvalue () % otherrate) ? bits : otherbits);
+
+    /* Reverse the difference if the next sample would be beyond 31 bits */
+    if ((int64_t)value + diff > 1073741823 || (int64_t)value + diff < -1073741824)
+      diff = -diff;
+
+    value += diff;
+  }
+
+  return samplecount;
+} /* End of makeseries() */
+
+/***************************************************************************
+ * encode:
+ *
+ * Encode samples with the library or the reference encoder of the
+ * selected encoding.
+ *
+ * Returns the number of samples encoded or -1 on error.
+ ***************************************************************************/
+static int
+encode (flag reference, int32_t *input, int samplecount, int32_t *output,
+        int outputlength, int32_t diff0, int swapflag)
+{
+  if (encoding == DE_STEIM1)
+    return (reference) ? ref_encode_steim1 (input, samplecount, output, outputlength, diff0, swapflag)
+                       : msr_encode_steim1 (input, samplecount, output, outputlength, diff0, swapflag);
+  else
+    return (reference) ? ref_encode_steim2 (input, samplecount, output, outputlength, diff0, swapflag)
+                       : msr_encode_steim2 (input, samplecount, output, outputlength, diff0,
+                                            "XX_TEST__LHZ", swapflag);
+} /* End of encode() */
+
+/***************************************************************************
+ * decodetests:
+ *
+ * Encode series with the library encoder and decode the frames with
+ * the library and the reference decoder of the selected encoding.
+ * Some frames are corrupted with random words and some decodings ask
+ * for more samples than encoded, the decoded samples and the return
+ * values must be identical.
+ *
+ * Returns 0 if all decodings are identical and 1 otherwise.
+ ***************************************************************************/
+static int
+decodetests (void)
+{
+  int32_t series[MAXSAMPLES];
+  int32_t frames[MAXOUTPUT / 4];
+  int32_t output[MAXDECODED];
+  int32_t refoutput[MAXDECODED];
+  int32_t diff0;
+  int samplecount;
+  int inputlength;
+  int swapflag;
+  int decoded  = 0;
+  int rejected = 0;
+  int differ   = 0;
+  int corrupt;
+  int idx;
+  int rv;
+  int refrv;
+
+  for (idx = 0; idx < SERIESCOUNT; idx++)
+  {
+    samplecount = makeseries (series, &diff0);
+    inputlength = outputlengths[randomvalue () % OUTPUTLENGTHCOUNT];
+    swapflag    = idx % 2;
+
+    memset (frames, 0, sizeof (frames));
+
+    /* Frames of rejected series are decoded as they are left */
+    rv = encode (0, series, samplecount, frames, inputlength, diff0, swapflag);
+    if (rv > 0)
+      samplecount = rv;
+
+    if (randomvalue () % 4 == 0)
+      samplecount += randomvalue () % 200;
+
+    if (randomvalue () % 4 == 0)
+    {
+      for (corrupt = 1 + randomvalue () % 4; corrupt > 0; corrupt--)
+        frames[randomvalue () % (inputlength / 4)] = (int32_t) ((randomvalue () << 8) ^ randomvalue ());
+    }
+
+    memset (output, 0xA5, sizeof (output));
+    memset (refoutput, 0xA5, sizeof (refoutput));
+
+    rv    = decode (0, frames, inputlength, samplecount, output, sizeof (output), swapflag);
+    refrv = decode (1, frames, inputlength, samplecount, refoutput, sizeof (refoutput), swapflag);
+
+    if (rv != refrv || (rv >= 0 && memcmp (output, refoutput, sizeof (output))))
+    {
+      if (differ < 10)
+        printf ("Series %d differs: %d samples, input length %d, swap %d, "
+                "decoded %d samples, reference %d samples\n",
+                idx, samplecount, inputlength, swapflag, rv, refrv);
+      differ++;
+    }
+    else if (rv < 0)
+    {
+      rejected++;
+    }
+    else
+    {
+      decoded++;
+    }
+  }
+
+  printf ("Decoding %d: %d series identical, %d rejected by both, %d differ\n",
+          encoding, decoded, rejected, differ);
+
+  if (benchmark)
+  {
+    throughput (0);
+    throughput (1);
+  }
+
+  return (differ) ? 1 : 0;
+} /* End of decodetests() */
+
+/***************************************************************************
+ * decode:
+ *
+ * Decode frames with the library or the reference decoder of the
+ * selected encoding.
+ *
+ * Returns the number of samples decoded or -1 on error.
+ ***************************************************************************/
+static int
+decode (flag reference, int32_t *input, int inputlength, int samplecount,
+        int32_t *output, int outputlength, int swapflag)
+{
+  if (encoding == DE_STEIM1)
+    return (reference) ? ref_decode_steim1 (input, inputlength, samplecount, output, outputlength,
+                                            "XX_TEST__LHZ", swapflag)
+                       : msr_decode_steim1 (input, inputlength, samplecount, output, outputlength,
+                                            "XX_TEST__LHZ", swapflag);
+  else
+    return (reference) ? ref_decode_steim2 (input, inputlength, samplecount, output, outputlength,
+                                            "XX_TEST__LHZ", swapflag)
+                       : msr_decode_steim2 (input, inputlength, samplecount, output, outputlength,
+                                            "XX_TEST__LHZ", swapflag);
+} /* End of decode() */
+
+/***************************************************************************
+ * throughput:
+ *
+ * Report the throughput of the library or the reference encoder, or
+ * decoder when decoding, for series of differences of typical widths
+ * packed into 4096-byte records, big-endian.
+ ***************************************************************************/
+static void
+throughput (flag reference)
+{
+  static int bits[] = {4, 8, 12, 16};
+  int32_t output[4032 / 4];
+  int32_t *series;
+  int32_t *records = NULL;
+  int *recordsamples = NULL;
+  int recordcount = 0;
+  int samplecount = 1000000;
+  int swapflag    = ms_bigendianhost () ? 0 : 1;
+  int64_t encoded = 0;
+  clock_t start;
+  double seconds;
+  int32_t value;
+  int offset;
+  int bidx;
+  int idx;
+  int rv;
+
+  if (!(series = (int32_t *)malloc (samplecount * sizeof (int32_t))))
+    return;
+
+  /* Records for decoding, at least 900 samples fit in each */
+  if (decoding &&
+      (!(records = (int32_t *)malloc ((samplecount / 900 + 1) * sizeof (output))) ||
+       !(recordsamples = (int *)malloc ((samplecount / 900 + 1) * sizeof (int)))))
+  {
+    free (series);
+    free (records);
+    return;
+  }
+
+  for (bidx = 0; bidx < (int)(sizeof (bits) / sizeof (bits[0])); bidx++)
+  {
+    for (idx = 0, value = 0; idx < samplecount; idx++)
+    {
+      series[idx] = value;
+      value       = (value > 1000000) ? value - 1000000 : value + randomdiff (bits[bidx]);
+    }
+
+    if (decoding)
+    {
+      for (offset = 0, recordcount = 0; offset < samplecount; offset += rv, recordcount++)
+      {
+        rv = encode (0, series + offset, samplecount - offset, records + recordcount * (sizeof (output) / 4),
+                     sizeof (output), 0, swapflag);
+        if (rv <= 0)
+          break;
+
+        recordsamples[recordcount] = rv;
+      }
+    }
+
+    encoded = 0;
+    start   = clock ();
+
+    while ((double)(clock () - start) / CLOCKS_PER_SEC < 0.2)
+    {
+      if (decoding)
+      {
+        for (idx = 0, offset = 0; idx < recordcount; idx++, offset += rv)
+        {
+          rv = decode (reference, records + idx * (sizeof (output) / 4), sizeof (output),
+                       recordsamples[idx], series + offset, (samplecount - offset) * sizeof (int32_t),
+                       swapflag);
+          if (rv <= 0)
+            break;
+        }
+      }
+      else
+      {
+        for (offset = 0; offset < samplecount; offset += rv)
+        {
+          rv = encode (reference, series + offset, samplecount - offset, output, sizeof (output), 0,
+                       swapflag);
+          if (rv <= 0)
+            break;
+        }
+      }
+      encoded += offset;
+    }
+
+    seconds = (double)(clock () - start) / CLOCKS_PER_SEC;
+
+    printf ("%s %s %d, %2d-bit differences: %.1f Msamples/s\n",
+            (reference) ? "Reference" : "Library  ", (decoding) ? "decoding" : "encoding",
+            encoding, bits[bidx], encoded / seconds / 1e6);
+  }
+
+  free (series);
+  free (records);
+  free (recordsamples);
+} /* End of throughput() */
+
+/* Macro to determine number of bits needed to represent VALUE in
+ * the following bit widths: 4,5,6,8,10,15,16,30,32 and set RESULT. */
+#define BITWIDTH(VALUE, RESULT)                       \
+  if (VALUE >= -8 && VALUE <= 7)                      \
+    RESULT = 4;                                       \
+  else if (VALUE >= -16 && VALUE <= 15)               \
+    RESULT = 5;                                       \
+  else if (VALUE >= -32 && VALUE <= 31)               \
+    RESULT = 6;                                       \
+  else if (VALUE >= -128 && VALUE <= 127)             \
+    RESULT = 8;                                       \
+  else if (VALUE >= -512 && VALUE <= 511)             \
+    RESULT = 10;                                      \
+  else if (VALUE >= -16384 && VALUE <= 16383)         \
+    RESULT = 15;                                      \
+  else if (VALUE >= -32768 && VALUE <= 32767)         \
+    RESULT = 16;                                      \
+  else if (VALUE >= -536870912 && VALUE <= 536870911) \
+    RESULT = 30;                                      \
+  else                                                \
+    RESULT = 32;
+
+/************************************************************************
+ * ref_encode_steim1:
+ *
+ * Reference Steim1 encoder, the original scalar msr_encode_steim1().
+ ************************************************************************/
+static int
+ref_encode_steim1 (int32_t *input, int samplecount, int32_t *output,
+                   int outputlength, int32_t diff0, int swapflag)
+{
+  int32_t *frameptr;   /* Frame pointer in output */
+  int32_t *Xnp = NULL; /* Reverse integration constant, aka last sample */
+  int32_t diffs[4];
+  int32_t bitwidth[4];
+  int diffcount     = 0;
+  int inputidx      = 0;
+  int outputsamples = 0;
+  int maxframes     = outputlength / 64;
+  int packedsamples = 0;
+  int frameidx;
+  int startnibble;
+  int widx;
+  int idx;
+
+  union dword {
+    int8_t d8[4];
+    int16_t d16[2];
+    int32_t d32;
+  } * word;
+
+  if (samplecount <= 0)
+    return 0;
+
+  if (!input || !output || outputlength <= 0)
+    return -1;
+
+  /* Add first difference to buffers */
+  diffs[0] = diff0;
+  BITWIDTH (diffs[0], bitwidth[0]);
+  diffcount = 1;
+
+  for (frameidx = 0; frameidx < maxframes && outputsamples < samplecount; frameidx++)
+  {
+    frameptr = output + (16 * frameidx);
+
+    /* Set 64-byte frame to 0's */
+    memset (frameptr, 0, 64);
+
+    /* Save forward integration constant (X0), pointer to reverse integration constant (Xn)
+     * and set the starting nibble index depending on frame. */
+    if (frameidx == 0)
+    {
+      frameptr[1] = input[0];
+
+      if (swapflag)
+        ms_gswap4a (&frameptr[1]);
+
+      Xnp = &frameptr[2];
+
+      startnibble = 3; /* First frame: skip nibbles, X0, and Xn */
+    }
+    else
+    {
+      startnibble = 1; /* Subsequent frames: skip nibbles */
+    }
+
+    for (widx = startnibble; widx < 16 && outputsamples < samplecount; widx++)
+    {
+      if (diffcount < 4)
+      {
+        /* Shift diffs and related bit widths to beginning of buffers */
+        for (idx = 0; idx < diffcount; idx++)
+        {
+          diffs[idx]    = diffs[packedsamples + idx];
+          bitwidth[idx] = bitwidth[packedsamples + idx];
+        }
+
+        /* Add new diffs and determine bit width needed to represent */
+        for (idx = diffcount; idx < 4 && inputidx < (samplecount - 1); idx++, inputidx++)
+        {
+          diffs[idx] = *(input + inputidx + 1) - *(input + inputidx);
+          BITWIDTH (diffs[idx], bitwidth[idx]);
+          diffcount++;
+        }
+      }
+
+      /* Determine optimal packing by checking, in-order:
+       * 4 x 8-bit differences
+       * 2 x 16-bit differences
+       * 1 x 32-bit difference */
+
+      word          = (union dword *)&frameptr[widx];
+      packedsamples = 0;
+
+      /* 4 x 8-bit differences */
+      if (diffcount == 4 &&
+          bitwidth[0] <= 8 && bitwidth[1] <= 8 &&
+          bitwidth[2] <= 8 && bitwidth[3] <= 8)
+      {
+        word->d8[0] = diffs[0];
+        word->d8[1] = diffs[1];
+        word->d8[2] = diffs[2];
+        word->d8[3] = diffs[3];
+
+        /* 2-bit nibble is 0b01 (0x1) */
+        frameptr[0] |= 0x1ul << (30 - 2 * widx);
+
+        packedsamples = 4;
+      }
+      /* 2 x 16-bit differences */
+      else if (diffcount >= 2 &&
+               bitwidth[0] <= 16 && bitwidth[1] <= 16)
+      {
+        word->d16[0] = diffs[0];
+        word->d16[1] = diffs[1];
+
+        if (swapflag)
+        {
+          ms_gswap2a (&word->d16[0]);
+          ms_gswap2a (&word->d16[1]);
+        }
+
+        /* 2-bit nibble is 0b10 (0x2) */
+        frameptr[0] |= 0x2ul << (30 - 2 * widx);
+
+        packedsamples = 2;
+      }
+      /* 1 x 32-bit difference */
+      else
+      {
+        frameptr[widx] = diffs[0];
+
+        if (swapflag)
+          ms_gswap4a (&frameptr[widx]);
+
+        /* 2-bit nibble is 0b11 (0x3) */
+        frameptr[0] |= 0x3ul << (30 - 2 * widx);
+
+        packedsamples = 1;
+      }
+
+      diffcount -= packedsamples;
+      outputsamples += packedsamples;
+    } /* Done with words in frame */
+
+    /* Swap word with nibbles */
+    if (swapflag)
+      ms_gswap4a (&frameptr[0]);
+  } /* Done with frames */
+
+  /* Set Xn (reverse integration constant) in first frame to last sample */
+  if (Xnp)
+    *Xnp = *(input + outputsamples - 1);
+  if (swapflag)
+    ms_gswap4a (Xnp);
+
+  /* Pad any remaining bytes */
+  if ((frameidx * 64) < outputlength)
+    memset (output + (frameidx * 16), 0, outputlength - (frameidx * 64));
+
+  return outputsamples;
+} /* End of ref_encode_steim1() */
+
+/************************************************************************
+ * ref_encode_steim2:
+ *
+ * Reference Steim2 encoder, the original scalar msr_encode_steim2().
+ ************************************************************************/
+static int
+ref_encode_steim2 (int32_t *input, int samplecount, int32_t *output,
+                   int outputlength, int32_t diff0, int swapflag)
+{
+  uint32_t *frameptr;  /* Frame pointer in output */
+  int32_t *Xnp = NULL; /* Reverse integration constant, aka last sample */
+  int32_t diffs[7];
+  int32_t bitwidth[7];
+  int diffcount     = 0;
+  int inputidx      = 0;
+  int outputsamples = 0;
+  int maxframes     = outputlength / 64;
+  int packedsamples = 0;
+  int frameidx;
+  int startnibble;
+  int widx;
+  int idx;
+
+  union dword {
+    int8_t d8[4];
+    int16_t d16[2];
+    int32_t d32;
+  } * word;
+
+  if (samplecount <= 0)
+    return 0;
+
+  if (!input || !output || outputlength <= 0)
+    return -1;
+
+  /* Add first difference to buffers */
+  diffs[0] = diff0;
+  BITWIDTH (diffs[0], bitwidth[0]);
+  diffcount = 1;
+
+  for (frameidx = 0; frameidx < maxframes && outputsamples < samplecount; frameidx++)
+  {
+    frameptr = (uint32_t *)output + (16 * frameidx);
+
+    /* Set 64-byte frame to 0's */
+    memset (frameptr, 0, 64);
+
+    /* Save forward integration constant (X0), pointer to reverse integration constant (Xn)
+     * and set the starting nibble index depending on frame. */
+    if (frameidx == 0)
+    {
+      frameptr[1] = input[0];
+
+      if (swapflag)
+        ms_gswap4a (&frameptr[1]);
+
+      Xnp = (int32_t *)&frameptr[2];
+
+      startnibble = 3; /* First frame: skip nibbles, X0, and Xn */
+    }
+    else
+    {
+      startnibble = 1; /* Subsequent frames: skip nibbles */
+    }
+
+    for (widx = startnibble; widx < 16 && outputsamples < samplecount; widx++)
+    {
+      if (diffcount < 7)
+      {
+        /* Shift diffs and related bit widths to beginning of buffers */
+        for (idx = 0; idx < diffcount; idx++)
+        {
+          diffs[idx]    = diffs[packedsamples + idx];
+          bitwidth[idx] = bitwidth[packedsamples + idx];
+        }
+
+        /* Add new diffs and determine bit width needed to represent */
+        for (idx = diffcount; idx < 7 && inputidx < (samplecount - 1); idx++, inputidx++)
+        {
+          diffs[idx] = *(input + inputidx + 1) - *(input + inputidx);
+          BITWIDTH (diffs[idx], bitwidth[idx]);
+          diffcount++;
+        }
+      }
+
+      /* Determine optimal packing by checking, in-order:
+       * 7 x 4-bit differences
+       * 6 x 5-bit differences
+       * 5 x 6-bit differences
+       * 4 x 8-bit differences
+       * 3 x 10-bit differences
+       * 2 x 15-bit differences
+       * 1 x 30-bit difference */
+
+      packedsamples = 0;
+
+      /* 7 x 4-bit differences */
+      if (diffcount == 7 && bitwidth[0] <= 4 &&
+          bitwidth[1] <= 4 && bitwidth[2] <= 4 && bitwidth[3] <= 4 &&
+          bitwidth[4] <= 4 && bitwidth[5] <= 4 && bitwidth[6] <= 4)
+      {
+        /* Mask the values, shift to proper location and set in word */
+        frameptr[widx] = ((uint32_t)diffs[6] & 0xFul);
+        frameptr[widx] |= ((uint32_t)diffs[5] & 0xFul) << 4;
+        frameptr[widx] |= ((uint32_t)diffs[4] & 0xFul) << 8;
+        frameptr[widx] |= ((uint32_t)diffs[3] & 0xFul) << 12;
+        frameptr[widx] |= ((uint32_t)diffs[2] & 0xFul) << 16;
+        frameptr[widx] |= ((uint32_t)diffs[1] & 0xFul) << 20;
+        frameptr[widx] |= ((uint32_t)diffs[0] & 0xFul) << 24;
+
+        /* 2-bit decode nibble is 0b10 (0x2) */
+        frameptr[widx] |= 0x2ul << 30;
+
+        /* 2-bit nibble is 0b11 (0x3) */
+        frameptr[0] |= 0x3ul << (30 - 2 * widx);
+
+        packedsamples = 7;
+      }
+      /* 6 x 5-bit differences */
+      else if (diffcount >= 6 &&
+               bitwidth[0] <= 5 && bitwidth[1] <= 5 && bitwidth[2] <= 5 &&
+               bitwidth[3] <= 5 && bitwidth[4] <= 5 && bitwidth[5] <= 5)
+      {
+        /* Mask the values, shift to proper location and set in word */
+        frameptr[widx] = ((uint32_t)diffs[5] & 0x1Ful);
+        frameptr[widx] |= ((uint32_t)diffs[4] & 0x1Ful) << 5;
+        frameptr[widx] |= ((uint32_t)diffs[3] & 0x1Ful) << 10;
+        frameptr[widx] |= ((uint32_t)diffs[2] & 0x1Ful) << 15;
+        frameptr[widx] |= ((uint32_t)diffs[1] & 0x1Ful) << 20;
+        frameptr[widx] |= ((uint32_t)diffs[0] & 0x1Ful) << 25;
+
+        /* 2-bit decode nibble is 0b01 (0x1) */
+        frameptr[widx] |= 0x1ul << 30;
+
+        /* 2-bit nibble is 0b11 (0x3) */
+        frameptr[0] |= 0x3ul << (30 - 2 * widx);
+
+        packedsamples = 6;
+      }
+      /* 5 x 6-bit differences */
+      else if (diffcount >= 5 &&
+               bitwidth[0] <= 6 && bitwidth[1] <= 6 && bitwidth[2] <= 6 &&
+               bitwidth[3] <= 6 && bitwidth[4] <= 6)
+      {
+        /* Mask the values, shift to proper location and set in word */
+        frameptr[widx] = ((uint32_t)diffs[4] & 0x3Ful);
+        frameptr[widx] |= ((uint32_t)diffs[3] & 0x3Ful) << 6;
+        frameptr[widx] |= ((uint32_t)diffs[2] & 0x3Ful) << 12;
+        frameptr[widx] |= ((uint32_t)diffs[1] & 0x3Ful) << 18;
+        frameptr[widx] |= ((uint32_t)diffs[0] & 0x3Ful) << 24;
+
+        /* 2-bit decode nibble is 0b00, nothing to set */
+
+        /* 2-bit nibble is 0b11 (0x3) */
+        frameptr[0] |= 0x3ul << (30 - 2 * widx);
+
+        packedsamples = 5;
+      }
+      /* 4 x 8-bit differences */
+      else if (diffcount >= 4 &&
+               bitwidth[0] <= 8 && bitwidth[1] <= 8 &&
+               bitwidth[2] <= 8 && bitwidth[3] <= 8)
+      {
+        word = (union dword *)&frameptr[widx];
+
+        word->d8[0] = diffs[0];
+        word->d8[1] = diffs[1];
+        word->d8[2] = diffs[2];
+        word->d8[3] = diffs[3];
+
+        /* 2-bit nibble is 0b01, only need to set 2nd bit */
+        frameptr[0] |= 0x1ul << (30 - 2 * widx);
+
+        packedsamples = 4;
+      }
+      /* 3 x 10-bit differences */
+      else if (diffcount >= 3 &&
+               bitwidth[0] <= 10 && bitwidth[1] <= 10 && bitwidth[2] <= 10)
+      {
+        /* Mask the values, shift to proper location and set in word */
+        frameptr[widx] = ((uint32_t)diffs[2] & 0x3FFul);
+        frameptr[widx] |= ((uint32_t)diffs[1] & 0x3FFul) << 10;
+        frameptr[widx] |= ((uint32_t)diffs[0] & 0x3FFul) << 20;
+
+        /* 2-bit decode nibble is 0b11 (0x3) */
+        frameptr[widx] |= 0x3ul << 30;
+
+        /* 2-bit nibble is 0b10 (0x2) */
+        frameptr[0] |= 0x2ul << (30 - 2 * widx);
+
+        packedsamples = 3;
+      }
+      /* 2 x 15-bit differences */
+      else if (diffcount >= 2 &&
+               bitwidth[0] <= 15 && bitwidth[1] <= 15)
+      {
+        /* Mask the values, shift to proper location and set in word */
+        frameptr[widx] = ((uint32_t)diffs[1] & 0x7FFFul);
+        frameptr[widx] |= ((uint32_t)diffs[0] & 0x7FFFul) << 15;
+
+        /* 2-bit decode nibble is 0b10 (0x2) */
+        frameptr[widx] |= 0x2ul << 30;
+
+        /* 2-bit nibble is 0b10 (0x2) */
+        frameptr[0] |= 0x2ul << (30 - 2 * widx);
+
+        packedsamples = 2;
+      }
+      /* 1 x 30-bit difference */
+      else if (diffcount >= 1 &&
+               bitwidth[0] <= 30)
+      {
+        /* Mask the value and set in word */
+        frameptr[widx] = ((uint32_t)diffs[0] & 0x3FFFFFFFul);
+
+        /* 2-bit decode nibble is 0b01 (0x1) */
+        frameptr[widx] |= 0x1ul << 30;
+
+        /* 2-bit nibble is 0b10 (0x2) */
+        frameptr[0] |= 0x2ul << (30 - 2 * widx);
+
+        packedsamples = 1;
+      }
+      else
+      {
+                return -1;
+      }
+
+      /* Swap encoded word except for 4x8-bit samples */
+      if (swapflag && packedsamples != 4)
+        ms_gswap4a (&frameptr[widx]);
+
+      diffcount -= packedsamples;
+      outputsamples += packedsamples;
+    } /* Done with words in frame */
+
+    /* Swap word with nibbles */
+    if (swapflag)
+      ms_gswap4a (&frameptr[0]);
+  } /* Done with frames */
+
+  /* Set Xn (reverse integration constant) in first frame to last sample */
+  if (Xnp)
+    *Xnp = *(input + outputsamples - 1);
+  if (swapflag)
+    ms_gswap4a (Xnp);
+
+  /* Pad any remaining bytes */
+  if ((frameidx * 64) < outputlength)
+    memset (output + (frameidx * 16), 0, outputlength - (frameidx * 64));
+
+  return outputsamples;
+} /* End of ref_encode_steim2() */
+
+/************************************************************************
+ * ref_decode_steim1:
+ *
+ * Reference Steim1 decoder, the original scalar msr_decode_steim1().
+ ************************************************************************/
+static int
+ref_decode_steim1 (int32_t *input, int inputlength, int samplecount,
+                   int32_t *output, int outputlength, char *srcname,
+                   int swapflag)
+{
+  int32_t *outputptr = output; /* Pointer to next output sample location */
+  uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
+  int32_t X0    = 0;           /* Forward integration constant, aka first sample */
+  int32_t Xn    = 0;           /* Reverse integration constant, aka last sample */
+  int maxframes = inputlength / 64;
+  int frameidx;
+  int startnibble;
+  int nibble;
+  int widx;
+  int diffcount;
+  int idx;
+
+  union dword {
+    int8_t d8[4];
+    int16_t d16[2];
+    int32_t d32;
+  } * word;
+
+  if (inputlength <= 0)
+    return 0;
+
+  if (!input || !output || outputlength <= 0 || maxframes <= 0)
+    return -1;
+
+  for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
+  {
+    /* Copy frame, each is 16x32-bit quantities = 64 bytes */
+    memcpy (frame, input + (16 * frameidx), 64);
+
+    /* Save forward integration constant (X0) and reverse integration constant (Xn)
+       and set the starting nibble index depending on frame. */
+    if (frameidx == 0)
+    {
+      if (swapflag)
+      {
+        ms_gswap4a (&frame[1]);
+        ms_gswap4a (&frame[2]);
+      }
+
+      X0 = frame[1];
+      Xn = frame[2];
+
+      startnibble = 3; /* First frame: skip nibbles, X0, and Xn */
+    }
+    else
+    {
+      startnibble = 1; /* Subsequent frames: skip nibbles */
+    }
+
+    /* Swap 32-bit word containing the nibbles */
+    if (swapflag)
+      ms_gswap4a (&frame[0]);
+
+    /* Decode each 32-bit word according to nibble */
+    for (widx = startnibble; widx < 16 && samplecount > 0; widx++)
+    {
+      /* W0: the first 32-bit contains 16 x 2-bit nibbles for each word */
+      nibble = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
+
+      word      = (union dword *)&frame[widx];
+      diffcount = 0;
+
+      switch (nibble)
+      {
+      case 0: /* 00: Special flag, no differences */
+        break;
+
+      case 1: /* 01: Four 1-byte differences */
+        diffcount = 4;
+        break;
+
+      case 2: /* 10: Two 2-byte differences */
+        diffcount = 2;
+
+        if (swapflag)
+        {
+          ms_gswap2a (&word->d16[0]);
+          ms_gswap2a (&word->d16[1]);
+        }
+        break;
+
+      case 3: /* 11: One 4-byte difference */
+        diffcount = 1;
+        if (swapflag)
+          ms_gswap4a (&word->d32);
+        break;
+      } /* Done with decoding 32-bit word based on nibble */
+
+      /* Apply accumulated differences to calculate output samples */
+      if (diffcount > 0)
+      {
+        for (idx = 0; idx < diffcount && samplecount > 0; idx++, outputptr++)
+        {
+          if (outputptr == output) /* Ignore first difference, instead store X0 */
+            *outputptr = X0;
+          else if (diffcount == 4) /* Otherwise store difference from previous sample */
+            *outputptr = *(outputptr - 1) + word->d8[idx];
+          else if (diffcount == 2)
+            *outputptr = *(outputptr - 1) + word->d16[idx];
+          else if (diffcount == 1)
+            *outputptr = *(outputptr - 1) + word->d32;
+
+          samplecount--;
+        }
+      }
+    } /* Done looping over nibbles and 32-bit words */
+  }   /* Done looping over frames */
+
+  /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
+  if (outputptr != output && *(outputptr - 1) != Xn)
+  {
+    ms_log (1, "%s: Warning: Data integrity check for Steim1 failed, Last sample=%d, Xn=%d\n",
+            srcname, *(outputptr - 1), Xn);
+  }
+
+  return (outputptr - output);
+} /* End of ref_decode_steim1() */
+
+/************************************************************************
+ * ref_decode_steim2:
+ *
+ * Reference Steim2 decoder, the original scalar msr_decode_steim2().
+ ************************************************************************/
+static int
+ref_decode_steim2 (int32_t *input, int inputlength, int samplecount,
+                   int32_t *output, int outputlength, char *srcname,
+                   int swapflag)
+{
+  int32_t *outputptr = output; /* Pointer to next output sample location */
+  uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
+  int32_t X0 = 0;              /* Forward integration constant, aka first sample */
+  int32_t Xn = 0;              /* Reverse integration constant, aka last sample */
+  int32_t diff[7];
+  int32_t semask;
+  int maxframes = inputlength / 64;
+  int frameidx;
+  int startnibble;
+  int nibble;
+  int widx;
+  int diffcount;
+  int dnib;
+  int idx;
+
+  union dword {
+    int8_t d8[4];
+    int32_t d32;
+  } * word;
+
+  if (inputlength <= 0)
+    return 0;
+
+  if (!input || !output || outputlength <= 0 || maxframes <= 0)
+    return -1;
+
+  for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
+  {
+    /* Copy frame, each is 16x32-bit quantities = 64 bytes */
+    memcpy (frame, input + (16 * frameidx), 64);
+
+    /* Save forward integration constant (X0) and reverse integration constant (Xn)
+       and set the starting nibble index depending on frame. */
+    if (frameidx == 0)
+    {
+      if (swapflag)
+      {
+        ms_gswap4a (&frame[1]);
+        ms_gswap4a (&frame[2]);
+      }
+
+      X0 = frame[1];
+      Xn = frame[2];
+
+      startnibble = 3; /* First frame: skip nibbles, X0, and Xn */
+    }
+    else
+    {
+      startnibble = 1; /* Subsequent frames: skip nibbles */
+    }
+
+    /* Swap 32-bit word containing the nibbles */
+    if (swapflag)
+      ms_gswap4a (&frame[0]);
+
+    /* Decode each 32-bit word according to nibble */
+    for (widx = startnibble; widx < 16 && samplecount > 0; widx++)
+    {
+      /* W0: the first 32-bit quantity contains 16 x 2-bit nibbles */
+      nibble    = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
+      diffcount = 0;
+
+      switch (nibble)
+      {
+      case 0: /* nibble=00: Special flag, no differences */
+        break;
+      case 1: /* nibble=01: Four 1-byte differences */
+        diffcount = 4;
+
+        word = (union dword *)&frame[widx];
+        for (idx = 0; idx < diffcount; idx++)
+        {
+          diff[idx] = word->d8[idx];
+        }
+        break;
+
+      case 2: /* nibble=10: Must consult dnib, the high order two bits */
+        if (swapflag)
+          ms_gswap4a (&frame[widx]);
+        dnib = EXTRACTBITRANGE (frame[widx], 30, 2);
+
+        switch (dnib)
+        {
+        case 0: /* nibble=10, dnib=00: Error, undefined value */
+          ms_log (2, "%s: Impossible Steim2 dnib=00 for nibble=10\n", srcname);
+
+          return -1;
+          break;
+
+        case 1: /* nibble=10, dnib=01: One 30-bit difference */
+          diffcount = 1;
+          semask    = 1ul << (30 - 1); /* Sign extension from bit 30 */
+          diff[0]   = EXTRACTBITRANGE (frame[widx], 0, 30);
+          diff[0]   = (diff[0] ^ semask) - semask;
+          break;
+
+        case 2: /* nibble=10, dnib=10: Two 15-bit differences */
+          diffcount = 2;
+          semask    = 1ul << (15 - 1); /* Sign extension from bit 15 */
+          for (idx = 0; idx < diffcount; idx++)
+          {
+            diff[idx] = EXTRACTBITRANGE (frame[widx], (15 - idx * 15), 15);
+            diff[idx] = (diff[idx] ^ semask) - semask;
+          }
+          break;
+
+        case 3: /* nibble=10, dnib=11: Three 10-bit differences */
+          diffcount = 3;
+          semask    = 1ul << (10 - 1); /* Sign extension from bit 10 */
+          for (idx = 0; idx < diffcount; idx++)
+          {
+            diff[idx] = EXTRACTBITRANGE (frame[widx], (20 - idx * 10), 10);
+            diff[idx] = (diff[idx] ^ semask) - semask;
+          }
+          break;
+        }
+
+        break;
+
+      case 3: /* nibble=11: Must consult dnib, the high order two bits */
+        if (swapflag)
+          ms_gswap4a (&frame[widx]);
+        dnib = EXTRACTBITRANGE (frame[widx], 30, 2);
+
+        switch (dnib)
+        {
+        case 0: /* nibble=11, dnib=00: Five 6-bit differences */
+          diffcount = 5;
+          semask    = 1ul << (6 - 1); /* Sign extension from bit 6 */
+          for (idx = 0; idx < diffcount; idx++)
+          {
+            diff[idx] = EXTRACTBITRANGE (frame[widx], (24 - idx * 6), 6);
+            diff[idx] = (diff[idx] ^ semask) - semask;
+          }
+          break;
+
+        case 1: /* nibble=11, dnib=01: Six 5-bit differences */
+          diffcount = 6;
+          semask    = 1ul << (5 - 1); /* Sign extension from bit 5 */
+          for (idx = 0; idx < diffcount; idx++)
+          {
+            diff[idx] = EXTRACTBITRANGE (frame[widx], (25 - idx * 5), 5);
+            diff[idx] = (diff[idx] ^ semask) - semask;
+          }
+          break;
+
+        case 2: /* nibble=11, dnib=10: Seven 4-bit differences */
+          diffcount = 7;
+          semask    = 1ul << (4 - 1); /* Sign extension from bit 4 */
+          for (idx = 0; idx < diffcount; idx++)
+          {
+            diff[idx] = EXTRACTBITRANGE (frame[widx], (24 - idx * 4), 4);
+            diff[idx] = (diff[idx] ^ semask) - semask;
+          }
+          break;
+
+        case 3: /* nibble=11, dnib=11: Error, undefined value */
+          ms_log (2, "%s: Impossible Steim2 dnib=11 for nibble=11\n", srcname);
+
+          return -1;
+          break;
+        }
+
+        break;
+      } /* Done with decoding 32-bit word based on nibble */
+
+      /* Apply differences to calculate output samples */
+      if (diffcount > 0)
+      {
+        for (idx = 0; idx < diffcount && samplecount > 0; idx++, outputptr++)
+        {
+          if (outputptr == output) /* Ignore first difference, instead store X0 */
+            *outputptr = X0;
+          else /* Otherwise store difference from previous sample */
+            *outputptr = *(outputptr - 1) + diff[idx];
+
+          samplecount--;
+        }
+      }
+    } /* Done looping over nibbles and 32-bit words */
+  }   /* Done looping over frames */
+
+  /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
+  if (outputptr != output && *(outputptr - 1) != Xn)
+  {
+    ms_log (1, "%s: Warning: Data integrity check for Steim2 failed, Last sample=%d, Xn=%d\n",
+            srcname, *(outputptr - 1), Xn);
+  }
+
+  return (outputptr - output);
+} /* End of ref_decode_steim2() */
+
+/***************************************************************************
+ * parameter_proc:
+ *
+ * Process the command line parameters.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+parameter_proc (int argcount, char **argvec)
+{
+  int optind;
+
+  /* Process all command line arguments */
+  for (optind = 1; optind < argcount; optind++)
+  {
+    if (strcmp (argvec[optind], "-V") == 0)
+    {
+      printf ("%s version: %s\n", PACKAGE, VERSION);
+      exit (0);
+    }
+    else if (strcmp (argvec[optind], "-h") == 0)
+    {
+      usage ();
+      exit (0);
+    }
+    else if (strcmp (argvec[optind], "-e") == 0 && optind + 1 < argcount)
+    {
+      encoding = strtol (argvec[++optind], NULL, 10);
+    }
+    else if (strcmp (argvec[optind], "-b") == 0)
+    {
+      benchmark = 1;
+    }
+    else if (strcmp (argvec[optind], "-d") == 0)
+    {
+      decoding = 1;
+    }
+    else
+    {
+      fprintf (stderr, "Unknown option: %s\n", argvec[optind]);
+      exit (1);
+    }
+  }
+
+  return 0;
+} /* End of parameter_proc() */
+
+/***************************************************************************
+ * discard:
+ *
+ * Discard a log message.
+ ***************************************************************************/
+static void
+discard (char *message)
+{
+  (void)message;
+} /* End of discard() */
+
+/***************************************************************************
+ * usage:
+ *
+ * Print the usage message and exit.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "%s version: %s\n\n", PACKAGE, VERSION);
+  fprintf (stderr, "Usage: %s [options]\n\n", PACKAGE);
+  fprintf (stderr,
+           " ## Options ##\n"
+           " -V             Report program version\n"
+           " -h             Show this usage message\n"
+           " -e encoding    Specify Steim encoding format, 10 or 11, default: 11\n"
+           " -b             Report encoding or decoding throughput\n"
+           " -d             Compare decoding instead of encoding\n"
+           "\n"
+           "This program compares Steim encoding, or decoding, of generated\n"
+           "series with the reference encoders or decoders\n"
+           "\n");
+} /* End of usage() */
@@ -0,0 +1,93 @@
+/***************************************************************************
+ * lmtesttrace.c
+ *
+ * A program for libmseed trace list tests.
+ *
+ * Read each input file into a single MSTraceList with ms_readtracelist(),
+ * reallocating the sample buffers of all segments to the size of their
+ * samples between files as a caller may, and print the trace list and
+ * a sum of the samples of each segment.
+ *
+ * modified 2026.290
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libmseed.h>
+
+static void print_stderr (char *message);
+
+int
+main (int argc, char **argv)
+{
+  MSTraceList *mstl = 0;
+  MSTraceID *id;
+  MSTraceSeg *seg;
+  void *datasamples;
+  int64_t idx;
+  int64_t sum;
+  int retcode;
+  int argi;
+
+  /* Redirect libmseed logging facility to stderr for consistency */
+  ms_loginit (print_stderr, NULL, print_stderr, NULL);
+
+  if (argc < 2)
+  {
+    ms_log (2, "Usage: lmtesttrace file [file ...]\n");
+    return 1;
+  }
+
+  for (argi = 1; argi < argc; argi++)
+  {
+    if ((retcode = ms_readtracelist (&mstl, argv[argi], -1, -1.0, -1.0, 0, 1, 1, 0)) != MS_NOERROR)
+    {
+      ms_log (2, "Cannot read %s: %s\n", argv[argi], ms_errorstr (retcode));
+      return 1;
+    }
+
+    /* Trim the sample buffers, usually reallocated in place */
+    for (id = mstl->traces; id; id = id->next)
+    {
+      for (seg = id->first; seg; seg = seg->next)
+      {
+        if (seg->datasamples && seg->numsamples > 0 &&
+            (datasamples = realloc (seg->datasamples, (size_t) (seg->numsamples * ms_samplesize (seg->sampletype)))))
+          seg->datasamples = datasamples;
+      }
+    }
+  }
+
+  mstl_printtracelist (mstl, 0, 1, 1);
+
+  for (id = mstl->traces; id; id = id->next)
+  {
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      sum = 0;
+
+      if (seg->sampletype == 'i')
+        for (idx = 0; idx < seg->numsamples; idx++)
+          sum += ((int32_t *)seg->datasamples)[idx];
+
+      ms_log (0, "%s: %" PRId64 " samples, sum %" PRId64 "\n",
+              id->srcname, seg->numsamples, sum);
+    }
+  }
+
+  mstl_free (&mstl, 0);
+
+  return 0;
+} /* End of main() */
+
+/***************************************************************************
+ * print_stderr():
+ * Print messsage to stderr.
+ ***************************************************************************/
+static void
+print_stderr (char *message)
+{
+  fprintf (stderr, "%s", message);
+} /* End of print_stderr() */
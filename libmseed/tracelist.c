@@ -5,7 +5,7 @@
  *
  * Written by Chad Trabant, IRIS Data Management Center
  *
- * modified: 2015.108
+ * modified: 2026.290
  ***************************************************************************/
 
 #include <stdio.h>
@@ -14,10 +14,81 @@
 #include <time.h>
 
 #include "libmseed.h"
+#include "tracelist.h"
+
+/* Maximum number of levels of the trace ID skip list */
+#define MSTL_MAXLEVEL 24
+
+/* Node of the trace ID index, an entry both in the hash table of
+ * source names and in the skip list of IDs in source name order */
+typedef struct MSTraceIDNode_s {
+  MSTraceID *id;
+  uint32_t hash;                      /* Hash of the source name */
+  struct MSTraceIDNode_s *hashnext;   /* Next node in hash table entry */
+  int level;                          /* Number of skip list levels */
+  struct MSTraceIDNode_s *forward[1]; /* Next node at each level, 'level' allocated */
+} MSTraceIDNode;
+
+/* Index of the trace IDs of a MSTraceList */
+struct MSTraceIDIndex_s {
+  MSTraceIDNode **table;              /* Hash table, 'size' entries */
+  uint32_t size;                      /* Size of hash table, a power of 2 */
+  uint32_t count;                     /* Number of IDs in index */
+  uint32_t seed;                      /* State of skip list level generator */
+  int level;                          /* Highest level in use */
+  MSTraceIDNode *head[MSTL_MAXLEVEL]; /* First node at each level */
+};
+
+/* Node of the segment index of a MSTraceID, a treap of the segments
+ * in list order where each node holds the range of end times of its
+ * subtree, allowing segments to be found by start and end time.  During
+ * a bulk addition the node also tracks the allocated size of the sample
+ * buffer, see mstl_addmsr_bulk(). */
+typedef struct MSTraceSegNode_s {
+  MSTraceSeg *seg;
+  hptime_t minend;                  /* Earliest segment end time in subtree */
+  hptime_t maxend;                  /* Latest segment end time in subtree */
+  uint32_t priority;                /* Heap priority of treap */
+  struct MSTraceSegNode_s *left;    /* Subtree of earlier segments */
+  struct MSTraceSegNode_s *right;   /* Subtree of later segments */
+  struct MSTraceSegNode_s *parent;
+  void *samples;                    /* Sample buffer allocated by the index */
+  size_t sampalloc;                 /* Allocated size of sample buffer in bytes */
+} MSTraceSegNode;
+
+/* State of a search of the segment index for segments a record fits */
+typedef struct MSTraceSegSearch_s {
+  MSRecord *msr;
+  hptime_t endtime;
+  hptime_t hpdelta;
+  hptime_t hptimetol;
+  hptime_t nhptimetol;
+  double sampratetol;
+  flag autoheal;
+  MSTraceSeg *segbefore;            /* Segment that record fits after */
+  MSTraceSeg *segafter;             /* Segment that record fits before */
+} MSTraceSegSearch;
 
 MSTraceSeg *mstl_msr2seg (MSRecord *msr, hptime_t endtime);
-MSTraceSeg *mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence);
-MSTraceSeg *mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2);
+MSTraceSeg *mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence, flag slack);
+MSTraceSeg *mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2, flag slack);
+
+static MSTraceSeg *mstl_addmsr_main (MSTraceList *mstl, MSRecord *msr, flag dataquality,
+                                     flag autoheal, double timetol, double sampratetol,
+                                     flag slack);
+static int mstl_srcnamecmp (const char *s1, const char *s2);
+static uint32_t mstl_srcnamehash (const char *srcname);
+static MSTraceID *mstl_findid (MSTraceList *mstl, const char *srcname, uint32_t hash);
+static int mstl_indexid (MSTraceList *mstl, MSTraceID *id, uint32_t hash, MSTraceID **ltid);
+static void mstl_freeindex (struct MSTraceIDIndex_s *index);
+static int mstl_indexseg (MSTraceID *id, MSTraceSeg *seg, MSTraceSeg *after);
+static void mstl_unindexseg (MSTraceID *id, MSTraceSeg *seg);
+static void mstl_updateseg (MSTraceSeg *seg);
+static void mstl_updatenode (MSTraceSegNode *node);
+static void mstl_rotateseg (MSTraceID *id, MSTraceSegNode *node);
+static int mstl_searchseg (MSTraceSegNode *node, MSTraceSegSearch *search);
+static MSTraceSeg *mstl_followseg (MSTraceID *id, hptime_t starttime);
+static int mstl_growsamples (MSTraceSeg *seg, int64_t numsamples, int samplesize, flag slack);
 
 /***************************************************************************
  * mstl_init:
@@ -61,7 +132,7 @@ mstl_init (MSTraceList *mstl)
 void
 mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
 {
-  MSTraceID *id       = 0;
+  MSTraceID *id   = 0;
   MSTraceID *nextid   = 0;
   MSTraceSeg *seg     = 0;
   MSTraceSeg *nextseg = 0;
@@ -91,6 +162,10 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
         if (seg->datasamples)
           free (seg->datasamples);
 
+        /* Free segment index node if present */
+        if (seg->node)
+          free (seg->node);
+
         free (seg);
         seg = nextseg;
       }
@@ -103,6 +178,9 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
       id = nextid;
     }
 
+    /* Free trace ID index */
+    mstl_freeindex ((*ppmstl)->index);
+
     free (*ppmstl);
 
     *ppmstl = NULL;
@@ -130,25 +208,104 @@ mstl_free (MSTraceList **ppmstl, flag freeprvtptr)
  * descending alphanumeric order.  MSTraceIDs are always maintained
  * with MSTraceSegs in data time time order.
  *
+ * The MSTraceIDs are found with a hash index of the source names and
+ * new MSTraceIDs are sorted into place with a skip list, the index is
+ * built on first use.  The MSTraceSegs of each MSTraceID are indexed
+ * by time, so records that do not fit at either end of the coverage
+ * are placed without searching all segments.  The lists of MSTraceIDs
+ * and MSTraceSegs should not be modified other than by this routine.
+ *
  * Return a pointer to the MSTraceSeg updated or 0 on error.
  ***************************************************************************/
 MSTraceSeg *
 mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
              flag autoheal, double timetol, double sampratetol)
 {
-  MSTraceID *id       = 0;
-  MSTraceID *searchid = 0;
-  MSTraceID *ltid     = 0;
+  return mstl_addmsr_main (mstl, msr, dataquality, autoheal, timetol, sampratetol, 0);
+} /* End of mstl_addmsr() */
+
+/***************************************************************************
+ * mstl_addmsr_bulk:
+ *
+ * Add data coverage from an MSRecord to a MSTraceList as done by
+ * mstl_addmsr(), as part of a bulk addition of records by libmseed.
+ * The sample buffers of indexed segments are grown geometrically,
+ * keeping room for following records so that adding a record does
+ * not reallocate and copy all of the segment samples.
+ *
+ * The room is only kept until mstl_endbulk() is called, which must
+ * happen before the MSTraceList is returned to the caller, as the
+ * caller may free or reallocate the data samples of segments.
+ *
+ * Return a pointer to the MSTraceSeg updated or 0 on error.
+ ***************************************************************************/
+MSTraceSeg *
+mstl_addmsr_bulk (MSTraceList *mstl, MSRecord *msr, flag dataquality,
+                  flag autoheal, double timetol, double sampratetol)
+{
+  return mstl_addmsr_main (mstl, msr, dataquality, autoheal, timetol, sampratetol, 1);
+} /* End of mstl_addmsr_bulk() */
+
+/***************************************************************************
+ * mstl_endbulk:
+ *
+ * Finish a bulk addition of records to a MSTraceList, trimming the
+ * sample buffers of all segments grown by mstl_addmsr_bulk() to the
+ * size of their samples and releasing the allocated sizes tracked.
+ ***************************************************************************/
+void
+mstl_endbulk (MSTraceList *mstl)
+{
+  MSTraceID *id;
+  MSTraceSeg *seg;
+  void *datasamples;
+  int samplesize;
+
+  if (!mstl)
+    return;
+
+  for (id = mstl->traces; id; id = id->next)
+  {
+    for (seg = id->first; seg; seg = seg->next)
+    {
+      if (!seg->node || !seg->node->samples)
+        continue;
+
+      if (seg->datasamples && seg->numsamples > 0 &&
+          (samplesize = ms_samplesize (seg->sampletype)) &&
+          (datasamples = realloc (seg->datasamples, (size_t) (seg->numsamples * samplesize))))
+        seg->datasamples = datasamples;
+
+      seg->node->samples   = 0;
+      seg->node->sampalloc = 0;
+    }
+  }
+} /* End of mstl_endbulk() */
+
+/***************************************************************************
+ * mstl_addmsr_main:
+ *
+ * Add data coverage from an MSRecord to a MSTraceList, see
+ * mstl_addmsr().  If the slack flag is true the sample buffers of
+ * segments keep room for following records, see mstl_addmsr_bulk().
+ *
+ * Return a pointer to the MSTraceSeg updated or 0 on error.
+ ***************************************************************************/
+static MSTraceSeg *
+mstl_addmsr_main (MSTraceList *mstl, MSRecord *msr, flag dataquality,
+                  flag autoheal, double timetol, double sampratetol,
+                  flag slack)
+{
+  MSTraceID *id   = 0;
+  MSTraceID *ltid = 0;
 
   MSTraceSeg *seg       = 0;
-  MSTraceSeg *searchseg = 0;
   MSTraceSeg *segbefore = 0;
   MSTraceSeg *segafter  = 0;
   MSTraceSeg *followseg = 0;
+  MSTraceSegSearch search;
 
   hptime_t endtime;
-  hptime_t pregap;
-  hptime_t postgap;
   hptime_t lastgap;
   hptime_t firstgap;
   hptime_t hpdelta;
@@ -157,13 +314,11 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
 
   char srcname[45];
   char *s1, *s2;
-  flag whence;
+  uint32_t hash = 0;
   flag lastratecheck;
   flag firstratecheck;
-  int mag;
-  int cmp;
-  int ltmag;
-  int ltcmp;
+  flag moved = 0;
+  int cmp    = 1;
 
   if (!mstl || !msr)
     return 0;
@@ -183,7 +338,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   }
 
   /* Search for matching trace ID starting with last accessed ID and
-     then looping through the trace ID list. */
+     then in the trace ID index. */
   if (mstl->last)
   {
     s1 = mstl->last->srcname;
@@ -196,61 +351,14 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     cmp = (*s1 - *--s2);
 
     if (!cmp)
-    {
       id = mstl->last;
-    }
-    else
-    {
-      /* Loop through trace ID list searching for a match, simultaneously
-         track the source name which is closest but less than the MSRecord
-         to allow for later insertion with sort order. */
-      searchid = mstl->traces;
-      ltcmp    = 0;
-      ltmag    = 0;
-      while (searchid)
-      {
-        /* Compare source names */
-        s1  = searchid->srcname;
-        s2  = srcname;
-        mag = 0;
-        while (*s1 == *s2++)
-        {
-          mag++;
-          if (*s1++ == '\0')
-            break;
-        }
-        cmp = (*s1 - *--s2);
-
-        /* If source names did not match track closest "less than" value
-           and continue searching. */
-        if (cmp != 0)
-        {
-          if (cmp < 0)
-          {
-            if ((ltcmp == 0 || cmp >= ltcmp) && mag >= ltmag)
-            {
-              ltcmp = cmp;
-              ltmag = mag;
-              ltid  = searchid;
-            }
-            else if (mag > ltmag)
-            {
-              ltcmp = cmp;
-              ltmag = mag;
-              ltid  = searchid;
-            }
-          }
-
-          searchid = searchid->next;
-          continue;
-        }
+  }
 
-        /* If we made it this far we found a match */
-        id = searchid;
-        break;
-      }
-    }
-  } /* Done searching for match in trace ID list */
+  if (cmp)
+  {
+    hash = mstl_srcnamehash (srcname);
+    id   = mstl_findid (mstl, srcname, hash);
+  }
 
   /* If no matching ID was found create new MSTraceID and MSTraceSeg entries */
   if (!id)
@@ -275,10 +383,24 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
 
     if (!(seg = mstl_msr2seg (msr, endtime)))
     {
+      free (id);
       return 0;
     }
     id->first = id->last = seg;
 
+    /* Add new MSTraceID to index, finding the ID it follows in sort order */
+    if (mstl_indexseg (id, seg, 0) || mstl_indexid (mstl, id, hash, &ltid))
+    {
+      ms_log (2, "mstl_addmsr(): Error allocating memory\n");
+      if (seg->datasamples)
+        free (seg->datasamples);
+      if (seg->node)
+        free (seg->node);
+      free (seg);
+      free (id);
+      return 0;
+    }
+
     /* Add new MSTraceID to MSTraceList */
     if (!mstl->traces || !ltid)
     {
@@ -340,7 +462,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     /* Record coverage fits at end of last segment */
     if (lastgap <= hptimetol && lastgap >= nhptimetol && lastratecheck)
     {
-      if (!mstl_addmsrtoseg (id->last, msr, endtime, 1))
+      if (!mstl_addmsrtoseg (id->last, msr, endtime, 1, slack))
         return 0;
 
       seg = id->last;
@@ -354,6 +476,14 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       if (!(seg = mstl_msr2seg (msr, endtime)))
         return 0;
 
+      if (mstl_indexseg (id, seg, id->last))
+      {
+        ms_log (2, "mstl_addmsr(): Error allocating memory\n");
+        free (seg->datasamples);
+        free (seg);
+        return 0;
+      }
+
       /* Add to end of list */
       id->last->next = seg;
       seg->prev      = id->last;
@@ -369,6 +499,14 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       if (!(seg = mstl_msr2seg (msr, endtime)))
         return 0;
 
+      if (mstl_indexseg (id, seg, 0))
+      {
+        ms_log (2, "mstl_addmsr(): Error allocating memory\n");
+        free (seg->datasamples);
+        free (seg);
+        return 0;
+      }
+
       /* Add to beginning of list */
       id->first->prev = seg;
       seg->next       = id->first;
@@ -381,7 +519,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
     /* Record coverage fits at beginning of first segment */
     else if (firstgap <= hptimetol && firstgap >= nhptimetol && firstratecheck)
     {
-      if (!mstl_addmsrtoseg (id->first, msr, endtime, 2))
+      if (!mstl_addmsrtoseg (id->first, msr, endtime, 2, slack))
         return 0;
 
       seg = id->first;
@@ -389,71 +527,28 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       if (msr->starttime < id->earliest)
         id->earliest = msr->starttime;
     }
-    /* Search complete segment list for matches */
+    /* Search segment index for matches */
     else
     {
-      searchseg = id->first;
-      segbefore = 0; /* Find segment that record fits before */
-      segafter  = 0; /* Find segment that record fits after */
-      followseg = 0; /* Track segment that record follows in time order */
-      while (searchseg)
-      {
-        if (msr->starttime > searchseg->starttime)
-          followseg = searchseg;
-
-        whence = 0;
+      search.msr         = msr;
+      search.endtime     = endtime;
+      search.hpdelta     = hpdelta;
+      search.hptimetol   = hptimetol;
+      search.nhptimetol  = nhptimetol;
+      search.sampratetol = sampratetol;
+      search.autoheal    = autoheal;
+      search.segbefore   = 0; /* Find segment that record fits before */
+      search.segafter    = 0; /* Find segment that record fits after */
 
-        postgap = msr->starttime - searchseg->endtime - hpdelta;
-        if (!segbefore && postgap <= hptimetol && postgap >= nhptimetol)
-          whence = 1;
+      mstl_searchseg (id->segindex, &search);
 
-        pregap = searchseg->starttime - endtime - hpdelta;
-        if (!segafter && pregap <= hptimetol && pregap >= nhptimetol)
-          whence = 2;
-
-        if (!whence)
-        {
-          searchseg = searchseg->next;
-          continue;
-        }
-
-        if (sampratetol == -1.0)
-        {
-          if (!MS_ISRATETOLERABLE (msr->samprate, searchseg->samprate))
-          {
-            searchseg = searchseg->next;
-            continue;
-          }
-        }
-        else
-        {
-          if (ms_dabs (msr->samprate - searchseg->samprate) > sampratetol)
-          {
-            searchseg = searchseg->next;
-            continue;
-          }
-        }
-
-        if (whence == 1)
-          segbefore = searchseg;
-        else
-          segafter = searchseg;
-
-        /* Done searching if not autohealing */
-        if (!autoheal)
-          break;
-
-        /* Done searching if both before and after segments are found */
-        if (segbefore && segafter)
-          break;
-
-        searchseg = searchseg->next;
-      } /* Done looping through segments */
+      segbefore = search.segbefore;
+      segafter  = search.segafter;
 
       /* Add MSRecord coverage to end of segment before */
       if (segbefore)
       {
-        if (!mstl_addmsrtoseg (segbefore, msr, endtime, 1))
+        if (!mstl_addmsrtoseg (segbefore, msr, endtime, 1, slack))
         {
           return 0;
         }
@@ -462,7 +557,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
         if (autoheal && segafter && segbefore != segafter)
         {
           /* Add segafter coverage to segbefore */
-          if (!mstl_addsegtoseg (segbefore, segafter))
+          if (!mstl_addsegtoseg (segbefore, segafter, slack))
           {
             return 0;
           }
@@ -471,6 +566,8 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
           if (segafter == id->last)
             id->last = id->last->prev;
 
+          mstl_unindexseg (id, segafter);
+
           /* Remove segafter from list */
           if (segafter->prev)
             segafter->prev->next = segafter->next;
@@ -492,7 +589,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       /* Add MSRecord coverage to beginning of segment after */
       else if (segafter)
       {
-        if (!mstl_addmsrtoseg (segafter, msr, endtime, 2))
+        if (!mstl_addmsrtoseg (segafter, msr, endtime, 2, slack))
         {
           return 0;
         }
@@ -508,6 +605,17 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
           return 0;
         }
 
+        /* Track segment that record follows in time order */
+        followseg = mstl_followseg (id, msr->starttime);
+
+        if (mstl_indexseg (id, seg, followseg))
+        {
+          ms_log (2, "mstl_addmsr(): Error allocating memory\n");
+          free (seg->datasamples);
+          free (seg);
+          return 0;
+        }
+
         /* Add new segment as first in list */
         if (!followseg)
         {
@@ -548,6 +656,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   {
     /* Move segment down list, swap seg and seg->next */
     segafter = seg->next;
+    moved    = 1;
 
     if (seg->prev)
       seg->prev->next = segafter;
@@ -572,6 +681,7 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
   {
     /* Move segment up list, swap seg and seg->prev */
     segbefore = seg->prev;
+    moved     = 1;
 
     if (seg->next)
       seg->next->prev = segbefore;
@@ -592,11 +702,570 @@ mstl_addmsr (MSTraceList *mstl, MSRecord *msr, flag dataquality,
       id->last = segbefore;
   }
 
+  /* Update segment index for the modified segment, moving it if needed */
+  if (moved)
+  {
+    mstl_unindexseg (id, seg);
+
+    if (mstl_indexseg (id, seg, seg->prev))
+    {
+      ms_log (2, "mstl_addmsr(): Error allocating memory\n");
+      return 0;
+    }
+  }
+  else
+  {
+    mstl_updateseg (seg);
+  }
+
   /* Set MSTraceID as last accessed */
   mstl->last = id;
 
   return seg;
-} /* End of mstl_addmsr() */
+} /* End of mstl_addmsr_main() */
+
+/***************************************************************************
+ * mstl_srcnamecmp:
+ *
+ * Compare two source names, the same comparison used to sort trace
+ * IDs by mstl_addmsr().
+ *
+ * Return the difference of the first differing characters, negative
+ * if s1 sorts before s2, 0 if equal and positive if after.
+ ***************************************************************************/
+static int
+mstl_srcnamecmp (const char *s1, const char *s2)
+{
+  while (*s1 == *s2++)
+  {
+    if (*s1++ == '\0')
+      return 0;
+  }
+
+  return (*s1 - *--s2);
+} /* End of mstl_srcnamecmp() */
+
+/***************************************************************************
+ * mstl_srcnamehash:
+ *
+ * Return the 32-bit FNV-1a hash of a source name.
+ ***************************************************************************/
+static uint32_t
+mstl_srcnamehash (const char *srcname)
+{
+  uint32_t hash = 2166136261u;
+
+  while (*srcname)
+    hash = (hash ^ (uint8_t)*srcname++) * 16777619u;
+
+  return hash;
+} /* End of mstl_srcnamehash() */
+
+/***************************************************************************
+ * mstl_findid:
+ *
+ * Find the MSTraceID with a source name in the trace ID index of a
+ * MSTraceList, building the index from the list if needed.
+ *
+ * Return a pointer to the MSTraceID or 0 if not found or on error.
+ ***************************************************************************/
+static MSTraceID *
+mstl_findid (MSTraceList *mstl, const char *srcname, uint32_t hash)
+{
+  MSTraceIDNode *node;
+  MSTraceID *id;
+
+  /* Build index of the IDs in the list */
+  if (!mstl->index)
+  {
+    if (!(mstl->index = (struct MSTraceIDIndex_s *)calloc (1, sizeof (struct MSTraceIDIndex_s))))
+    {
+      ms_log (2, "mstl_findid(): Error allocating memory\n");
+      return 0;
+    }
+
+    mstl->index->seed = 2463534242u;
+
+    for (id = mstl->traces; id; id = id->next)
+    {
+      if (mstl_indexid (mstl, id, mstl_srcnamehash (id->srcname), NULL))
+      {
+        ms_log (2, "mstl_findid(): Error allocating memory\n");
+        mstl_freeindex (mstl->index);
+        mstl->index = 0;
+        return 0;
+      }
+    }
+  }
+
+  if (!mstl->index->size)
+    return 0;
+
+  for (node = mstl->index->table[hash & (mstl->index->size - 1)]; node; node = node->hashnext)
+  {
+    if (node->hash == hash && !strcmp (node->id->srcname, srcname))
+      return node->id;
+  }
+
+  return 0;
+} /* End of mstl_findid() */
+
+/***************************************************************************
+ * mstl_indexid:
+ *
+ * Add a MSTraceID to the trace ID index of a MSTraceList.  The hash
+ * table is doubled in size when the number of IDs exceeds it.
+ *
+ * If ltid is not NULL it is set to the indexed MSTraceID that sorts
+ * immediately before the new ID, or 0 if the new ID sorts first.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl_indexid (MSTraceList *mstl, MSTraceID *id, uint32_t hash, MSTraceID **ltid)
+{
+  struct MSTraceIDIndex_s *index = mstl->index;
+  MSTraceIDNode **update[MSTL_MAXLEVEL];
+  MSTraceIDNode **forward;
+  MSTraceIDNode **table;
+  MSTraceIDNode *node;
+  MSTraceIDNode *prev = 0;
+  MSTraceIDNode *next;
+  uint32_t size;
+  uint32_t idx;
+  int level;
+
+  if (!index)
+    return -1;
+
+  /* Grow hash table as needed */
+  if (index->count >= index->size)
+  {
+    size = (index->size) ? index->size * 2 : 64;
+
+    if (!(table = (MSTraceIDNode **)calloc (size, sizeof (MSTraceIDNode *))))
+      return -1;
+
+    for (idx = 0; idx < index->size; idx++)
+    {
+      for (node = index->table[idx]; node; node = next)
+      {
+        next           = node->hashnext;
+        node->hashnext = table[node->hash & (size - 1)];
+
+        table[node->hash & (size - 1)] = node;
+      }
+    }
+
+    if (index->table)
+      free (index->table);
+
+    index->table = table;
+    index->size  = size;
+  }
+
+  /* Choose a random level, each level with a quarter of the nodes of the level below */
+  level = 1;
+  do
+  {
+    index->seed ^= index->seed << 13;
+    index->seed ^= index->seed >> 17;
+    index->seed ^= index->seed << 5;
+  } while ((index->seed & 3) == 0 && ++level < MSTL_MAXLEVEL);
+
+  if (!(node = (MSTraceIDNode *)malloc (sizeof (MSTraceIDNode) + (level - 1) * sizeof (MSTraceIDNode *))))
+    return -1;
+
+  node->id    = id;
+  node->hash  = hash;
+  node->level = level;
+
+  /* Find the last node sorting before the ID at each level */
+  forward = index->head;
+  for (idx = index->level; idx-- > 0;)
+  {
+    while (forward[idx] && mstl_srcnamecmp (forward[idx]->id->srcname, id->srcname) < 0)
+    {
+      prev    = forward[idx];
+      forward = prev->forward;
+    }
+
+    update[idx] = forward;
+  }
+
+  for (idx = index->level; idx < (uint32_t)level; idx++)
+    update[idx] = index->head;
+
+  if (level > index->level)
+    index->level = level;
+
+  /* Link node into skip list and hash table */
+  for (idx = 0; idx < (uint32_t)level; idx++)
+  {
+    node->forward[idx] = update[idx][idx];
+    update[idx][idx]   = node;
+  }
+
+  node->hashnext = index->table[hash & (index->size - 1)];
+
+  index->table[hash & (index->size - 1)] = node;
+  index->count++;
+
+  if (ltid)
+    *ltid = (prev) ? prev->id : 0;
+
+  return 0;
+} /* End of mstl_indexid() */
+
+/***************************************************************************
+ * mstl_freeindex:
+ *
+ * Free all memory associated with a trace ID index.
+ ***************************************************************************/
+static void
+mstl_freeindex (struct MSTraceIDIndex_s *index)
+{
+  MSTraceIDNode *node;
+  MSTraceIDNode *next;
+  uint32_t idx;
+
+  if (!index)
+    return;
+
+  for (idx = 0; idx < index->size; idx++)
+  {
+    for (node = index->table[idx]; node; node = next)
+    {
+      next = node->hashnext;
+      free (node);
+    }
+  }
+
+  if (index->table)
+    free (index->table);
+
+  free (index);
+} /* End of mstl_freeindex() */
+
+/***************************************************************************
+ * mstl_indexseg:
+ *
+ * Add a MSTraceSeg to the segment index of a MSTraceID, following the
+ * segment after in list order or as the first segment if after is
+ * NULL.  The priority of the node is derived from its address.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl_indexseg (MSTraceID *id, MSTraceSeg *seg, MSTraceSeg *after)
+{
+  MSTraceSegNode *node;
+  MSTraceSegNode *parent;
+  uint64_t mix;
+
+  if (!(node = (MSTraceSegNode *)calloc (1, sizeof (MSTraceSegNode))))
+    return -1;
+
+  mix = (uint64_t) (uintptr_t)node;
+  mix ^= mix >> 33;
+  mix *= 0xff51afd7ed558ccdULL;
+  mix ^= mix >> 33;
+
+  node->seg      = seg;
+  node->minend   = seg->endtime;
+  node->maxend   = seg->endtime;
+  node->priority = (uint32_t)mix;
+  seg->node      = node;
+
+  /* Attach as a leaf immediately after the 'after' node or first */
+  if (!id->segindex)
+  {
+    id->segindex = node;
+    return 0;
+  }
+
+  if (!after)
+  {
+    for (parent = id->segindex; parent->left; parent = parent->left)
+      ;
+    parent->left = node;
+  }
+  else if (!after->node->right)
+  {
+    parent        = after->node;
+    parent->right = node;
+  }
+  else
+  {
+    for (parent = after->node->right; parent->left; parent = parent->left)
+      ;
+    parent->left = node;
+  }
+
+  node->parent = parent;
+
+  for (; parent; parent = parent->parent)
+  {
+    if (parent->minend > node->minend)
+      parent->minend = node->minend;
+    if (parent->maxend < node->maxend)
+      parent->maxend = node->maxend;
+  }
+
+  /* Restore heap order of priorities */
+  while (node->parent && node->priority > node->parent->priority)
+    mstl_rotateseg (id, node);
+
+  return 0;
+} /* End of mstl_indexseg() */
+
+/***************************************************************************
+ * mstl_unindexseg:
+ *
+ * Remove a MSTraceSeg from the segment index of a MSTraceID.
+ ***************************************************************************/
+static void
+mstl_unindexseg (MSTraceID *id, MSTraceSeg *seg)
+{
+  MSTraceSegNode *node = seg->node;
+  MSTraceSegNode *parent;
+
+  if (!node)
+    return;
+
+  /* Rotate the node down to a leaf */
+  while (node->left || node->right)
+  {
+    if (!node->right || (node->left && node->left->priority > node->right->priority))
+      mstl_rotateseg (id, node->left);
+    else
+      mstl_rotateseg (id, node->right);
+  }
+
+  if ((parent = node->parent))
+  {
+    if (parent->left == node)
+      parent->left = 0;
+    else
+      parent->right = 0;
+
+    mstl_updateseg (parent->seg);
+  }
+  else
+  {
+    id->segindex = 0;
+  }
+
+  free (node);
+  seg->node = 0;
+} /* End of mstl_unindexseg() */
+
+/***************************************************************************
+ * mstl_updateseg:
+ *
+ * Update the end time ranges of the subtrees containing a MSTraceSeg
+ * after its end time changed.
+ ***************************************************************************/
+static void
+mstl_updateseg (MSTraceSeg *seg)
+{
+  MSTraceSegNode *node;
+
+  for (node = seg->node; node; node = node->parent)
+    mstl_updatenode (node);
+} /* End of mstl_updateseg() */
+
+/***************************************************************************
+ * mstl_updatenode:
+ *
+ * Set the end time range of the subtree of a segment index node from
+ * its segment and child nodes.
+ ***************************************************************************/
+static void
+mstl_updatenode (MSTraceSegNode *node)
+{
+  node->minend = node->maxend = node->seg->endtime;
+
+  if (node->left)
+  {
+    if (node->left->minend < node->minend)
+      node->minend = node->left->minend;
+    if (node->left->maxend > node->maxend)
+      node->maxend = node->left->maxend;
+  }
+
+  if (node->right)
+  {
+    if (node->right->minend < node->minend)
+      node->minend = node->right->minend;
+    if (node->right->maxend > node->maxend)
+      node->maxend = node->right->maxend;
+  }
+} /* End of mstl_updatenode() */
+
+/***************************************************************************
+ * mstl_rotateseg:
+ *
+ * Rotate a node of a segment index above its parent, keeping the list
+ * order of the nodes and the end time ranges of the subtrees.
+ ***************************************************************************/
+static void
+mstl_rotateseg (MSTraceID *id, MSTraceSegNode *node)
+{
+  MSTraceSegNode *parent = node->parent;
+  MSTraceSegNode *child;
+
+  if (parent->left == node)
+  {
+    child         = node->right;
+    parent->left  = child;
+    node->right   = parent;
+  }
+  else
+  {
+    child         = node->left;
+    parent->right = child;
+    node->left    = parent;
+  }
+
+  if (child)
+    child->parent = parent;
+
+  node->parent = parent->parent;
+
+  if (!node->parent)
+    id->segindex = node;
+  else if (node->parent->left == parent)
+    node->parent->left = node;
+  else
+    node->parent->right = node;
+
+  parent->parent = node;
+
+  /* The subtree of the rotated node is that of the parent before */
+  node->minend = parent->minend;
+  node->maxend = parent->maxend;
+  mstl_updatenode (parent);
+} /* End of mstl_rotateseg() */
+
+/***************************************************************************
+ * mstl_searchseg:
+ *
+ * Search a segment index in list order for the segments a record fits
+ * after (search->segbefore) and before (search->segafter), with the
+ * same logic as testing every segment in the list.  Only subtrees that
+ * can contain a segment ending or starting within the time tolerance
+ * of the record are searched, using the end time ranges of subtrees
+ * and the start time order of the list.
+ *
+ * Return 1 when the search is complete, otherwise 0.
+ ***************************************************************************/
+static int
+mstl_searchseg (MSTraceSegNode *node, MSTraceSegSearch *search)
+{
+  MSTraceSeg *seg;
+  hptime_t postgap;
+  hptime_t pregap;
+  hptime_t endmin;
+  hptime_t endmax;
+  hptime_t startmin;
+  hptime_t startmax;
+  flag whence;
+
+  if (!node)
+    return 0;
+
+  seg = node->seg;
+
+  /* Range of end times of segments the record follows and of start
+   * times of segments the record precedes */
+  endmin   = search->msr->starttime - search->hpdelta - search->hptimetol;
+  endmax   = search->msr->starttime - search->hpdelta - search->nhptimetol;
+  startmin = search->endtime + search->hpdelta + search->nhptimetol;
+  startmax = search->endtime + search->hpdelta + search->hptimetol;
+
+  /* Earlier segments, starting no later than this segment */
+  if (node->left && ((node->left->maxend >= endmin && node->left->minend <= endmax) ||
+                     seg->starttime >= startmin))
+    if (mstl_searchseg (node->left, search))
+      return 1;
+
+  whence = 0;
+
+  postgap = search->msr->starttime - seg->endtime - search->hpdelta;
+  if (!search->segbefore && postgap <= search->hptimetol && postgap >= search->nhptimetol)
+    whence = 1;
+
+  pregap = seg->starttime - search->endtime - search->hpdelta;
+  if (!search->segafter && pregap <= search->hptimetol && pregap >= search->nhptimetol)
+    whence = 2;
+
+  if (whence)
+  {
+    if (search->sampratetol == -1.0)
+    {
+      if (!MS_ISRATETOLERABLE (search->msr->samprate, seg->samprate))
+        whence = 0;
+    }
+    else
+    {
+      if (ms_dabs (search->msr->samprate - seg->samprate) > search->sampratetol)
+        whence = 0;
+    }
+  }
+
+  if (whence)
+  {
+    if (whence == 1)
+      search->segbefore = seg;
+    else
+      search->segafter = seg;
+
+    /* Done searching if not autohealing */
+    if (!search->autoheal)
+      return 1;
+
+    /* Done searching if both before and after segments are found */
+    if (search->segbefore && search->segafter)
+      return 1;
+  }
+
+  /* Later segments, starting no earlier than this segment */
+  if (node->right && ((node->right->maxend >= endmin && node->right->minend <= endmax) ||
+                      seg->starttime <= startmax))
+    return mstl_searchseg (node->right, search);
+
+  return 0;
+} /* End of mstl_searchseg() */
+
+/***************************************************************************
+ * mstl_followseg:
+ *
+ * Find the last segment of a MSTraceID starting before a time.
+ *
+ * Return a pointer to the MSTraceSeg or 0 if no segment starts before.
+ ***************************************************************************/
+static MSTraceSeg *
+mstl_followseg (MSTraceID *id, hptime_t starttime)
+{
+  MSTraceSegNode *node = id->segindex;
+  MSTraceSeg *followseg = 0;
+
+  while (node)
+  {
+    if (starttime > node->seg->starttime)
+    {
+      followseg = node->seg;
+      node      = node->right;
+    }
+    else
+    {
+      node = node->left;
+    }
+  }
+
+  return followseg;
+} /* End of mstl_followseg() */
 
 /***************************************************************************
  * mstl_msr2seg:
@@ -653,13 +1322,15 @@ mstl_msr2seg (MSRecord *msr, hptime_t endtime)
  * 1 : add coverage to the end
  * 2 : add coverage to the beginninig
  *
+ * If the slack flag is true the sample buffer keeps room for following
+ * records, see mstl_growsamples().
+ *
  * Return a pointer to a MSTraceSeg otherwise 0 on error.
  ***************************************************************************/
 MSTraceSeg *
-mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence)
+mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence, flag slack)
 {
   int samplesize = 0;
-  void *newdatasamples;
 
   if (!seg || !msr)
     return 0;
@@ -680,13 +1351,11 @@ mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence)
       return 0;
     }
 
-    if (!(newdatasamples = realloc (seg->datasamples, (size_t) ((seg->numsamples + msr->numsamples) * samplesize))))
+    if (mstl_growsamples (seg, seg->numsamples + msr->numsamples, samplesize, slack))
     {
       ms_log (2, "mstl_addmsrtoseg(): Error allocating memory\n");
       return 0;
     }
-
-    seg->datasamples = newdatasamples;
   }
 
   /* Add coverage to end of segment */
@@ -735,15 +1404,16 @@ mstl_addmsrtoseg (MSTraceSeg *seg, MSRecord *msr, hptime_t endtime, flag whence)
 /***************************************************************************
  * mstl_addsegtoseg:
  *
- * Add data coverage from seg2 to seg1.
+ * Add data coverage from seg2 to seg1.  If the slack flag is true the
+ * sample buffer keeps room for following records, see
+ * mstl_growsamples().
  *
  * Return a pointer to a seg1 otherwise 0 on error.
  ***************************************************************************/
 MSTraceSeg *
-mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2)
+mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2, flag slack)
 {
   int samplesize = 0;
-  void *newdatasamples;
 
   if (!seg1 || !seg2)
     return 0;
@@ -764,13 +1434,11 @@ mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2)
       return 0;
     }
 
-    if (!(newdatasamples = realloc (seg1->datasamples, (size_t) ((seg1->numsamples + seg2->numsamples) * samplesize))))
+    if (mstl_growsamples (seg1, seg1->numsamples + seg2->numsamples, samplesize, slack))
     {
       ms_log (2, "mstl_addsegtoseg(): Error allocating memory\n");
       return 0;
     }
-
-    seg1->datasamples = newdatasamples;
   }
 
   /* Add seg2 coverage to end of seg1 */
@@ -789,6 +1457,52 @@ mstl_addsegtoseg (MSTraceSeg *seg1, MSTraceSeg *seg2)
   return seg1;
 } /* End of mstl_addsegtoseg() */
 
+/***************************************************************************
+ * mstl_growsamples:
+ *
+ * Make room in the data sample buffer of a MSTraceSeg for the
+ * specified total number of samples.  If the slack flag is true the
+ * buffer of an indexed segment is grown geometrically, leaving room
+ * for following records so that adding a record does not reallocate
+ * and copy all of the segment samples.  The allocated size is tracked
+ * in the segment index node until mstl_endbulk() trims the buffer.
+ *
+ * Without slack the buffer is reallocated to the size needed, as the
+ * caller owns the data samples and may have reallocated them.
+ *
+ * Return 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+mstl_growsamples (MSTraceSeg *seg, int64_t numsamples, int samplesize, flag slack)
+{
+  MSTraceSegNode *node = seg->node;
+  void *newdatasamples;
+  size_t needed = (size_t) (numsamples * samplesize);
+  size_t size   = needed;
+
+  if (!node)
+    slack = 0;
+
+  if (slack && node->samples && node->samples == seg->datasamples && node->sampalloc >= needed)
+    return 0;
+
+  if (slack)
+    size += needed / 2;
+
+  if (!(newdatasamples = realloc (seg->datasamples, size)))
+    return -1;
+
+  seg->datasamples = newdatasamples;
+
+  if (node)
+  {
+    node->samples   = (slack) ? newdatasamples : 0;
+    node->sampalloc = (slack) ? size : 0;
+  }
+
+  return 0;
+} /* End of mstl_growsamples() */
+
 /***************************************************************************
  * mstl_convertsamples:
  *
@@ -828,6 +1542,10 @@ mstl_convertsamples (MSTraceSeg *seg, char type, flag truncate)
     return -1;
   }
 
+  /* Sample buffer is reallocated to the size needed by conversion */
+  if (seg->node)
+    seg->node->samples = 0;
+
   idata = (int32_t *)seg->datasamples;
   fdata = (float *)seg->datasamples;
   ddata = (double *)seg->datasamples;
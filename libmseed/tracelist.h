@@ -0,0 +1,25 @@
+/***************************************************************************
+ * tracelist.h:
+ *
+ * Interface declarations for the MSTraceList routines in tracelist.c
+ * internal to libmseed.
+ *
+ * modified: 2026.290
+ ***************************************************************************/
+
+#ifndef TRACELIST_H
+#define TRACELIST_H 1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern MSTraceSeg *mstl_addmsr_bulk (MSTraceList *mstl, MSRecord *msr, flag dataquality,
+                                     flag autoheal, double timetol, double sampratetol);
+extern void mstl_endbulk (MSTraceList *mstl);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
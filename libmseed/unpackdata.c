@@ -3,7 +3,7 @@
  * STEIM2, GEOSCOPE (24bit and gain ranged), CDSN, SRO and DWWSSN
  * encoded data.
  *
- * modified: 2017.053
+ * modified: 2026.289
  ************************************************************************/
 
 #include <memory.h>
@@ -13,6 +13,11 @@
 #include "libmseed.h"
 #include "unpackdata.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define STEIM_SSE2 1
+#include <emmintrin.h>
+#endif
+
 /* Control for printing debugging information */
 int decodedebug = 0;
 
@@ -168,12 +173,161 @@ msr_decode_float64 (double *input, int samplecount, double *output,
   return idx;
 } /* End of msr_decode_float64() */
 
+/************************************************************************
+ * steim_loadframe:
+ *
+ * Copy a Steim frame of 16 x 32-bit words, swapping each word to host
+ * byte order if requested.  With SSE2 4 words are swapped at a time.
+ ************************************************************************/
+static void
+steim_loadframe (int32_t *input, uint32_t *frame, int swapflag)
+{
+#if defined(STEIM_SSE2)
+  __m128i words;
+#else
+  uint32_t word;
+#endif
+  int widx;
+
+  if (!swapflag)
+  {
+    memcpy (frame, input, 64);
+    return;
+  }
+
+#if defined(STEIM_SSE2)
+  for (widx = 0; widx < 16; widx += 4)
+  {
+    words = _mm_loadu_si128 ((__m128i *)(input + widx));
+
+    /* Swap the bytes of each 16-bit half, then the halves */
+    words = _mm_or_si128 (_mm_slli_epi16 (words, 8), _mm_srli_epi16 (words, 8));
+    words = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (words, 0xB1), 0xB1);
+
+    _mm_storeu_si128 ((__m128i *)(frame + widx), words);
+  }
+#else
+  for (widx = 0; widx < 16; widx++)
+  {
+    memcpy (&word, input + widx, sizeof (uint32_t));
+
+    frame[widx] = (word >> 24) | ((word >> 8) & 0xFF00u) | ((word << 8) & 0xFF0000u) | (word << 24);
+  }
+#endif
+} /* End of steim_loadframe() */
+
+/************************************************************************
+ * steim_integrate:
+ *
+ * Integrate differences into output samples, each sample is the
+ * previous sample plus the difference, starting from the specified
+ * previous sample.  With SSE2 4 samples are summed at a time.
+ ************************************************************************/
+static void
+steim_integrate (int32_t *diffs, int count, int32_t *output, int32_t previous)
+{
+  int idx = 0;
+
+#if defined(STEIM_SSE2)
+  __m128i carry = _mm_set1_epi32 (previous);
+  __m128i sums;
+
+  for (; idx + 4 <= count; idx += 4)
+  {
+    /* Prefix sum of 4 differences plus the previous sample */
+    sums = _mm_loadu_si128 ((__m128i *)(diffs + idx));
+    sums = _mm_add_epi32 (sums, _mm_slli_si128 (sums, 4));
+    sums = _mm_add_epi32 (sums, _mm_slli_si128 (sums, 8));
+    sums = _mm_add_epi32 (sums, carry);
+    _mm_storeu_si128 ((__m128i *)(output + idx), sums);
+
+    carry = _mm_shuffle_epi32 (sums, 0xFF);
+  }
+
+  if (idx > 0)
+    previous = output[idx - 1];
+#endif
+
+  for (; idx < count; idx++)
+    previous = output[idx] = (int32_t) ((uint32_t)previous + (uint32_t)diffs[idx]);
+} /* End of steim_integrate() */
+
+/* Multiplier shifting a value left by SHIFT bits */
+#define SHIFTMULT(SHIFT) (1u << (SHIFT))
+
+/************************************************************************
+ * steim_extract:
+ *
+ * Extract the differences of a word with the multipliers of its
+ * layout: each is shifted to the top of the word by multiplication
+ * and sign extended down by the difference width.  With SSE2 the
+ * maximum count of the encoding, 4 or 8, values are always extracted,
+ * diffs and the multipliers must have room for them.
+ ************************************************************************/
+static void
+steim_extract (uint32_t word, const uint32_t *multiplier, int count, int maxcount,
+               int width, int32_t *diffs)
+{
+#if defined(STEIM_SSE2)
+  __m128i words = _mm_set1_epi32 ((int)word);
+  __m128i shift = _mm_cvtsi32_si128 (32 - width);
+  __m128i multipliers;
+  __m128i even;
+  __m128i odd;
+  int idx;
+
+  (void)count;
+
+  for (idx = 0; idx < maxcount; idx += 4)
+  {
+    /* Low halves of the products of the even and odd lanes, interleaved */
+    multipliers = _mm_loadu_si128 ((__m128i *)(multiplier + idx));
+    even        = _mm_mul_epu32 (words, multipliers);
+    odd         = _mm_mul_epu32 (words, _mm_srli_epi64 (multipliers, 32));
+    even        = _mm_unpacklo_epi32 (_mm_shuffle_epi32 (even, 0x08), _mm_shuffle_epi32 (odd, 0x08));
+
+    _mm_storeu_si128 ((__m128i *)(diffs + idx), _mm_sra_epi32 (even, shift));
+  }
+#else
+  int idx;
+
+  (void)maxcount;
+
+  for (idx = 0; idx < count; idx++)
+    diffs[idx] = (int32_t) (word * multiplier[idx]) >> (32 - width);
+#endif
+} /* End of steim_extract() */
+
+/* Layouts of Steim1 words by code, the nibble plus 4 for little-endian
+ * data: the multipliers shifting each difference to the top of the
+ * word, the number of differences, their width in bits and the
+ * debugging label.  Differences of 4x8-bit and 2x16-bit words are in
+ * data byte order. */
+static const struct steim1layout_s
+{
+  uint32_t multiplier[4];
+  int8_t count;
+  uint8_t width;
+  const char *label;
+} steim1layouts[8] = {
+    {{1, 1, 1, 1}, 0, 32, "00=special"},
+    {{SHIFTMULT (0), SHIFTMULT (8), SHIFTMULT (16), SHIFTMULT (24)}, 4, 8, "01=4x8b"},
+    {{SHIFTMULT (0), SHIFTMULT (16), 1, 1}, 2, 16, "10=2x16b"},
+    {{SHIFTMULT (0), 1, 1, 1}, 1, 32, "11=1x32b"},
+    {{1, 1, 1, 1}, 0, 32, "00=special"},
+    {{SHIFTMULT (24), SHIFTMULT (16), SHIFTMULT (8), SHIFTMULT (0)}, 4, 8, "01=4x8b"},
+    {{SHIFTMULT (16), SHIFTMULT (0), 1, 1}, 2, 16, "10=2x16b"},
+    {{SHIFTMULT (0), 1, 1, 1}, 1, 32, "11=1x32b"}};
+
 /************************************************************************
  * msr_decode_steim1:
  *
  * Decode Steim1 encoded miniSEED data and place in supplied buffer
  * as 32-bit integers.
  *
+ * The differences of each frame are extracted using the word layouts
+ * in steim1layouts and then integrated together.
+ *
  * Return number of samples in output buffer on success, -1 on error.
  ************************************************************************/
 int
@@ -185,20 +339,19 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
   uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
   int32_t X0    = 0;           /* Forward integration constant, aka first sample */
   int32_t Xn    = 0;           /* Reverse integration constant, aka last sample */
+  int32_t diffs[15 * 4];       /* Differences of a frame */
+  int32_t *diffptr;
+  const struct steim1layout_s *layouts;
+  const struct steim1layout_s *layout;
+  char line[100];
   int maxframes = inputlength / 64;
   int frameidx;
   int startnibble;
-  int nibble;
   int widx;
   int diffcount;
+  int length;
   int idx;
 
-  union dword {
-    int8_t d8[4];
-    int16_t d16[2];
-    int32_t d32;
-  } * word;
-
   if (inputlength <= 0)
     return 0;
 
@@ -209,21 +362,18 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
     ms_log (1, "Decoding %d Steim1 frames, swapflag: %d, srcname: %s\n",
             maxframes, swapflag, (srcname) ? srcname : "");
 
+  /* 4x8-bit and 2x16-bit differences are in byte order, select by data byte order */
+  layouts = steim1layouts + 4 * ((ms_bigendianhost ()) ? swapflag : !swapflag);
+
   for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
   {
     /* Copy frame, each is 16x32-bit quantities = 64 bytes */
-    memcpy (frame, input + (16 * frameidx), 64);
+    steim_loadframe (input + (16 * frameidx), frame, swapflag);
 
     /* Save forward integration constant (X0) and reverse integration constant (Xn)
        and set the starting nibble index depending on frame. */
     if (frameidx == 0)
     {
-      if (swapflag)
-      {
-        ms_gswap4a (&frame[1]);
-        ms_gswap4a (&frame[2]);
-      }
-
       X0 = frame[1];
       Xn = frame[2];
 
@@ -240,76 +390,48 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
         ms_log (1, "Frame %d\n", frameidx);
     }
 
-    /* Swap 32-bit word containing the nibbles */
-    if (swapflag)
-      ms_gswap4a (&frame[0]);
-
-    /* Decode each 32-bit word according to nibble */
-    for (widx = startnibble; widx < 16 && samplecount > 0; widx++)
+    /* Extract differences of each 32-bit word according to nibble */
+    diffptr = diffs;
+    for (widx = startnibble; widx < 16 && (diffptr - diffs) < samplecount; widx++)
     {
       /* W0: the first 32-bit contains 16 x 2-bit nibbles for each word */
-      nibble = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
+      layout = &layouts[EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2)];
 
-      word      = (union dword *)&frame[widx];
-      diffcount = 0;
+      steim_extract (frame[widx], layout->multiplier, layout->count, 4, layout->width, diffptr);
 
-      switch (nibble)
-      {
-      case 0: /* 00: Special flag, no differences */
-        if (decodedebug)
-          ms_log (1, "  W%02d: 00=special\n", widx);
-        break;
-
-      case 1: /* 01: Four 1-byte differences */
-        diffcount = 4;
-
-        if (decodedebug)
-          ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n",
-                  widx, word->d8[0], word->d8[1], word->d8[2], word->d8[3]);
-        break;
-
-      case 2: /* 10: Two 2-byte differences */
-        diffcount = 2;
-
-        if (swapflag)
-        {
-          ms_gswap2a (&word->d16[0]);
-          ms_gswap2a (&word->d16[1]);
-        }
-
-        if (decodedebug)
-          ms_log (1, "  W%02d: 10=2x16b  %d  %d\n", widx, word->d16[0], word->d16[1]);
-        break;
-
-      case 3: /* 11: One 4-byte difference */
-        diffcount = 1;
-        if (swapflag)
-          ms_gswap4a (&word->d32);
-
-        if (decodedebug)
-          ms_log (1, "  W%02d: 11=1x32b  %d\n", widx, word->d32);
-        break;
-      } /* Done with decoding 32-bit word based on nibble */
-
-      /* Apply accumulated differences to calculate output samples */
-      if (diffcount > 0)
+      if (decodedebug)
       {
-        for (idx = 0; idx < diffcount && samplecount > 0; idx++, outputptr++)
-        {
-          if (outputptr == output) /* Ignore first difference, instead store X0 */
-            *outputptr = X0;
-          else if (diffcount == 4) /* Otherwise store difference from previous sample */
-            *outputptr = *(outputptr - 1) + word->d8[idx];
-          else if (diffcount == 2)
-            *outputptr = *(outputptr - 1) + word->d16[idx];
-          else if (diffcount == 1)
-            *outputptr = *(outputptr - 1) + word->d32;
-
-          samplecount--;
-        }
+        length = snprintf (line, sizeof (line), "  W%02d: %s", widx, layout->label);
+        for (idx = 0; idx < layout->count; idx++)
+          length += snprintf (line + length, sizeof (line) - length, "  %d", diffptr[idx]);
+
+        ms_log (1, "%s\n", line);
       }
+
+      diffptr += layout->count;
     } /* Done looping over nibbles and 32-bit words */
-  }   /* Done looping over frames */
+
+    /* Apply accumulated differences to calculate output samples */
+    diffcount = diffptr - diffs;
+    if (diffcount > samplecount)
+      diffcount = samplecount;
+
+    if (diffcount > 0)
+    {
+      if (outputptr == output) /* Ignore first difference, instead store X0 */
+      {
+        diffs[0] = X0;
+        steim_integrate (diffs, diffcount, outputptr, 0);
+      }
+      else /* Otherwise store difference from previous sample */
+      {
+        steim_integrate (diffs, diffcount, outputptr, *(outputptr - 1));
+      }
+
+      outputptr += diffcount;
+      samplecount -= diffcount;
+    }
+  } /* Done looping over frames */
 
   /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
   if (outputptr != output && *(outputptr - 1) != Xn)
@@ -321,12 +443,49 @@ msr_decode_steim1 (int32_t *input, int inputlength, int samplecount,
   return (outputptr - output);
 } /* End of msr_decode_steim1() */
 
+/* Layouts of Steim2 words by code, (nibble << 2) | dnib, plus 12 for
+ * 4x8-bit words of little-endian data: the multipliers shifting each
+ * difference to the top of the word (unused multipliers extract
+ * ignored values), the number of differences (-1 if undefined), their
+ * width in bits and the debugging label.  The dnib bits of 4x8-bit
+ * words are data, codes 4-7 and 16-19 are all 4x8-bit layouts. */
+static const struct steim2layout_s
+{
+  uint32_t multiplier[8];
+  int8_t count;
+  uint8_t width;
+  const char *label;
+} steim2layouts[20] = {
+    {{1, 1, 1, 1, 1, 1, 1, 1}, 0, 32, "00=special"},
+    {{1, 1, 1, 1, 1, 1, 1, 1}, 0, 32, "00=special"},
+    {{1, 1, 1, 1, 1, 1, 1, 1}, 0, 32, "00=special"},
+    {{1, 1, 1, 1, 1, 1, 1, 1}, 0, 32, "00=special"},
+    {{SHIFTMULT (0), SHIFTMULT (8), SHIFTMULT (16), SHIFTMULT (24), 1, 1, 1, 1}, 4, 8, "01=4x8b"},
+    {{SHIFTMULT (0), SHIFTMULT (8), SHIFTMULT (16), SHIFTMULT (24), 1, 1, 1, 1}, 4, 8, "01=4x8b"},
+    {{SHIFTMULT (0), SHIFTMULT (8), SHIFTMULT (16), SHIFTMULT (24), 1, 1, 1, 1}, 4, 8, "01=4x8b"},
+    {{SHIFTMULT (0), SHIFTMULT (8), SHIFTMULT (16), SHIFTMULT (24), 1, 1, 1, 1}, 4, 8, "01=4x8b"},
+    {{1, 1, 1, 1, 1, 1, 1, 1}, -1, 32, NULL},
+    {{SHIFTMULT (2), 1, 1, 1, 1, 1, 1, 1}, 1, 30, "10,01=1x30b"},
+    {{SHIFTMULT (2), SHIFTMULT (17), 1, 1, 1, 1, 1, 1}, 2, 15, "10,10=2x15b"},
+    {{SHIFTMULT (2), SHIFTMULT (12), SHIFTMULT (22), 1, 1, 1, 1, 1}, 3, 10, "10,11=3x10b"},
+    {{SHIFTMULT (2), SHIFTMULT (8), SHIFTMULT (14), SHIFTMULT (20), SHIFTMULT (26), 1, 1, 1}, 5, 6, "11,00=5x6b"},
+    {{SHIFTMULT (2), SHIFTMULT (7), SHIFTMULT (12), SHIFTMULT (17), SHIFTMULT (22), SHIFTMULT (27), 1, 1}, 6, 5, "11,01=6x5b"},
+    {{SHIFTMULT (4), SHIFTMULT (8), SHIFTMULT (12), SHIFTMULT (16), SHIFTMULT (20), SHIFTMULT (24), SHIFTMULT (28), 1}, 7, 4, "11,10=7x4b"},
+    {{1, 1, 1, 1, 1, 1, 1, 1}, -1, 32, NULL},
+    {{SHIFTMULT (24), SHIFTMULT (16), SHIFTMULT (8), SHIFTMULT (0), 1, 1, 1, 1}, 4, 8, "01=4x8b"},
+    {{SHIFTMULT (24), SHIFTMULT (16), SHIFTMULT (8), SHIFTMULT (0), 1, 1, 1, 1}, 4, 8, "01=4x8b"},
+    {{SHIFTMULT (24), SHIFTMULT (16), SHIFTMULT (8), SHIFTMULT (0), 1, 1, 1, 1}, 4, 8, "01=4x8b"},
+    {{SHIFTMULT (24), SHIFTMULT (16), SHIFTMULT (8), SHIFTMULT (0), 1, 1, 1, 1}, 4, 8, "01=4x8b"}};
+
 /************************************************************************
  * msr_decode_steim2:
  *
  * Decode Steim2 encoded miniSEED data and place in supplied buffer
  * as 32-bit integers.
  *
+ * The differences of each frame are extracted using the word layouts
+ * in steim2layouts and then integrated together.
+ *
  * Return number of samples in output buffer on success, -1 on error.
  ************************************************************************/
 int
@@ -338,22 +497,20 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
   uint32_t frame[16];          /* Frame, 16 x 32-bit quantities = 64 bytes */
   int32_t X0 = 0;              /* Forward integration constant, aka first sample */
   int32_t Xn = 0;              /* Reverse integration constant, aka last sample */
-  int32_t diff[7];
-  int32_t semask;
+  int32_t diffs[15 * 7 + 8];   /* Differences of a frame, with room for ignored values */
+  int32_t *diffptr;
+  const struct steim2layout_s *layout;
+  char line[200];
   int maxframes = inputlength / 64;
+  int littleendian;
   int frameidx;
   int startnibble;
   int nibble;
   int widx;
   int diffcount;
-  int dnib;
+  int length;
   int idx;
 
-  union dword {
-    int8_t d8[4];
-    int32_t d32;
-  } * word;
-
   if (inputlength <= 0)
     return 0;
 
@@ -364,21 +521,18 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
     ms_log (1, "Decoding %d Steim2 frames, swapflag: %d, srcname: %s\n",
             maxframes, swapflag, (srcname) ? srcname : "");
 
+  /* 4x8-bit differences are in byte order, determine data byte order */
+  littleendian = (ms_bigendianhost ()) ? swapflag : !swapflag;
+
   for (frameidx = 0; frameidx < maxframes && samplecount > 0; frameidx++)
   {
     /* Copy frame, each is 16x32-bit quantities = 64 bytes */
-    memcpy (frame, input + (16 * frameidx), 64);
+    steim_loadframe (input + (16 * frameidx), frame, swapflag);
 
     /* Save forward integration constant (X0) and reverse integration constant (Xn)
        and set the starting nibble index depending on frame. */
     if (frameidx == 0)
     {
-      if (swapflag)
-      {
-        ms_gswap4a (&frame[1]);
-        ms_gswap4a (&frame[2]);
-      }
-
       X0 = frame[1];
       Xn = frame[2];
 
@@ -395,163 +549,60 @@ msr_decode_steim2 (int32_t *input, int inputlength, int samplecount,
         ms_log (1, "Frame %d\n", frameidx);
     }
 
-    /* Swap 32-bit word containing the nibbles */
-    if (swapflag)
-      ms_gswap4a (&frame[0]);
-
-    /* Decode each 32-bit word according to nibble */
-    for (widx = startnibble; widx < 16 && samplecount > 0; widx++)
+    /* Extract differences of each 32-bit word according to nibble and dnib */
+    diffptr = diffs;
+    for (widx = startnibble; widx < 16 && (diffptr - diffs) < samplecount; widx++)
     {
       /* W0: the first 32-bit quantity contains 16 x 2-bit nibbles */
-      nibble    = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
-      diffcount = 0;
+      nibble = EXTRACTBITRANGE (frame[0], (30 - (2 * widx)), 2);
+
+      /* dnib, the high order two bits, for nibbles 10 and 11 */
+      layout = &steim2layouts[((nibble << 2) | EXTRACTBITRANGE (frame[widx], 30, 2)) +
+                              ((nibble == 1) & littleendian) * 12];
 
-      switch (nibble)
+      if (layout->count < 0)
       {
-      case 0: /* nibble=00: Special flag, no differences */
-        if (decodedebug)
-          ms_log (1, "  W%02d: 00=special\n", widx);
-
-        break;
-      case 1: /* nibble=01: Four 1-byte differences */
-        diffcount = 4;
-
-        word = (union dword *)&frame[widx];
-        for (idx = 0; idx < diffcount; idx++)
-        {
-          diff[idx] = word->d8[idx];
-        }
-
-        if (decodedebug)
-          ms_log (1, "  W%02d: 01=4x8b  %d  %d  %d  %d\n", widx, diff[0], diff[1], diff[2], diff[3]);
-        break;
-
-      case 2: /* nibble=10: Must consult dnib, the high order two bits */
-        if (swapflag)
-          ms_gswap4a (&frame[widx]);
-        dnib = EXTRACTBITRANGE (frame[widx], 30, 2);
-
-        switch (dnib)
-        {
-        case 0: /* nibble=10, dnib=00: Error, undefined value */
-          ms_log (2, "%s: Impossible Steim2 dnib=00 for nibble=10\n", srcname);
-
-          return -1;
-          break;
-
-        case 1: /* nibble=10, dnib=01: One 30-bit difference */
-          diffcount = 1;
-          semask    = 1ul << (30 - 1); /* Sign extension from bit 30 */
-          diff[0]   = EXTRACTBITRANGE (frame[widx], 0, 30);
-          diff[0]   = (diff[0] ^ semask) - semask;
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 10,01=1x30b  %d\n", widx, diff[0]);
-          break;
-
-        case 2: /* nibble=10, dnib=10: Two 15-bit differences */
-          diffcount = 2;
-          semask    = 1ul << (15 - 1); /* Sign extension from bit 15 */
-          for (idx = 0; idx < diffcount; idx++)
-          {
-            diff[idx] = EXTRACTBITRANGE (frame[widx], (15 - idx * 15), 15);
-            diff[idx] = (diff[idx] ^ semask) - semask;
-          }
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 10,10=2x15b  %d  %d\n", widx, diff[0], diff[1]);
-          break;
-
-        case 3: /* nibble=10, dnib=11: Three 10-bit differences */
-          diffcount = 3;
-          semask    = 1ul << (10 - 1); /* Sign extension from bit 10 */
-          for (idx = 0; idx < diffcount; idx++)
-          {
-            diff[idx] = EXTRACTBITRANGE (frame[widx], (20 - idx * 10), 10);
-            diff[idx] = (diff[idx] ^ semask) - semask;
-          }
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 10,11=3x10b  %d  %d  %d\n", widx, diff[0], diff[1], diff[2]);
-          break;
-        }
-
-        break;
-
-      case 3: /* nibble=11: Must consult dnib, the high order two bits */
-        if (swapflag)
-          ms_gswap4a (&frame[widx]);
-        dnib = EXTRACTBITRANGE (frame[widx], 30, 2);
-
-        switch (dnib)
-        {
-        case 0: /* nibble=11, dnib=00: Five 6-bit differences */
-          diffcount = 5;
-          semask    = 1ul << (6 - 1); /* Sign extension from bit 6 */
-          for (idx = 0; idx < diffcount; idx++)
-          {
-            diff[idx] = EXTRACTBITRANGE (frame[widx], (24 - idx * 6), 6);
-            diff[idx] = (diff[idx] ^ semask) - semask;
-          }
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 11,00=5x6b  %d  %d  %d  %d  %d\n",
-                    widx, diff[0], diff[1], diff[2], diff[3], diff[4]);
-          break;
-
-        case 1: /* nibble=11, dnib=01: Six 5-bit differences */
-          diffcount = 6;
-          semask    = 1ul << (5 - 1); /* Sign extension from bit 5 */
-          for (idx = 0; idx < diffcount; idx++)
-          {
-            diff[idx] = EXTRACTBITRANGE (frame[widx], (25 - idx * 5), 5);
-            diff[idx] = (diff[idx] ^ semask) - semask;
-          }
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 11,01=6x5b  %d  %d  %d  %d  %d  %d\n",
-                    widx, diff[0], diff[1], diff[2], diff[3], diff[4], diff[5]);
-          break;
-
-        case 2: /* nibble=11, dnib=10: Seven 4-bit differences */
-          diffcount = 7;
-          semask    = 1ul << (4 - 1); /* Sign extension from bit 4 */
-          for (idx = 0; idx < diffcount; idx++)
-          {
-            diff[idx] = EXTRACTBITRANGE (frame[widx], (24 - idx * 4), 4);
-            diff[idx] = (diff[idx] ^ semask) - semask;
-          }
-
-          if (decodedebug)
-            ms_log (1, "  W%02d: 11,10=7x4b  %d  %d  %d  %d  %d  %d  %d\n",
-                    widx, diff[0], diff[1], diff[2], diff[3], diff[4], diff[5], diff[6]);
-          break;
-
-        case 3: /* nibble=11, dnib=11: Error, undefined value */
-          ms_log (2, "%s: Impossible Steim2 dnib=11 for nibble=11\n", srcname);
-
-          return -1;
-          break;
-        }
-
-        break;
-      } /* Done with decoding 32-bit word based on nibble */
-
-      /* Apply differences to calculate output samples */
-      if (diffcount > 0)
+        ms_log (2, "%s: Impossible Steim2 dnib=%s for nibble=%s\n", srcname,
+                (nibble == 2) ? "00" : "11", (nibble == 2) ? "10" : "11");
+
+        return -1;
+      }
+
+      steim_extract (frame[widx], layout->multiplier, layout->count, 8, layout->width, diffptr);
+
+      if (decodedebug)
       {
-        for (idx = 0; idx < diffcount && samplecount > 0; idx++, outputptr++)
-        {
-          if (outputptr == output) /* Ignore first difference, instead store X0 */
-            *outputptr = X0;
-          else /* Otherwise store difference from previous sample */
-            *outputptr = *(outputptr - 1) + diff[idx];
-
-          samplecount--;
-        }
+        length = snprintf (line, sizeof (line), "  W%02d: %s", widx, layout->label);
+        for (idx = 0; idx < layout->count; idx++)
+          length += snprintf (line + length, sizeof (line) - length, "  %d", diffptr[idx]);
+
+        ms_log (1, "%s\n", line);
       }
+
+      diffptr += layout->count;
     } /* Done looping over nibbles and 32-bit words */
-  }   /* Done looping over frames */
+
+    /* Apply differences to calculate output samples */
+    diffcount = diffptr - diffs;
+    if (diffcount > samplecount)
+      diffcount = samplecount;
+
+    if (diffcount > 0)
+    {
+      if (outputptr == output) /* Ignore first difference, instead store X0 */
+      {
+        diffs[0] = X0;
+        steim_integrate (diffs, diffcount, outputptr, 0);
+      }
+      else /* Otherwise store difference from previous sample */
+      {
+        steim_integrate (diffs, diffcount, outputptr, *(outputptr - 1));
+      }
+
+      outputptr += diffcount;
+      samplecount -= diffcount;
+    }
+  } /* Done looping over frames */
 
   /* Check data integrity by comparing last sample to Xn (reverse integration constant) */
   if (outputptr != output && *(outputptr - 1) != Xn)
@@ -2,6 +2,26 @@
 /*
  * Modified from the original by Chad Trabant, IRIS Data Management Center.
  *
+ * 2026.289:
+ *   Replace the lazily calculated CM6 decoding table with a constant
+ *   table, decode CM6 in chunks classified with SSE2 where available
+ *   and assemble samples without branching on the continuation bit.
+ *   Check 16 characters at a time in cm6span() with SSE2.
+ *   Calculate the GSE checksum while integrating decoded samples and
+ *   add gsechksumadd() for running checksums, unpackcm6 integrates
+ *   while decoding instead of with separate passes.
+ *   Add cm6init(), cm6decode() and cm6finish() to incrementally decode
+ *   CM6 data a piece at a time, reimplement unpackcm6 using them.
+ *   Change unpackcm6 to take the allocated size of intbuf, grow it by
+ *   doubling and never shrink it so buffers can be reused.
+ *   Add cm6span() to validate CM6 characters without requiring NULL
+ *   terminated input.
+ *   Define cm6table here, declared in cm6.h, as it is no longer used
+ *   elsewhere.
+ *
+ * 2026.290:
+ *   Add parseint32() from gse2mseed.c to parse GSE INT samples.
+ *
  * 2005.123:
  *   Update packcm6 to use the cm6table defined in cm6.h
  *   Update unpackcm6 to use static variables and only calculate the CM6
@@ -40,7 +60,7 @@
  * USA
  *
  *
- * Modifed: 2005.123
+ * Modifed: 2026.290
  */
 
 #include <stdio.h>
@@ -49,6 +69,14 @@
 
 #include "cm6.h"
 
+/* Table of all possible CM6 characters */
+char cm6table[64]= { '+','-','0','1','2','3','4','5','6','7',
+		     '8','9','A','B','C','D','E','F','G','H',
+		     'I','J','K','L','M','N','O','P','Q','R',
+		     'S','T','U','V','W','X','Y','Z','a','b',
+		     'c','d','e','f','g','h','i','j','k','l',
+		     'm','n','o','p','q','r','s','t','u','v',
+		     'w','x','y','z' };
 
 /***************************************************************************
  * delta:
@@ -154,139 +182,560 @@ packcm6 (int32_t *intbuf, int32_t Nint,
 }
 
 
+/* Constants for CM6 decoding */
+#define SIGNMASK 16
+#define VAL1MASK 15
+#define SHIFTVAL 32
+
+/* Add a sample to a running GSE checksum, the sample and checksum are
+ * only reduced modulo CHKMODULO when they exceed it, the division is
+ * rarely needed */
+#define CHKMODULO 100000000
+#define GSECHKSUM_ADD(cksum, sample)					\
+  do {									\
+    int32_t val_ = (sample);						\
+    if ( abs(val_) > CHKMODULO ) val_ = val_ - CHKMODULO * (val_ / CHKMODULO); \
+    (cksum) += val_;							\
+    if ( abs(cksum) > CHKMODULO )					\
+      (cksum) = (cksum) - CHKMODULO * ((cksum) / CHKMODULO);		\
+  } while (0)
+
+
+/* CM6 decoding table mapping characters to their 6-bit values, all
+ * characters not in cm6table map to CM6_INVALID */
+#define CM6_INVALID 64
+
+static const uint8_t cm6decodetable[256] = {
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,  0, 64,  1, 64, 64,
+   2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 64, 64, 64, 64, 64, 64,
+  64, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26,
+  27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 64, 64, 64, 64, 64,
+  64, 38, 39, 40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52,
+  53, 54, 55, 56, 57, 58, 59, 60, 61, 62, 63, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
+  64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64
+};
+
+
+/* Number of characters decoded together by cm6decode() */
+#define CM6_CHUNK 16
+
+/* Number of decoded samples added to the checksum together */
+#define CM6_CHKBATCH 256
+
+/* Per character decoding terms for a chunk of CM6 characters.  With
+ * the continuation bit of the preceding character known, each
+ * character either starts a sample (keep = 0, 4 value bits and the
+ * sign) or continues one (keep = -1, 5 value bits). */
+typedef struct CM6Chunk_s {
+  uint8_t addend[CM6_CHUNK];  /* Value bits added to the sample */
+  int8_t  keep[CM6_CHUNK];    /* -1 if continuing a sample, 0 if starting */
+  int8_t  neg[CM6_CHUNK];     /* -1 if starting a negative sample, else 0 */
+  uint8_t done[CM6_CHUNK];    /* 1 if the character completes a sample */
+} CM6Chunk;
+
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CM6_SSE2 1
+#include <emmintrin.h>
+
+/***************************************************************************
+ * cm6values16:
+ *
+ * Map 16 characters to their 6-bit CM6 values using SSE2 range
+ * comparisons, characters not in cm6table map to 0 as they do when
+ * decoding with cm6decodetable.  The bytes of valid are set to all
+ * ones for characters in cm6table and zero otherwise.
+ *
+ * Returns the CM6 values.
+ ***************************************************************************/
+static __m128i
+cm6values16 (__m128i c, __m128i *valid)
+{
+  __m128i digit, upper, lower, plus, minus;
+  __m128i offset;
+  
+  /* Signed comparisons, characters above 127 are in no range */
+  digit = _mm_and_si128 (_mm_cmpgt_epi8 (c, _mm_set1_epi8 ('0' - 1)),
+			 _mm_cmplt_epi8 (c, _mm_set1_epi8 ('9' + 1)));
+  upper = _mm_and_si128 (_mm_cmpgt_epi8 (c, _mm_set1_epi8 ('A' - 1)),
+			 _mm_cmplt_epi8 (c, _mm_set1_epi8 ('Z' + 1)));
+  lower = _mm_and_si128 (_mm_cmpgt_epi8 (c, _mm_set1_epi8 ('a' - 1)),
+			 _mm_cmplt_epi8 (c, _mm_set1_epi8 ('z' + 1)));
+  plus  = _mm_cmpeq_epi8 (c, _mm_set1_epi8 ('+'));
+  minus = _mm_cmpeq_epi8 (c, _mm_set1_epi8 ('-'));
+  
+  /* Offset from each character to its value: '+' = 0, '-' = 1,
+   * '0' = 2, 'A' = 12 and 'a' = 38 */
+  offset = _mm_or_si128 (_mm_or_si128 (_mm_and_si128 (digit, _mm_set1_epi8 ('0' - 2)),
+				       _mm_and_si128 (upper, _mm_set1_epi8 ('A' - 12))),
+			 _mm_or_si128 (_mm_and_si128 (lower, _mm_set1_epi8 ('a' - 38)),
+				       _mm_or_si128 (_mm_and_si128 (plus, _mm_set1_epi8 ('+')),
+						     _mm_and_si128 (minus, _mm_set1_epi8 ('-' - 1)))));
+  *valid = _mm_or_si128 (_mm_or_si128 (digit, upper),
+			 _mm_or_si128 (lower, _mm_or_si128 (plus, minus)));
+  
+  return _mm_and_si128 (_mm_sub_epi8 (c, offset), *valid);
+}
+
+
+/***************************************************************************
+ * cm6prepare:
+ *
+ * Classify CM6_CHUNK characters and calculate their decoding terms
+ * using SSE2.
+ *
+ * contin is non-zero if the character before the chunk has the
+ * continuation bit set.
+ *
+ * Returns a bitmask of the characters with the continuation bit set.
+ ***************************************************************************/
+static int
+cm6prepare (const char *cm6buf, uint32_t contin, CM6Chunk *chunk)
+{
+  __m128i valid, v, cont, keep;
+  
+  v = cm6values16 (_mm_loadu_si128 ((const __m128i *) cm6buf), &valid);
+  cont = _mm_cmpgt_epi8 (v, _mm_set1_epi8 (31));
+  
+  /* A character continues a sample if the one before it has the
+   * continuation bit set */
+  keep = _mm_or_si128 (_mm_slli_si128 (cont, 1),
+		       _mm_cvtsi32_si128 ((contin) ? 0xFF : 0));
+  
+  _mm_storeu_si128 ((__m128i *) chunk->addend,
+		    _mm_and_si128 (v, _mm_or_si128 (_mm_set1_epi8 (VAL1MASK),
+						    _mm_and_si128 (keep, _mm_set1_epi8 (SIGNMASK)))));
+  _mm_storeu_si128 ((__m128i *) chunk->keep, keep);
+  _mm_storeu_si128 ((__m128i *) chunk->neg,
+		    _mm_andnot_si128 (keep, _mm_cmpeq_epi8 (_mm_and_si128 (v, _mm_set1_epi8 (SIGNMASK)),
+							    _mm_set1_epi8 (SIGNMASK))));
+  _mm_storeu_si128 ((__m128i *) chunk->done,
+		    _mm_andnot_si128 (cont, _mm_set1_epi8 (1)));
+  
+  return _mm_movemask_epi8 (cont);
+}
+#else
+
+/***************************************************************************
+ * cm6prepare:
+ *
+ * Classify CM6_CHUNK characters and calculate their decoding terms.
+ *
+ * contin is non-zero if the character before the chunk has the
+ * continuation bit set.
+ *
+ * Returns a bitmask of the characters with the continuation bit set.
+ ***************************************************************************/
+static int
+cm6prepare (const char *cm6buf, uint32_t contin, CM6Chunk *chunk)
+{
+  uint8_t v;
+  int contbits = 0;
+  int k;
+  
+  for (k=0; k < CM6_CHUNK; k++)
+    {
+      v = cm6decodetable[(uint8_t) cm6buf[k]] & (CM6_INVALID - 1);
+      
+      chunk->keep[k] = ( contin ) ? -1 : 0;
+      chunk->addend[k] = v & (( contin ) ? (VAL1MASK | SIGNMASK) : VAL1MASK);
+      chunk->neg[k] = ( ! contin && (v & SIGNMASK) ) ? -1 : 0;
+      chunk->done[k] = ( v >> 5 ) ? 0 : 1;
+      
+      contin = v >> 5;
+      contbits |= contin << k;
+    }
+  
+  return contbits;
+}
+#endif
+
+
 /***************************************************************************
  * unpackcm6:
  *
  * Unpack CM6 compressed data into 32-bit integers.
  *
- * cm6buf = input CM6 ASCII
- * Ncm6   = number of input characters
- * intbuf = 32-bit integer buffer (contents destroyed, final is returned)
- * Nint   = number of output integers unpacked
- * Nreq   = number of output integers to unpack, if negative unpack all
- * ndiff  = differencing level (2 is highly recommended)
+ * cm6buf  = input CM6 ASCII
+ * Ncm6    = number of input characters
+ * intbuf  = 32-bit integer buffer (contents destroyed, final is returned)
+ * Nint    = number of output integers unpacked
+ * Nintbuf = number of integers allocated in intbuf (will be updated)
+ * Nreq    = number of output integers to unpack, if negative unpack all
+ * ndiff   = differencing level (2 is highly recommended)
  *
  * intbuf should be either allocated by the malloc(3) family of
  * functions or set to NULL by the calling program.
  *
- * It is assumed that if Nreq is positive and intbuf is not NULL that
- * intbuf has enough space to hold at least Nreq 32-bit integers.
- *
- * If the original intbuf is big enough to hold Nreq integers it will
- * not be reallocated.
+ * If intbuf is not big enough to hold the unpacked integers it will
+ * be reallocated, doubling in size as needed, and Nintbuf updated.
+ * The buffer is never shrunk so it may be reused for subsequent calls
+ * without further allocation.
  *
  * Returns the unpacked integers on success and NULL on error.
  ***************************************************************************/
 
 int32_t *
 unpackcm6 (const char *cm6buf, int32_t Ncm6,
-	   int32_t *intbuf, int32_t *Nint,
+	   int32_t *intbuf, int32_t *Nint, int32_t *Nintbuf,
 	   int32_t Nreq, int32_t ndiff)
 {
-  static int8_t tablecalculated = 0;
-  static int32_t table[256];
-
-  int32_t cin;
-  int32_t val, sign=1, cont=0;
+  CM6State state;
+  int32_t limit;
+  int32_t nout;
   int32_t i, j;
-  int32_t Nintbuf = 0;
-  int8_t  alloced = 0;
-
-  /* constants for CM6: */
-  int32_t SIGNMASK=16;
-  int32_t CONTMASK=32;
-  int32_t VAL1MASK=15;
-  int32_t VAL2MASK=31;
-  int32_t CLBTMASK=127;
-  int32_t SHIFTVAL=32;
-  
-  if ( ! tablecalculated )
+  
+  /* Integrate while decoding, any further differencing levels after */
+  if ( ndiff > CM6_MAXDIFF )
     {
-      for (j=0,i=0; i < 256; i++)
-	{
-	  if (i=='+') table[i]=j;
-	  else if (i=='-') table[i]=j;
-	  else if ((i>='0') && (i<='9')) table[i]=j;
-	  else if ((i>='a') && (i<='z')) table[i]=j;
-	  else if ((i>='A') && (i<='Z')) table[i]=j;
-	  else { table[i]=0; continue; }
-	  j++;
-	}
-      
-      tablecalculated = 1;
+      cm6init (&state, CM6_MAXDIFF);
+      ndiff -= CM6_MAXDIFF;
     }
-  
-  if ( Nreq > 0 )
-    Nintbuf = Nreq;
   else
-    Nintbuf = 10;
+    {
+      cm6init (&state, ndiff);
+      ndiff = 0;
+    }
   
   if ( intbuf == NULL )
+    *Nintbuf = 0;
+  
+  /* Allocate space for the requested number of integers if needed */
+  if ( Nreq > 0 && *Nintbuf < Nreq )
     {
-      intbuf = (int32_t *) malloc (Nintbuf * sizeof(int32_t));
+      intbuf = (int32_t *) realloc (intbuf, Nreq * sizeof(int32_t));
       if (!intbuf) return NULL;
-      alloced = 1;
+      *Nintbuf = Nreq;
     }
   
-  memset (intbuf, 0, Nintbuf * sizeof(int32_t));
-  
-  for (j=i=0; j < Ncm6; i++)
+  for (j=i=0; j < Ncm6 || state.cont; )
     {
       if ( Nreq > 0 && i >= Nreq ) break;
       
-      /* If intbuf is full allocate more space for 10 more ints */
-      if ( i >= Nintbuf )
+      /* If intbuf is full double the space allocated */
+      if ( i >= *Nintbuf )
 	{
-	  Nintbuf += 10;
+	  *Nintbuf = (*Nintbuf > 0) ? *Nintbuf * 2 : 64;
 	  
-	  intbuf = (int32_t *) realloc (intbuf, Nintbuf * sizeof(int32_t));
+	  intbuf = (int32_t *) realloc (intbuf, *Nintbuf * sizeof(int32_t));
 	  if (!intbuf) return NULL;
-	  alloced = 1;
-	  
-	  memset (intbuf+i, 0, 10 * sizeof(int32_t));
 	}
+      
+      /* Input ended within a sample */
+      if ( j >= Ncm6 )
+	{
+	  fprintf (stderr, "unpackcm6: truncated data\n");
+	  i += cm6finish (&state, intbuf + i);
+	  break;
+	}
+      
+      limit = ( Nreq > 0 && Nreq < *Nintbuf ) ? Nreq : *Nintbuf;
+      
+      j += cm6decode (&state, cm6buf + j, Ncm6 - j, intbuf + i, limit - i, &nout);
+      i += nout;
+    }
+  
+  *Nint = i;
+  
+  if ( Nreq > 0 && *Nint != Nreq )
+    fprintf (stderr, "unpackcm6: %d of %d samples unpacked\n", *Nint, Nreq);
+  
+  while (ndiff--) undelta (intbuf, *Nint);
+  
+  return (intbuf);
+}
+
+
+/***************************************************************************
+ * cm6init:
+ *
+ * Initialize the state for incremental decoding of a CM6 data block.
+ *
+ * state  = CM6 decoding state
+ * ndiff  = differencing level, at most CM6_MAXDIFF (2 is highly recommended)
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+int
+cm6init (CM6State *state, int32_t ndiff)
+{
+  if ( ! state || ndiff < 0 || ndiff > CM6_MAXDIFF )
+    return -1;
+  
+  memset (state, 0, sizeof(CM6State));
+  state->ndiff = ndiff;
+  
+  return 0;
+}
+
 
-      cin = cm6buf[j++];
-      val = table[cin] & CLBTMASK;
-      sign = val & SIGNMASK;
-      cont = val & CONTMASK;
-      intbuf[i] = val & VAL1MASK;
+/* Decode one 6-bit CM6 value v without branching: a first character
+ * sets the sign and 4 value bits, a continuation character adds 5
+ * value bits.  The signed, possibly partial, sample is always stored
+ * at raw[nraw] and nraw is advanced when the sample is complete. */
+#define CM6_STEP(v)							\
+  do {									\
+    value = ((value * SHIFTVAL) & contmask) +				\
+      ((v) & (VAL1MASK | (SIGNMASK & contmask)));			\
+    signmask = (signmask & contmask) |					\
+      (~contmask & (0u - (((v) & SIGNMASK) >> 4)));			\
+    contmask = 0u - ((v) >> 5);						\
+    raw[nraw] = (value ^ signmask) - signmask;				\
+    nraw += 1 - ((v) >> 5);						\
+  } while (0)
 
-      while (cont)
+
+/***************************************************************************
+ * cm6integrate:
+ *
+ * Integrate decoded differences through the differencing levels of
+ * the state and store the resulting samples in intbuf.  The contents
+ * of raw are destroyed.
+ *
+ ***************************************************************************/
+static void
+cm6integrate (CM6State *state, uint32_t *raw, int32_t Nraw, int32_t *intbuf)
+{
+  uint32_t sum0, sum1;
+  int32_t i, k;
+  
+  /* Second differences are by far the most common */
+  if ( state->ndiff == 2 )
+    {
+      sum0 = state->sums[0];
+      sum1 = state->sums[1];
+      for (i=0; i < Nraw; i++)
 	{
-	  intbuf[i] *= SHIFTVAL;
+	  sum0 += raw[i];
+	  sum1 += sum0;
+	  intbuf[i] = (int32_t) sum1;
+	}
+      
+      state->sums[0] = sum0;
+      state->sums[1] = sum1;
+      return;
+    }
+  
+  for (k=0; k < state->ndiff; k++)
+    {
+      sum0 = state->sums[k];
+      
+      for (i=0; i < Nraw; i++)
+	raw[i] = sum0 += raw[i];
+      
+      state->sums[k] = sum0;
+    }
+  
+  for (i=0; i < Nraw; i++)
+    intbuf[i] = (int32_t) raw[i];
+}
+
+
+/***************************************************************************
+ * cm6decode:
+ *
+ * Incrementally decode CM6 compressed data into 32-bit integers.  The
+ * CM6 data of a block may be passed in any number of pieces (e.g. line
+ * by line), samples spanning pieces and the differencing state are
+ * carried in the state, which must be initialized with cm6init().
+ *
+ * state   = CM6 decoding state
+ * cm6buf  = input CM6 ASCII
+ * Ncm6    = number of input characters
+ * intbuf  = output 32-bit integers
+ * Nintbuf = maximum number of integers to write to intbuf
+ * Nint    = number of integers written to intbuf
+ *
+ * Each input character completes at most one integer, so an intbuf
+ * with space for Ncm6 integers is always enough.  Decoding stops early
+ * when Nintbuf integers have been written.
+ *
+ * Characters are decoded CM6_CHUNK at a time, classified with SSE2
+ * where available, and samples are assembled without branching on
+ * the continuation bit.  A chunk of only single character samples,
+ * common for quiet data, skips sample assembly entirely.
+ *
+ * The decoded integers are added to the running checksum of the state
+ * in batches, while they are still in cache.
+ *
+ * Returns the number of input characters consumed.
+ ***************************************************************************/
+int32_t
+cm6decode (CM6State *state, const char *cm6buf, int32_t Ncm6,
+	   int32_t *intbuf, int32_t Nintbuf, int32_t *Nint)
+{
+  CM6Chunk chunk;
+  uint32_t raw[CM6_CHUNK + 1];
+  uint32_t value = state->value;
+  uint32_t signmask = ( state->sign ) ? ~0u : 0u;
+  uint32_t contmask = ( state->cont ) ? ~0u : 0u;
+  uint32_t keep;
+  uint32_t v;
+  int32_t nraw;
+  int32_t i = 0;
+  int32_t j = 0;
+  int32_t chk = 0;
+  int32_t k;
+  int contbits;
+  
+  /* Decode whole chunks while the output has space for a sample per character */
+  while ( Ncm6 - j >= CM6_CHUNK && Nintbuf - i >= CM6_CHUNK )
+    {
+      contbits = cm6prepare (cm6buf + j, contmask, &chunk);
+      
+      if ( ! contbits && ! contmask )
+	{
+	  /* Every character is a complete sample */
+	  for (k=0; k < CM6_CHUNK; k++)
+	    {
+	      signmask = (uint32_t) (int32_t) chunk.neg[k];
+	      raw[k] = (chunk.addend[k] ^ signmask) - signmask;
+	    }
 	  
-	  if ( j >= Ncm6 )
+	  value = chunk.addend[CM6_CHUNK - 1];
+	  nraw = CM6_CHUNK;
+	}
+      else
+	{
+	  for (nraw=k=0; k < CM6_CHUNK; k++)
 	    {
-	      fprintf (stderr, "unpackcm6: truncated data\n");
-	      break;
+	      keep = (uint32_t) (int32_t) chunk.keep[k];
+	      value = ((value * SHIFTVAL) & keep) + chunk.addend[k];
+	      signmask = (signmask & keep) | (uint32_t) (int32_t) chunk.neg[k];
+	      raw[nraw] = (value ^ signmask) - signmask;
+	      nraw += chunk.done[k];
 	    }
 	  
-	  cin = cm6buf[j++];
-	  val = table[cin] & CLBTMASK;
-	  cont = val & CONTMASK;
-	  intbuf[i] += val & VAL2MASK;
+	  contmask = 0u - (uint32_t) ((contbits >> (CM6_CHUNK - 1)) & 1);
+	}
+      
+      cm6integrate (state, raw, nraw, intbuf + i);
+      
+      i += nraw;
+      j += CM6_CHUNK;
+      
+      /* Add recent samples to the checksum while still in cache */
+      if ( i - chk >= CM6_CHKBATCH )
+	{
+	  state->cksum = gsechksumadd (state->cksum, intbuf + chk, i - chk);
+	  chk = i;
 	}
+    }
+  
+  /* Decode remaining characters one at a time */
+  while ( j < Ncm6 && i < Nintbuf )
+    {
+      nraw = 0;
+      v = cm6decodetable[(uint8_t) cm6buf[j++]] & (CM6_INVALID - 1);
       
-      if (sign) intbuf[i] = -intbuf[i];
-      sign=0;
+      CM6_STEP (v);
+      
+      if ( nraw )
+	{
+	  cm6integrate (state, raw, 1, intbuf + i);
+	  i++;
+	}
     }
   
+  state->cksum = gsechksumadd (state->cksum, intbuf + chk, i - chk);
+  state->value = value;
+  state->sign = ( signmask ) ? 1 : 0;
+  state->cont = ( contmask ) ? 1 : 0;
   *Nint = i;
   
-  /* Make sure intbuf is just the right size, should always truncate */
-  if ( alloced && *Nint != Nintbuf )
+  return j;
+}
+
+
+/***************************************************************************
+ * cm6finish:
+ *
+ * Finish incremental CM6 decoding.  If the input ended within a sample
+ * the truncated sample is completed, in the same manner as unpackcm6()
+ * handles truncated data, and written to intbuf.
+ *
+ * state   = CM6 decoding state
+ * intbuf  = output 32-bit integers, space for 1 integer is needed
+ *
+ * Returns the number of integers written to intbuf, 1 if the data was
+ * truncated and 0 otherwise.
+ ***************************************************************************/
+int32_t
+cm6finish (CM6State *state, int32_t *intbuf)
+{
+  uint32_t sample;
+  
+  if ( ! state->cont )
+    return 0;
+  
+  sample = state->value * SHIFTVAL;
+  
+  if ( state->sign )
+    sample = 0u - sample;
+  
+  cm6integrate (state, &sample, 1, intbuf);
+  state->cksum = gsechksumadd (state->cksum, intbuf, 1);
+  
+  state->value = 0;
+  state->sign = 0;
+  state->cont = 0;
+  
+  return 1;
+}
+
+
+/***************************************************************************
+ * cm6span:
+ *
+ * Determine the number of leading characters in cm6buf that are valid
+ * CM6 characters (those in cm6table).  Like strspn(3) but the input
+ * does not need to be NULL terminated.  Characters are checked 16 at
+ * a time with SSE2 where available.
+ *
+ * A line of CM6 data is valid if the first character not in cm6table
+ * is a space, carriage return or newline, or there is none, so a
+ * single call both validates the line and finds where the data ends.
+ *
+ * cm6buf = input CM6 ASCII
+ * Ncm6   = number of input characters
+ *
+ * Returns the number of valid CM6 characters before the first invalid
+ * character, or Ncm6 if all characters are valid.
+ ***************************************************************************/
+int32_t
+cm6span (const char *cm6buf, int32_t Ncm6)
+{
+  int32_t i = 0;
+  
+#if defined(CM6_SSE2)
+  __m128i valid;
+  
+  for (; i + 16 <= Ncm6; i += 16)
     {
-      intbuf = (int32_t *) realloc (intbuf, (*Nint) * sizeof(int32_t));
-      if (!intbuf) return NULL;
+      cm6values16 (_mm_loadu_si128 ((const __m128i *) (cm6buf + i)), &valid);
+      
+      /* Locate the invalid character below */
+      if ( _mm_movemask_epi8 (valid) != 0xFFFF )
+	break;
     }
+#endif
   
-  if ( Nreq > 0 && *Nint != Nreq )
-    fprintf (stderr, "unpackcm6: %d of %d samples unpacked\n", *Nint, Nintbuf);
-  
-  while (ndiff--) undelta (intbuf, *Nint);
+  for (; i < Ncm6; i++)
+    {
+      if ( cm6decodetable[(uint8_t) cm6buf[i]] & CM6_INVALID )
+	break;
+    }
   
-  return (intbuf);
+  return i;
 }
 
 
@@ -304,20 +753,175 @@ unpackcm6 (const char *cm6buf, int32_t Ncm6,
 int32_t
 gsechksum (int32_t *intbuf, int32_t Nint)
 {
-  int32_t i, val;
-  int32_t cksum=0L;
-  int32_t MODULO=100000000;
+  return (abs(gsechksumadd (0, intbuf, Nint)));
+}
 
-  for (i=0; i<Nint; i++)
+
+/***************************************************************************
+ * gsechksumadd:
+ *
+ * Add integers to a running checksum using the algorithm specified by
+ * GSETT-3, allowing the checksum to be calculated incrementally.  The
+ * running checksum starts at 0 and the final checksum is the absolute
+ * value of the running checksum, as returned by gsechksum().
+ *
+ * cksum   = running checksum
+ * intbuf  = input 32-bit integers
+ * Nint    = number of input integers
+ *
+ * The checksum reduces each integer and the running sum modulo 10^8
+ * only when they exceed it, so the result depends on the order of
+ * reduction.  Groups of 16 integers whose magnitudes, added to that of
+ * the running sum, do not exceed 10^8 cannot trigger any reduction and
+ * are summed directly with SSE2 where available; other groups, and all
+ * integers elsewhere, are added one at a time.  The result is identical
+ * to adding one integer at a time.
+ *
+ * Returns the updated running checksum.
+ ***************************************************************************/
+int32_t
+gsechksumadd (int32_t cksum, const int32_t *intbuf, int32_t Nint)
+{
+  int32_t i = 0;
+  
+#if defined(CM6_SSE2)
+  const __m128i bias = _mm_set1_epi32 (INT32_MIN);
+  const __m128i limit = _mm_set1_epi32 (CHKMODULO ^ INT32_MIN);
+  __m128i x, sign, absx, sumv, magv, over;
+  uint32_t magnitude;
+  int32_t lanes[4];
+  int32_t k;
+  
+  for (; i + 16 <= Nint; i += 16)
     {
-      if ( abs(intbuf[i]) > MODULO ) val=intbuf[i] - MODULO * (intbuf[i] / MODULO);
-      else val=intbuf[i];
+      sumv = _mm_setzero_si128 ();
+      magv = _mm_setzero_si128 ();
+      over = _mm_setzero_si128 ();
+      
+      for (k=0; k < 16; k += 4)
+	{
+	  x = _mm_loadu_si128 ((const __m128i *) (intbuf + i + k));
+	  sign = _mm_srai_epi32 (x, 31);
+	  absx = _mm_sub_epi32 (_mm_xor_si128 (x, sign), sign);
+	  
+	  /* Unsigned comparison of the magnitudes with the modulus */
+	  over = _mm_or_si128 (over, _mm_cmpgt_epi32 (_mm_xor_si128 (absx, bias), limit));
+	  sumv = _mm_add_epi32 (sumv, x);
+	  magv = _mm_add_epi32 (magv, absx);
+	}
+      
+      /* With all magnitudes within the modulus the sums cannot overflow */
+      if ( ! _mm_movemask_epi8 (over) )
+	{
+	  _mm_storeu_si128 ((__m128i *) lanes, magv);
+	  magnitude = (uint32_t) lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	  
+	  if ( (uint32_t) abs(cksum) + magnitude <= CHKMODULO )
+	    {
+	      _mm_storeu_si128 ((__m128i *) lanes, sumv);
+	      cksum += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	      continue;
+	    }
+	}
+      
+      for (k=0; k < 16; k++)
+	GSECHKSUM_ADD (cksum, intbuf[i+k]);
+    }
+#endif
+  
+  for (; i < Nint; i++)
+    GSECHKSUM_ADD (cksum, intbuf[i]);
+  
+  return cksum;
+}
 
-      cksum+=val;
 
-      if ( abs(cksum) > MODULO )
-	cksum= cksum - MODULO * (cksum/MODULO);
+/***************************************************************************
+ * parseint32:
+ *
+ * Parse a base 10 integer with an optional sign from the characters
+ * between str and end, stopping at the first character that is not a
+ * digit, as used for GSE INT data.  Values outside the range of a
+ * 32-bit integer are clamped to the range and overflow is set,
+ * otherwise overflow is cleared.
+ *
+ * str      = first character to parse
+ * end      = end of the characters to parse
+ * bufend   = end of readable memory, at or after end
+ * value    = parsed value
+ * overflow = flag set if the value was clamped
+ *
+ * On little-endian hosts up to 8 digits are converted at once using
+ * SWAR (SIMD within a register) arithmetic, avoiding a multiply and
+ * branch per digit.  This reads 8 characters at a time, which may go
+ * beyond end but never beyond bufend, the end of readable memory.
+ *
+ * Returns a pointer to the first character following the digits.
+ ***************************************************************************/
+const char *
+parseint32 (const char *str, const char *end, const char *bufend,
+	    int32_t *value, int *overflow)
+{
+  uint64_t magnitude = 0;
+  uint64_t limit = INT32_MAX;
+  int negative = 0;
+  
+  if ( str < end && (*str == '-' || *str == '+') )
+    {
+      if ( *str == '-' )
+	{
+	  negative = 1;
+	  limit = (uint64_t) INT32_MAX + 1;
+	}
+      str++;
     }
-
-  return (abs(cksum));
+  
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  if ( bufend - str >= 8 )
+    {
+      uint64_t chunk;
+      uint64_t nondigit;
+      int ndigits;
+      
+      memcpy (&chunk, str, 8);
+      
+      /* Non-zero bytes for characters other than '0' through '9', a
+       * carry from adding 6 only ever follows a non-digit */
+      nondigit = ((chunk & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL) |
+	(((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) ^ 0x3030303030303030ULL);
+      
+      ndigits = ( nondigit ) ? __builtin_ctzll (nondigit) >> 3 : 8;
+      
+      if ( ndigits > end - str )
+	ndigits = (int) (end - str);
+      
+      if ( ndigits > 0 )
+	{
+	  /* Shift the digits to the top, padding with leading zeros,
+	   * and combine pairs of digits, pairs of pairs and so on */
+	  chunk = (chunk - 0x3030303030303030ULL) << (8 * (8 - ndigits));
+	  chunk = ((chunk & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+	  chunk = ((chunk & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+	  magnitude = ((chunk & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+	  
+	  str += ndigits;
+	}
+    }
+#endif
+  
+  /* Remaining digits, stop accumulating once beyond the limit */
+  for ( ; str < end && *str >= '0' && *str <= '9'; str++ )
+    {
+      if ( magnitude <= limit )
+	magnitude = magnitude * 10 + (*str - '0');
+    }
+  
+  *overflow = ( magnitude > limit );
+  
+  if ( *overflow )
+    magnitude = limit;
+  
+  *value = ( negative ) ? (int32_t) (0 - (int64_t) magnitude) : (int32_t) magnitude;
+  
+  return str;
 }
@@ -8,23 +8,44 @@ extern "C" {
 
 #include <libmseed.h>
 
-/* Table of all possible CM6 characters */
-static char cm6table[64]= { '+','-','0','1','2','3','4','5','6','7',
-			    '8','9','A','B','C','D','E','F','G','H',
-			    'I','J','K','L','M','N','O','P','Q','R',
-			    'S','T','U','V','W','X','Y','Z','a','b',
-			    'c','d','e','f','g','h','i','j','k','l',
-			    'm','n','o','p','q','r','s','t','u','v',
-			    'w','x','y','z' };
-  
+/* Table of all possible CM6 characters, defined in cm6.c */
+extern char cm6table[64];
+
+/* Maximum differencing level supported by incremental decoding */
+#define CM6_MAXDIFF 4
+
+/* State for incremental CM6 decoding, see cm6init() and cm6decode() */
+typedef struct CM6State_s {
+  uint32_t value;              /* Value of partially decoded sample */
+  int8_t   sign;               /* Sign flag of partially decoded sample */
+  int8_t   cont;               /* Continuation flag, a sample is partially decoded */
+  int32_t  ndiff;              /* Differencing level */
+  uint32_t sums[CM6_MAXDIFF];  /* Integration state for each differencing level */
+  int32_t  cksum;              /* Running GSE checksum of decoded samples, see gsechksumadd() */
+} CM6State;
+
 char *packcm6 (int32_t *intbuf, int32_t Nint, char *cm6buf,
 	       int32_t *Ncm6, int32_t ndiff);
   
 int32_t *unpackcm6 (const char *cm6buf, int32_t Ncm6, int32_t *intbuf,
-		    int32_t *Nint, int32_t Nreq, int32_t ndiff);
+		    int32_t *Nint, int32_t *Nintbuf, int32_t Nreq, int32_t ndiff);
+
+int cm6init (CM6State *state, int32_t ndiff);
+
+int32_t cm6decode (CM6State *state, const char *cm6buf, int32_t Ncm6,
+		   int32_t *intbuf, int32_t Nintbuf, int32_t *Nint);
+
+int32_t cm6finish (CM6State *state, int32_t *intbuf);
+
+int32_t cm6span (const char *cm6buf, int32_t Ncm6);
 
 int32_t gsechksum (int32_t *intbuf, int32_t Nint);
 
+int32_t gsechksumadd (int32_t cksum, const int32_t *intbuf, int32_t Nint);
+
+const char *parseint32 (const char *str, const char *end, const char *bufend,
+			int32_t *value, int *overflow);
+
 #ifdef __cplusplus
 }
 #endif
@@ -5,41 +5,292 @@
  *
  * Written by Chad Trabant, IRIS Data Management Center
  *
- * modified 2013.138
+ * modified 2026.289
  ***************************************************************************/
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <string.h>
 #include <time.h>
 #include <errno.h>
 
 #include <libmseed.h>
 
+#if !defined(LMP_WIN)
+  #include <fcntl.h>
+  #include <pthread.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+#if defined(LMP_WIN)
+  #include <direct.h>
+#endif
+
+#if defined(__APPLE__)
+  #define fdatasync fsync
+#endif
+
 #include "cm6.h"
 
+/* White space test equivalent to isspace() in the C locale */
+#define GSESPACE(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+
 #define VERSION "1.13"
 #define PACKAGE "gse2mseed"
 
-static void packtraces (flag flush);
-static int gse2group (char *gsefile, MSTraceGroup *mstg);
+/* Minimum input size of a job when decoding blocks concurrently */
+#define BLOCKJOBSIZE 262144
+
+/* Size of each of the two output buffers of a record writer */
+#define OUTBUFSIZE 8388608
+
+/* Maximum number of open SDS files, hash table size and buffer size */
+#define SDSMAXOPEN 128
+#define SDSHASHSIZE 256
+#define SDSBUFSIZE 65536
+
+/* Time of a sample as calculated by msr_pack() */
+#define SAMPLETIME(T,I,R) ((T) + (hptime_t) ((I) / (R) * HPTMODULUS + 0.5))
+
+/* Start of the day containing a time */
+#define DAYLENGTH ((hptime_t) 86400 * HPTMODULUS)
+#define DAYSTART(T) ((T) - (((T) % DAYLENGTH) + DAYLENGTH) % DAYLENGTH)
+
+/* Start, or end if byend is true, time of trace idx of a source name */
+#define TRACETIME(id,idx,byend) ((byend) ? (id)->segs[idx].mst->endtime : (id)->segs[idx].mst->starttime)
+
+/* Contents of an input file, memory mapped if possible */
+struct inputfile {
+  char  *data;       /* File contents */
+  size_t size;       /* Size of file contents in bytes */
+  int    mapped;     /* Flag indicating data is memory mapped */
+};
+
+/* Buffers used to decode GSE blocks, reused for all blocks and files */
+struct blockbuffers {
+  int32_t *intbuf;       /* Samples of the current block */
+  size_t   intcount;     /* Number of samples in intbuf */
+  size_t   intalloc;     /* Number of samples allocated for intbuf */
+  CM6State cm6state;     /* Decoding state for CM6 data of the current block */
+  MSRecord *msr;         /* Holder for the current block header values */
+  MSRecord *packmsr;     /* Template for packing, see packtemplate() */
+};
+
+/* Record writer, output is copied to one of two buffers while the
+ * other is written to the output file by a writer thread */
+struct recwriter {
+  FILE   *fp;              /* Output file, 0 if not open */
+  char   *buffer[2];       /* Output buffers */
+  int     current;         /* Index of the buffer being filled */
+  size_t  fill;            /* Number of bytes in the current buffer */
+  int     syncdata;        /* Flag to synchronize data to storage after writing */
+  int     error;           /* Error number of a failed write, 0 if none */
+#if !defined(LMP_WIN)
+  char   *pendingbuf;      /* Buffer handed to the writer thread */
+  size_t  pending;         /* Number of bytes in pendingbuf, 0 when written */
+  int     started;         /* Flag indicating the writer thread is running */
+  int     stop;            /* Flag to stop the writer thread */
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t  ready;   /* Signaled when a buffer is pending */
+  pthread_cond_t  written; /* Signaled when the pending buffer is written */
+#endif
+};
+
+/* An open file of an SDS archive */
+struct sdsfile {
+  char      ident[12];       /* Station, location, channel and network as in a header */
+  uint16_t  year;
+  uint16_t  day;
+  uint32_t  hash;            /* Hash table index */
+  char      name[40];        /* File name, NET.STA.LOC.CHAN.D.YEAR.DAY */
+  FILE     *fp;
+  struct sdsfile *prev;      /* More recently used file */
+  struct sdsfile *next;      /* Less recently used file */
+  struct sdsfile *hashnext;  /* Next file in hash table entry */
+};
+
+/* Output to an SDS archive with a cache of open files */
+struct sdsarchive {
+  char   *dir;                         /* Base directory of archive */
+  struct sdsfile *table[SDSHASHSIZE];  /* Hash table of open files */
+  struct sdsfile *mru;                 /* Most recently used file */
+  struct sdsfile *lru;                 /* Least recently used file */
+  int     open;                        /* Number of open files */
+  int     error;                       /* Flag indicating writing failed */
+};
+
+/* A trace of a group in a trace index */
+struct tracesegment {
+  MSTrace  *mst;
+  int64_t   maxsamples;      /* Number of samples allocated for the trace */
+};
+
+/* The traces of a source name in a trace index */
+struct traceid {
+  struct tracesegment *segs; /* Traces in the order added to the group */
+  int      *bystart;         /* Indexes of segs sorted by start time */
+  int      *byend;           /* Indexes of segs sorted by end time */
+  int       numsegs;         /* Number of traces */
+  int       maxsegs;         /* Number of traces allocated */
+  uint32_t  hash;            /* Hash of the source name */
+  struct traceid *next;      /* Next source name in hash table entry */
+};
+
+/* Hash index of the traces of a group by source name */
+struct traceindex {
+  struct traceid **table;    /* Hash table of source names */
+  uint32_t  size;            /* Size of the hash table, a power of 2 */
+  uint32_t  count;           /* Number of source names */
+  MSTrace  *last;            /* Last trace of the group */
+};
+
+/* Conversion context, all state that changes while converting files.
+ * Each conversion thread uses its own context. */
+struct convcontext {
+  struct blockbuffers bb;  /* Block decoding buffers */
+  struct recwriter out;    /* Output for records, unless buffered */
+  struct sdsarchive *sds;  /* SDS archive output, unless buffered */
+  int     buffered;        /* Flag to collect records in recbuf */
+  char   *recbuf;          /* Buffer of packed records */
+  size_t  recsize;         /* Number of bytes in recbuf */
+  size_t  recalloc;        /* Number of bytes allocated for recbuf */
+  int     bufferlog;       /* Flag to collect messages in msgbuf */
+  char   *msgbuf;          /* Buffer of diagnostic messages */
+  size_t  msgsize;         /* Number of bytes in msgbuf */
+  size_t  msgalloc;        /* Number of bytes allocated for msgbuf */
+  int     blockthreads;    /* Number of threads to decode blocks of a file */
+  struct traceindex groupindex;   /* Index of the group when buffering all */
+  MSTraceGroup *streams;   /* Open streams when streaming, see streamblock() */
+  struct traceindex streamindex;  /* Index of the streams */
+  int64_t streamsamples;   /* Number of samples buffered in all streams */
+  int     packedtraces;
+  int     packedsamples;
+  int     packedrecords;
+};
+
+#if !defined(LMP_WIN)
+/* A conversion job of the worker pool, a whole file or range of blocks */
+struct convjob {
+  char   *filename;
+  char   *start;           /* Start of the input of a block job, 0 for a file job */
+  char   *end;             /* End of the input of a block job */
+  char   *recbuf;          /* Packed records of the job, to be written in order */
+  size_t  recsize;         /* Number of bytes in recbuf */
+  size_t  recalloc;        /* Number of bytes allocated for recbuf */
+  char   *msgbuf;          /* Diagnostic messages of the job */
+  size_t  msgsize;         /* Number of bytes in msgbuf */
+  size_t  msgalloc;        /* Number of bytes allocated for msgbuf */
+  size_t  size;            /* Input size of the job in bytes */
+  int     packedtraces;
+  int     packedsamples;
+  int     packedrecords;
+  int     retval;          /* Return value of the job, -1 on failure */
+  int     done;            /* Flag indicating the job is complete */
+  struct convjob *next;    /* Next job in the queue */
+};
+
+/* Shared state of the worker pool, protected by lock */
+struct workpool {
+  struct convjob *head;    /* Oldest job not yet output */
+  struct convjob *tail;    /* Newest job queued */
+  struct convjob *claim;   /* Next job to be claimed by a worker */
+  struct convjob *spare;   /* Output jobs kept for reuse, with their buffers */
+  int    complete;         /* Flag indicating all jobs are queued */
+  int    stop;             /* Flag to stop queuing and claiming jobs */
+  int    stoponerror;      /* Flag to stop after a failed job */
+  int    buffered;         /* Flag indicating records are collected by workers */
+  size_t inflight;         /* Input bytes of jobs queued but not output */
+  size_t budget;           /* Maximum input bytes of jobs in flight */
+  char  *gsefile;          /* Input file of block jobs, 0 for file jobs */
+  char  *input;            /* Input of block jobs */
+  char  *inputend;         /* End of input of block jobs */
+  pthread_mutex_t lock;
+  pthread_cond_t  queued;  /* Signaled when a job is queued */
+  pthread_cond_t  jobdone; /* Signaled when a job is complete */
+  pthread_cond_t  written; /* Signaled when a job has been output */
+};
+#endif
+
+static void packtraces (struct convcontext *ctx, MSTraceGroup *mstg, flag flush);
+static void packblock (struct convcontext *ctx, MSRecord *blockmsr);
+static MSRecord *packtemplate (struct blockbuffers *bb, char *network, char *station,
+			       char *location, char *channel);
+static void streamblock (struct convcontext *ctx, MSRecord *blockmsr);
+static void packstream (struct convcontext *ctx, MSTrace *mst, void *samples,
+			int64_t count, flag flush);
+static void flushstreams (struct convcontext *ctx);
+static void freestreams (struct convcontext *ctx);
+static MSTrace *addtogroup (struct traceindex *index, MSTraceGroup *mstg, MSRecord *msr);
+static int addsamples (struct tracesegment *seg, MSRecord *msr, hptime_t endtime, flag whence);
+static struct traceid *findtraceid (struct traceindex *index, MSRecord *msr);
+static int searchtraces (struct traceid *id, flag byend, hptime_t time);
+static void reordertrace (struct traceid *id, flag byend, int pos);
+static int linktrace (struct traceindex *index, MSTraceGroup *mstg, struct traceid *id,
+		      MSTrace *mst);
+static void freetraceindex (struct traceindex *index);
+static int gse2group (struct convcontext *ctx, char *gsefile, MSTraceGroup *mstg);
+static int scanblock (struct convcontext *ctx, char *gsefile, char **lineptr, char *inputend);
+static void emitblock (struct convcontext *ctx, char *gsefile, MSTraceGroup *mstg);
+#if !defined(LMP_WIN)
+static int convertfiles (struct convcontext *ctx);
+static int convertblocks (struct convcontext *ctx, char *gsefile, char *input, char *inputend);
+static int runjobs (struct convcontext *ctx, struct workpool *pool);
+static int queuejob (struct workpool *pool, struct convjob *job);
+static struct convjob *newjob (struct workpool *pool, char *filename, char *start,
+			       char *end, size_t size);
+static void freejob (struct convjob *job);
+static void *convreader (void *arg);
+static void *convworker (void *arg);
+#endif
+static int mapinput (char *filename, struct inputfile *input);
+static void unmapinput (struct inputfile *input);
+static int growbuffer (void **buffer, size_t *allocated, size_t needed, size_t size);
+static void freeblockbuffers (struct blockbuffers *bb);
+static int openwriter (struct recwriter *w, FILE *fp);
+static void writeoutput (struct recwriter *w, const char *data, size_t size);
+static int closewriter (struct recwriter *w);
+static void freewriter (struct recwriter *w);
+static void handoffbuffer (struct recwriter *w);
+static int  outputrecords (struct convcontext *ctx, char *records, size_t size);
+static int sdswrite (struct sdsarchive *sds, char *record, int reclen);
+static struct sdsfile *sdsopen (struct sdsarchive *sds, const char *ident,
+				uint16_t year, uint16_t day);
+static void sdsunlink (struct sdsarchive *sds, struct sdsfile *file);
+static int sdsclosefile (struct sdsarchive *sds, struct sdsfile *file);
+static int sdsclose (struct sdsarchive *sds);
+static void sdsmkdirs (char *path);
+static int64_t daysplit (hptime_t starttime, double samprate);
+static void writebuffer (struct recwriter *w, char *data, size_t size);
+#if !defined(LMP_WIN)
+static void *writerthread (void *arg);
+#endif
 static int parameter_proc (int argcount, char **argvec);
 static char *getoptval (int argcount, char **argvec, int argopt);
 static int readlistfile (char *listfile);
 static void addfile (char *filename);
 static void record_handler (char *record, int reclen, void *handlerdata);
+static void convlog (struct convcontext *ctx, const char *format, ...);
 static void usage (void);
 
 static int   verbose     = 0;
 static int   ignorecs    = 0;
 static char  bufferall   = 0;
+static char  streaming   = 0;
+static double streamlatency = 0.0;
 static char *forcenet    = 0;
 static char *forceloc    = 0;
 static int   packreclen  = -1;
 static int   encoding    = -1;
 static int   byteorder   = -1;
+static int   threads     = 1;
+static int   memorybudget = 256;
+static int   syncoutput  = 0;
 static char *outputfile  = 0;
-static FILE *ofp         = 0;
+static char *sdsdir      = 0;
 
 struct filelink {
   char *filename;
@@ -48,23 +299,28 @@ struct filelink {
 
 /* A list of input files */
 struct filelink *filelist = 0;
+struct filelink *filelisttail = 0;
+static int filecount = 0;
 
-static MSTraceGroup *mstg = 0;
-
-static int packedtraces  = 0;
-static int packedsamples = 0;
-static int packedrecords = 0;
 
 
 int
 main (int argc, char **argv)
 {
   struct filelink *flp;
+  struct convcontext ctx;
+  MSTraceGroup *mstg = 0;
+  struct sdsarchive sds;
+  FILE *ofp = 0;
+  int retval = 0;
+  int error;
   
   /* Process given parameters (command line and parameter file) */
   if (parameter_proc (argc, argv) < 0)
     return -1;
   
+  memset (&ctx, 0, sizeof(struct convcontext));
+  
   /* Init MSTraceGroup */
   mstg = mst_initgroup (mstg);
   
@@ -83,33 +339,78 @@ main (int argc, char **argv)
         }
     }
   
-  /* Read input GSE files into MSTraceGroup */
-  flp = filelist;
+  if ( ofp && openwriter (&ctx.out, ofp) )
+    return -1;
   
-  while ( flp != 0 )
+  /* Initialize SDS archive output if specified */
+  if ( sdsdir )
     {
-      if ( verbose )
-	fprintf (stderr, "Reading %s\n", flp->filename);
-
-      gse2group (flp->filename, mstg);
+      memset (&sds, 0, sizeof(struct sdsarchive));
+      sds.dir = sdsdir;
+      ctx.sds = &sds;
+    }
+  
+  ctx.blockthreads = threads;
+  
+#if !defined(LMP_WIN)
+  /* Convert files concurrently if there are enough files for all
+   * threads, otherwise decode the blocks of each file concurrently */
+  if ( threads > 1 && filecount >= threads )
+    {
+      if ( convertfiles (&ctx) )
+        retval = -1;
+    }
+  else
+#endif
+    {
+      /* Read input GSE files into MSTraceGroup */
+      flp = filelist;
       
-      flp = flp->next;
+      while ( flp != 0 )
+        {
+          if ( verbose )
+            fprintf (stderr, "Reading %s\n", flp->filename);
+          
+          gse2group (&ctx, flp->filename, mstg);
+          
+          flp = flp->next;
+        }
+    }
+  
+  /* Flush the data remaining in streams */
+  if ( streaming )
+    {
+      flushstreams (&ctx);
+      freestreams (&ctx);
     }
   
   /* Pack any remaining, possibly all data */
-  packtraces (1);
-  packedtraces += mstg->numtraces;
+  packtraces (&ctx, mstg, 1);
+  ctx.packedtraces += mstg->numtraces;
   
   fprintf (stderr, "Packed %d trace(s) of %d samples into %d records\n",
-           packedtraces, packedsamples, packedrecords);
+           ctx.packedtraces, ctx.packedsamples, ctx.packedrecords);
   
   /* Make sure everything is cleaned up */
   mst_freegroup (&mstg);
+  freetraceindex (&ctx.groupindex);
+  freeblockbuffers (&ctx.bb);
+  
+  if ( (error = closewriter (&ctx.out)) )
+    {
+      fprintf (stderr, "Error writing to output file: %s\n", strerror(error));
+      retval = -1;
+    }
   
-  if ( ofp )
-    fclose (ofp);
+  freewriter (&ctx.out);
   
-  return 0;
+  if ( ctx.sds && sdsclose (ctx.sds) )
+    {
+      fprintf (stderr, "Error writing to SDS archive: %s\n", sdsdir);
+      retval = -1;
+    }
+  
+  return retval;
 }  /* End of main() */
 
 
@@ -121,14 +422,13 @@ main (int argc, char **argv)
  * Returns 0 on success, and -1 on failure
  ***************************************************************************/
 static void
-packtraces (flag flush)
+packtraces (struct convcontext *ctx, MSTraceGroup *mstg, flag flush)
 {
   MSTrace *mst;
   MSRecord *msr = NULL;
+  MSRecord *template;
   int64_t trpackedsamples = 0;
   int64_t trpackedrecords = 0;
-  struct blkt_1000_s Blkt1000;
-  struct blkt_1001_s Blkt1001;
   
   mst = mstg->traces;
   while ( mst )
@@ -139,21 +439,37 @@ packtraces (flag flush)
           continue;
         }
       
-      /* Initialize MSRecord template for packing */
-      msr = msr_init(msr);
-      strncpy (msr->network, mst->network, sizeof(msr->network));
-      strncpy (msr->station, mst->station, sizeof(msr->station));
-      strncpy (msr->location, mst->location, sizeof(msr->location));
-      strncpy (msr->channel, mst->channel, sizeof(msr->channel));
+      /* Pack traces for SDS output with packblock() to split days */
+      if ( sdsdir && flush )
+        {
+          msr = msr_init(msr);
+          strncpy (msr->network, mst->network, sizeof(msr->network));
+          strncpy (msr->station, mst->station, sizeof(msr->station));
+          strncpy (msr->location, mst->location, sizeof(msr->location));
+          strncpy (msr->channel, mst->channel, sizeof(msr->channel));
+          msr->starttime = mst->starttime;
+          msr->samprate = mst->samprate;
+          msr->datasamples = mst->datasamples;
+          msr->numsamples = mst->numsamples;
+          msr->sampletype = mst->sampletype;
+          
+          packblock (ctx, msr);
+          
+          msr->datasamples = 0;
+          mst->numsamples = 0;
+          mst = mst->next;
+          continue;
+        }
       
-      /* Add blockettes 1000 & 1001 to template */
-      memset (&Blkt1000, 0, sizeof(struct blkt_1000_s));
-      msr_addblockette (msr, (char *) &Blkt1000, sizeof(struct blkt_1001_s), 1000, 0);
-      memset (&Blkt1001, 0, sizeof(struct blkt_1001_s));
-      msr_addblockette (msr, (char *) &Blkt1001, sizeof(struct blkt_1001_s), 1001, 0);
+      if ( ! (template = packtemplate (&ctx->bb, mst->network, mst->station,
+				       mst->location, mst->channel)) )
+	{
+	  fprintf (stderr, "Cannot initialize MSRecord strcture\n");
+	  break;
+	}
       
-      trpackedrecords = mst_pack (mst, &record_handler, 0, packreclen, encoding, byteorder,
-                                  &trpackedsamples, flush, verbose-2, msr);
+      trpackedrecords = mst_pack (mst, &record_handler, ctx, packreclen, encoding, byteorder,
+                                  &trpackedsamples, flush, verbose-2, template);
       
       if ( trpackedrecords < 0 )
         {
@@ -161,8 +477,8 @@ packtraces (flag flush)
         }
       else
         {
-          packedrecords += trpackedrecords;
-          packedsamples += trpackedsamples;
+          ctx->packedrecords += trpackedrecords;
+          ctx->packedsamples += trpackedsamples;
         }
       
       mst = mst->next;
@@ -173,391 +489,2695 @@ packtraces (flag flush)
 
 
 /***************************************************************************
- * gse2group:
- * Read a GSE file and add data samples to a MSTraceGroup.  As the GSE
- * is read in a MSRecord struct is used as a holder for the input
- * information.
+ * packblock:
  *
- * Returns 0 on success, and -1 on failure
+ * Pack the samples of a single GSE block directly from the block
+ * sample buffer, flushing all data.  This avoids copying the samples
+ * into an MSTrace and produces the same records as adding the block to
+ * an empty MSTraceGroup and packing it with packtraces().
+ *
+ * For SDS output the samples are packed separately for each day so no
+ * record spans a day boundary.
  ***************************************************************************/
-static int
-gse2group (char *gsefile, MSTraceGroup *mstg)
+static void
+packblock (struct convcontext *ctx, MSRecord *blockmsr)
 {
-  FILE *ifp;
-  MSRecord *msr = 0;
-  char line[1025];
-  int linesize;
-
-  char timestr[25];
-  char sampstr[10];
-  char ratestr[15];
-  char chkstr[10];
-  
-  int expectdata = 0;
-  int ochksum, cchksum;
-  int blockend = 0;
-  int retval = 0;
-  int format = 0;  /* 1 = CM6, 2 = INT */
+  struct blockbuffers *bb = &ctx->bb;
+  MSRecord *msr;
+  StreamState ststate;
+  int64_t trpackedsamples = 0;
+  int64_t trpackedrecords = 0;
+  int64_t segpackedsamples;
+  int64_t segpackedrecords;
+  int64_t offset = 0;
+  int64_t count;
+  int samplesize;
+  char srcname[50];
   
-  char *cm6buf = 0;
-  int cm6bufsize = 0;   /* Number of characters in cm6buf */
-  int32_t *intbuf = 0;
-  int intbufcount = 0;  /* Number of 32-bit integers in intbuf */
+  if ( blockmsr->numsamples <= 0 )
+    return;
   
-  /* Open input file */
-  if ( (ifp = fopen (gsefile, "r")) == NULL )
+  if ( ! (msr = packtemplate (bb, blockmsr->network, blockmsr->station,
+			      blockmsr->location, blockmsr->channel)) )
     {
-      fprintf (stderr, "Cannot open input file: %s (%s)\n",
-	       gsefile, strerror(errno));
-      return -1;
+      fprintf (stderr, "Cannot initialize MSRecord strcture\n");
+      return;
     }
   
-  /* Open .mseed output file if needed, replacing .gse if present */
-  if ( ! ofp )
+  msr->reclen = packreclen;
+  msr->encoding = encoding;
+  msr->byteorder = byteorder;
+  msr->samprate = blockmsr->samprate;
+  msr->sampletype = blockmsr->sampletype;
+  msr->ststate = &ststate;
+  
+  samplesize = ms_samplesize (blockmsr->sampletype);
+  
+  while ( offset < blockmsr->numsamples )
     {
-      char mseedoutputfile[1024];
-      int filelen;
-      strncpy (mseedoutputfile, gsefile, sizeof(mseedoutputfile)-6 );
-      filelen = strlen (mseedoutputfile);
+      count = blockmsr->numsamples - offset;
       
-      /* Truncate file name if .gse is at the end */
-      if ( filelen > 4 )
-	if ( (*(mseedoutputfile + filelen - 1) == 'e' || *(mseedoutputfile + filelen - 1) == 'E') &&
-	     (*(mseedoutputfile + filelen - 2) == 's' || *(mseedoutputfile + filelen - 2) == 'S') &&
-	     (*(mseedoutputfile + filelen - 3) == 'g' || *(mseedoutputfile + filelen - 3) == 'G') &&
-	     (*(mseedoutputfile + filelen - 4) == '.') )
-	  {
-	    *(mseedoutputfile + filelen - 4) = '\0';
-	  }
+      msr->starttime = ( offset ) ?
+	SAMPLETIME (blockmsr->starttime, offset, blockmsr->samprate) : blockmsr->starttime;
+      
+      /* Limit to samples of the current day for SDS output */
+      if ( sdsdir && blockmsr->samprate > 0.0 )
+	{
+	  int64_t daycount = daysplit (msr->starttime, blockmsr->samprate);
+	  
+	  if ( daycount < count )
+	    count = daycount;
+	}
+      
+      /* Each block is packed as a new trace with new stream state */
+      memset (&ststate, 0, sizeof(StreamState));
+      
+      msr->datasamples = (char *) blockmsr->datasamples + offset * samplesize;
+      msr->numsamples = count;
+      
+      segpackedrecords = msr_pack (msr, &record_handler, ctx, &segpackedsamples, 1, verbose-2);
+      
+      if ( segpackedrecords < 0 )
+	{
+	  trpackedrecords = segpackedrecords;
+	  break;
+	}
+      
+      trpackedrecords += segpackedrecords;
+      trpackedsamples += segpackedsamples;
+      offset += count;
+    }
+  
+  if ( verbose > 3 )
+    ms_log (1, "Packed %d records for %s trace\n", (int) trpackedrecords,
+	    msr_srcname (blockmsr, srcname, 0));
+  
+  /* Data and stream state are not owned by the template */
+  msr->datasamples = 0;
+  msr->ststate = 0;
+  
+  if ( trpackedrecords < 0 )
+    {
+      convlog (ctx, "Error packing data\n");
+    }
+  else
+    {
+      ctx->packedrecords += trpackedrecords;
+      ctx->packedsamples += trpackedsamples;
+    }
+}  /* End of packblock() */
 
-      strcat (mseedoutputfile, ".mseed");
+
+/***************************************************************************
+ * packtemplate:
+ *
+ * Prepare the MSRecord template of the block buffers for packing the
+ * samples of a source name.  The template and its blockettes 1000 &
+ * 1001 are allocated once and reused, only the values that differ
+ * between uses are set, so packing allocates nothing per block.  The
+ * record sequence numbers start at 1 for each use.
+ *
+ * Returns the template on success and 0 on error.
+ ***************************************************************************/
+static MSRecord *
+packtemplate (struct blockbuffers *bb, char *network, char *station,
+	      char *location, char *channel)
+{
+  MSRecord *msr = bb->packmsr;
+  struct blkt_1000_s Blkt1000;
+  struct blkt_1001_s Blkt1001;
+  
+  if ( ! msr )
+    {
+      if ( ! (msr = bb->packmsr = msr_init (NULL)) )
+	return 0;
       
-      if ( (ofp = fopen (mseedoutputfile, "wb")) == NULL )
-        {
-          fprintf (stderr, "Cannot open output file: %s (%s)\n",
-                   mseedoutputfile, strerror(errno));
-          return -1;
-        }
+      /* Add blockettes 1000 & 1001 to template */
+      memset (&Blkt1000, 0, sizeof(struct blkt_1000_s));
+      memset (&Blkt1001, 0, sizeof(struct blkt_1001_s));
+      
+      if ( ! msr_addblockette (msr, (char *) &Blkt1000, sizeof(struct blkt_1001_s), 1000, 0) ||
+	   ! msr_addblockette (msr, (char *) &Blkt1001, sizeof(struct blkt_1001_s), 1001, 0) )
+	{
+	  msr_free (&bb->packmsr);
+	  return 0;
+	}
     }
+  
+  ms_strncpclean (msr->network, network, sizeof(msr->network) - 1);
+  ms_strncpclean (msr->station, station, sizeof(msr->station) - 1);
+  ms_strncpclean (msr->location, location, sizeof(msr->location) - 1);
+  ms_strncpclean (msr->channel, channel, sizeof(msr->channel) - 1);
+  msr->sequence_number = 0;
+  
+  return msr;
+}  /* End of packtemplate() */
 
-  if ( ! (msr = msr_init(msr)) )
+
+/***************************************************************************
+ * streamblock:
+ * Add the samples of a block to the stream of its channel and pack
+ * the records that are filled.  Each stream has a packer holding its
+ * samples and packing state across blocks and files, so records are
+ * packed without moving the samples buffered and partial records are
+ * only flushed when the stream is not contiguous with the block, at a
+ * day boundary for SDS output, when the buffered data span the latency
+ * limit or when the samples buffered in all streams exceed the memory
+ * budget.
+ ***************************************************************************/
+static void
+streamblock (struct convcontext *ctx, MSRecord *blockmsr)
+{
+  struct traceid *id;
+  MSTrace *mst;
+  MSPacker *packer = 0;
+  MSRecord *template;
+  void *datasamples = blockmsr->datasamples;
+  int64_t numsamples = blockmsr->numsamples;
+  hptime_t starttime = blockmsr->starttime;
+  hptime_t segstart;
+  int64_t offset = 0;
+  int64_t count;
+  int samplesize;
+  double period;
+  double gap;
+  int newtrace = 1;
+  struct blkt_1000_s Blkt1000;
+  struct blkt_1001_s Blkt1001;
+  char srcname[50];
+  
+  if ( blockmsr->numsamples <= 0 )
+    return;
+  
+  if ( ! ctx->streams && ! (ctx->streams = mst_initgroup (NULL)) )
     {
-      fprintf (stderr, "Cannot initialize MSRecord strcture\n");
-      return -1;
+      convlog (ctx, "Cannot initialize MSTraceGroup structure\n");
+      return;
     }
   
-  while ( fgets (line, 1025, ifp) )
+  /* Find the stream of the channel */
+  if ( ! (id = findtraceid (&ctx->streamindex, blockmsr)) )
     {
-      linesize = strlen (line);
-      
-      if ( ! strncmp ("WID2", line, 4) && ! expectdata )
+      convlog (ctx, "Cannot allocate memory for stream index\n");
+      return;
+    }
+  
+  mst = ( id->numsegs ) ? id->segs[0].mst : 0;
+  
+  if ( ! mst )
+    {
+      if ( ! (mst = mst_init (NULL)) ||
+	   ! (packer = msr_packer_init (NULL, &record_handler, ctx)) )
 	{
-	  if ( linesize < 68 ) 
-	    {
-	      fprintf (stderr, "[%s] WID2 line is too short, only %d characters:\n%s\n",
-		       gsefile, linesize, line);
-	      retval = -1;
-	      break;
-	    }
-	  
-	  /* Extract values from WID2 line and populate the msr holder */
-	  strncpy (timestr, line + 5, 23); timestr[23] = '\0';
-	  msr->starttime = ms_timestr2hptime (timestr);
-	  
-	  ms_strncpclean (msr->network, forcenet, 2);
-	  ms_strncpclean (msr->station, line + 29, 5);
-	  ms_strncpclean (msr->location, line + 39, 2);
-	  ms_strncpclean (msr->channel, line + 35, 3);
-	  
-	  if ( forceloc )
-	    {
-	      ms_strncpclean (msr->location, forceloc, 2);
-	    }
-	  
-	  if ( ! strncmp (line + 44, "CM6", 3) )
-	    {
-	      format = 1;
-	    }
-	  else if ( ! strncmp (line + 44, "INT", 3) )
-	    {
-	      format = 2;
-	    }
-	  else
-	    {
-	      fprintf (stderr, "[%s] %s %s: Only CM6 and INT formatted data are supported, not %.3s\n",
-		       gsefile, msr->station, msr->channel, line + 44);
-	      retval = -1;
-	      break;
-	    }
-	  
-	  ms_strncpclean (sampstr, line + 48, 8);
-	  msr->samplecnt = strtol (sampstr, NULL, 10);
-	  
-	  ms_strncpclean (ratestr, line + 57, 11);
-	  msr->samprate = strtod (ratestr, NULL);
+	  convlog (ctx, "Cannot initialize stream structures\n");
+	  mst_free (&mst);
+	  return;
 	}
       
-      else if ( ! strncmp ("STA2", line, 4) && ! expectdata )
+      strncpy (mst->network, blockmsr->network, sizeof(mst->network));
+      strncpy (mst->station, blockmsr->station, sizeof(mst->station));
+      strncpy (mst->location, blockmsr->location, sizeof(mst->location));
+      strncpy (mst->channel, blockmsr->channel, sizeof(mst->channel));
+      mst->sampletype = blockmsr->sampletype;
+      
+      /* The packing template of the stream keeps the record sequence */
+      template = packer->msr;
+      strncpy (template->network, blockmsr->network, sizeof(template->network));
+      strncpy (template->station, blockmsr->station, sizeof(template->station));
+      strncpy (template->location, blockmsr->location, sizeof(template->location));
+      strncpy (template->channel, blockmsr->channel, sizeof(template->channel));
+      template->reclen = packreclen;
+      template->encoding = encoding;
+      template->byteorder = byteorder;
+      template->sampletype = blockmsr->sampletype;
+      
+      /* Add blockettes 1000 & 1001 to template */
+      memset (&Blkt1000, 0, sizeof(struct blkt_1000_s));
+      memset (&Blkt1001, 0, sizeof(struct blkt_1001_s));
+      
+      if ( ! msr_addblockette (template, (char *) &Blkt1000, sizeof(struct blkt_1001_s), 1000, 0) ||
+	   ! msr_addblockette (template, (char *) &Blkt1001, sizeof(struct blkt_1001_s), 1001, 0) )
 	{
-	  if ( linesize < 14 )
-	    {
-	      fprintf (stderr, "[%s] %s %s: STA2 line is too short, only %d characters:\n%s\n",
-		       gsefile, msr->station, msr->channel, linesize, line);
-	      retval = -1;
-	      break;
-	    }
-
-	  if ( ! forcenet )
-	    {
-	      ms_strncpclean (msr->network, line + 5, 2);
-	    }
+	  convlog (ctx, "Cannot add blockettes to stream template\n");
+	  msr_packer_free (&packer);
+	  mst_free (&mst);
+	  return;
 	}
       
-      else if ( ! strncmp ("DAT2", line, 4) && ! expectdata )
+      mst->prvtptr = packer;
+      
+      if ( linktrace (&ctx->streamindex, ctx->streams, id, mst) )
 	{
-	  if ( format == 0 )
-	    {
-	      fprintf (stderr, "[%s] DAT2 line read but data format is not yet known!\n",
-		       gsefile);
-	      retval = -1;
-	      break;
-	    }
-	  
-	  expectdata = 1;
+	  convlog (ctx, "Cannot allocate memory for stream index\n");
+	  msr_packer_free (&packer);
+	  mst->prvtptr = 0;
+	  mst_free (&mst);
+	  return;
 	}
+    }
+  else
+    {
+      packer = (MSPacker *) mst->prvtptr;
+      
+      /* Check that the block continues the stream within half a sample */
+      period = ( mst->samprate > 0.0 ) ? 1.0 / mst->samprate : 0.0;
+      gap = (double) (starttime - mst->endtime) / HPTMODULUS - period;
       
-      else if ( ! strncmp ("CHK2 ", line, 5) )
+      if ( mst->samprate > 0.0 && MS_ISRATETOLERABLE (mst->samprate, blockmsr->samprate) &&
+	   ms_dabs (gap) <= period / 2.0 )
 	{
-	  if ( linesize < 6 )
-	    {
-	      fprintf (stderr, "[%s] %s %s: CHK2 line is too short, only %d characters:\n%s\n",
-		       gsefile, msr->station, msr->channel, linesize, line);
-	      retval = -1;
-	      break;
-	    }
+	  newtrace = 0;
+	}
+      else
+	{
+	  if ( verbose > 1 )
+	    convlog (ctx, "Stream %s is not contiguous, flushing\n",
+		     mst_srcname (mst, srcname, 0));
 	  
-	  /* Test that data was actually expected */
-	  if ( ! expectdata )
+	  packstream (ctx, mst, 0, 0, 1);
+	  
+	  if ( packer->msr->ststate )
+	    memset (packer->msr->ststate, 0, sizeof(StreamState));
+	}
+    }
+  
+  if ( newtrace )
+    {
+      mst->samprate = blockmsr->samprate;
+      packer->msr->samprate = blockmsr->samprate;
+      ctx->packedtraces++;
+    }
+  
+  samplesize = ms_samplesize (blockmsr->sampletype);
+  
+  while ( offset < numsamples )
+    {
+      count = numsamples - offset;
+      segstart = ( offset ) ?
+	SAMPLETIME (starttime, offset, blockmsr->samprate) : starttime;
+      
+      /* Limit to samples of the current day and flush the samples
+       * of a previous day for SDS output */
+      if ( sdsdir && blockmsr->samprate > 0.0 )
+	{
+	  int64_t daycount = daysplit (segstart, blockmsr->samprate);
+	  
+	  if ( daycount < count )
+	    count = daycount;
+	  
+	  if ( mst->numsamples > 0 && DAYSTART (mst->starttime) != DAYSTART (segstart) )
+	    packstream (ctx, mst, 0, 0, 1);
+	}
+      
+      if ( mst->numsamples == 0 )
+	packer->msr->starttime = segstart;
+      
+      blockmsr->numsamples = count;
+      blockmsr->samplecnt = count;
+      blockmsr->starttime = segstart;
+      
+      if ( (mst->endtime = msr_endtime (blockmsr)) == HPTERROR )
+	{
+	  convlog (ctx, "Error calculating end time of stream %s\n",
+		   mst_srcname (mst, srcname, 0));
+	  break;
+	}
+      
+      /* Pack the records filled */
+      packstream (ctx, mst, (char *) datasamples + offset * samplesize, count, 0);
+      
+      offset += count;
+    }
+  
+  blockmsr->numsamples = numsamples;
+  blockmsr->samplecnt = numsamples;
+  blockmsr->starttime = starttime;
+  
+  /* Flush the stream if the buffered data span the latency limit */
+  if ( streamlatency > 0.0 && mst->numsamples > 0 &&
+       (double) (mst->endtime - mst->starttime) / HPTMODULUS >= streamlatency )
+    packstream (ctx, mst, 0, 0, 1);
+  
+  /* Flush all streams if the buffered samples exceed the memory budget */
+  if ( ctx->streamsamples * samplesize > (int64_t) memorybudget * 1048576 )
+    flushstreams (ctx);
+}  /* End of streamblock() */
+
+
+/***************************************************************************
+ * packstream:
+ * Add samples to the packer of a stream and pack the records filled,
+ * or pack all samples pending in the packer when flushing.  Samples
+ * that cannot be packed are discarded by the packer.  The start time
+ * and sample count of the stream trace follow the samples pending.
+ ***************************************************************************/
+static void
+packstream (struct convcontext *ctx, MSTrace *mst, void *samples,
+	    int64_t count, flag flush)
+{
+  MSPacker *packer = (MSPacker *) mst->prvtptr;
+  int64_t trpackedsamples = 0;
+  int64_t trpackedrecords = 0;
+  
+  if ( flush )
+    trpackedrecords = msr_packer_flush (packer, &trpackedsamples, verbose-2);
+  else
+    trpackedrecords = msr_packer_push (packer, samples, count, &trpackedsamples, verbose-2);
+  
+  if ( trpackedrecords < 0 )
+    {
+      convlog (ctx, "Error packing data\n");
+    }
+  else
+    {
+      ctx->packedrecords += trpackedrecords;
+      ctx->packedsamples += trpackedsamples;
+    }
+  
+  ctx->streamsamples += packer->numsamples - mst->numsamples;
+  
+  mst->starttime = packer->msr->starttime;
+  mst->numsamples = packer->numsamples;
+  mst->samplecnt = packer->numsamples;
+}  /* End of packstream() */
+
+
+/***************************************************************************
+ * flushstreams:
+ * Flush the samples buffered in all streams.
+ ***************************************************************************/
+static void
+flushstreams (struct convcontext *ctx)
+{
+  MSTrace *mst;
+  
+  if ( ! ctx->streams )
+    return;
+  
+  for ( mst = ctx->streams->traces; mst; mst = mst->next )
+    packstream (ctx, mst, 0, 0, 1);
+}  /* End of flushstreams() */
+
+
+/***************************************************************************
+ * freestreams:
+ * Free all streams and their packers.
+ ***************************************************************************/
+static void
+freestreams (struct convcontext *ctx)
+{
+  MSTrace *mst;
+  MSPacker *packer;
+  
+  if ( ! ctx->streams )
+    return;
+  
+  for ( mst = ctx->streams->traces; mst; mst = mst->next )
+    {
+      packer = (MSPacker *) mst->prvtptr;
+      msr_packer_free (&packer);
+      mst->prvtptr = 0;
+    }
+  
+  mst_freegroup (&ctx->streams);
+  freetraceindex (&ctx->streamindex);
+  ctx->streamsamples = 0;
+}  /* End of freestreams() */
+
+
+/***************************************************************************
+ * addtogroup:
+ * Add the samples of a MSRecord to a MSTraceGroup, appending them to
+ * a time adjacent trace of the same source name or adding a new trace.
+ * This is equivalent to mst_addmsrtogroup() with default time and
+ * sample rate tolerances and without matching data quality, except
+ * that the traces are found with a hash index of the group by source
+ * name instead of scanning all traces of the group.
+ *
+ * The traces of a source name are also kept sorted by start time and
+ * by end time, so the traces a record can follow or precede are found
+ * by searching the tolerance windows around its start and end times.
+ * Of all traces that fit, the one added to the group first is used,
+ * preferring to append to it, as found by mst_addmsrtogroup().  All
+ * traces of the group must be added with this routine.
+ *
+ * Returns a pointer to the MSTrace updated or 0 on error.
+ ***************************************************************************/
+static MSTrace *
+addtogroup (struct traceindex *index, MSTraceGroup *mstg, MSRecord *msr)
+{
+  struct traceid *id;
+  struct tracesegment *seg = 0;
+  MSTrace *mst;
+  hptime_t endtime;
+  hptime_t hpdelta;
+  hptime_t hptimetol;
+  hptime_t fittime;
+  flag whence = 0;
+  int best = -1;
+  int bestpos = 0;
+  int pos;
+  int idx;
+  
+  if ( (endtime = msr_endtime (msr)) == HPTERROR )
+    {
+      ms_log (2, "addtogroup(): Error calculating record end time\n");
+      return 0;
+    }
+  
+  if ( ! (id = findtraceid (index, msr)) )
+    return 0;
+  
+  /* Default time tolerance is 1/2 sample period */
+  hpdelta = (hptime_t) ((msr->samprate) ? (HPTMODULUS / msr->samprate) : 0.0);
+  hptimetol = (hptime_t) (0.5 * hpdelta);
+  
+  /* Check the traces ending one sample period before the record */
+  fittime = msr->starttime - hpdelta;
+  
+  for ( pos = searchtraces (id, 1, fittime - hptimetol); pos < id->numsegs; pos++ )
+    {
+      idx = id->byend[pos];
+      mst = id->segs[idx].mst;
+      
+      if ( mst->endtime > fittime + hptimetol )
+	break;
+      
+      if ( (best < 0 || idx < best) &&
+	   MS_ISRATETOLERABLE (msr->samprate, mst->samprate) )
+	{
+	  best = idx;
+	  bestpos = pos;
+	  whence = 1;
+	}
+    }
+  
+  /* Check the traces starting one sample period after the record,
+   * a trace that also fits at the end was added first */
+  fittime = endtime + hpdelta;
+  
+  for ( pos = searchtraces (id, 0, fittime - hptimetol); pos < id->numsegs; pos++ )
+    {
+      idx = id->bystart[pos];
+      mst = id->segs[idx].mst;
+      
+      if ( mst->starttime > fittime + hptimetol )
+	break;
+      
+      if ( (best < 0 || idx < best) &&
+	   MS_ISRATETOLERABLE (msr->samprate, mst->samprate) )
+	{
+	  best = idx;
+	  bestpos = pos;
+	  whence = 2;
+	}
+    }
+  
+  if ( best >= 0 )
+    seg = &id->segs[best];
+  
+  if ( seg )
+    {
+      mst = seg->mst;
+      
+      /* Records with no time coverage do not contribute to a trace */
+      if ( msr->samplecnt <= 0 || msr->samprate <= 0.0 )
+	return mst;
+      
+      if ( addsamples (seg, msr, endtime, whence) )
+	return 0;
+      
+      /* Appending moves the end time of the trace, prepending the start */
+      reordertrace (id, (whence == 1), bestpos);
+      
+      return mst;
+    }
+  
+  if ( ! (mst = mst_init (NULL)) )
+    return 0;
+  
+  strncpy (mst->network, msr->network, sizeof(mst->network));
+  strncpy (mst->station, msr->station, sizeof(mst->station));
+  strncpy (mst->location, msr->location, sizeof(mst->location));
+  strncpy (mst->channel, msr->channel, sizeof(mst->channel));
+  
+  mst->starttime = msr->starttime;
+  mst->samprate = msr->samprate;
+  mst->sampletype = msr->sampletype;
+  
+  if ( mst_addmsr (mst, msr, 1) || linktrace (index, mstg, id, mst) )
+    {
+      mst_free (&mst);
+      return 0;
+    }
+  
+  return mst;
+}  /* End of addtogroup() */
+
+
+/***************************************************************************
+ * addsamples:
+ * Add the samples of a MSRecord to the end (whence 1) or beginning
+ * (whence 2) of a trace of a trace index, as done by mst_addmsr().
+ * The sample buffer of the trace is grown geometrically so adding a
+ * block does not reallocate and copy all samples of the trace.
+ *
+ * Returns 0 on success and -1 on error.
+ ***************************************************************************/
+static int
+addsamples (struct tracesegment *seg, MSRecord *msr, hptime_t endtime, flag whence)
+{
+  MSTrace *mst = seg->mst;
+  int64_t maxsamples;
+  void *datasamples;
+  int samplesize;
+  
+  if ( msr->sampletype != mst->sampletype ||
+       ! (samplesize = ms_samplesize (msr->sampletype)) )
+    {
+      ms_log (2, "addsamples(): Mismatched sample type, '%c' and '%c'\n",
+	      msr->sampletype, mst->sampletype);
+      return -1;
+    }
+  
+  if ( mst->numsamples + msr->numsamples > seg->maxsamples )
+    {
+      maxsamples = mst->numsamples + msr->numsamples;
+      maxsamples += maxsamples / 2;
+      
+      if ( ! (datasamples = realloc (mst->datasamples, (size_t) (maxsamples * samplesize))) )
+	{
+	  ms_log (2, "addsamples(): Cannot allocate memory\n");
+	  return -1;
+	}
+      
+      mst->datasamples = datasamples;
+      seg->maxsamples = maxsamples;
+    }
+  
+  if ( whence == 1 )
+    {
+      memcpy ((char *)mst->datasamples + (mst->numsamples * samplesize),
+	      msr->datasamples, (size_t) (msr->numsamples * samplesize));
+      
+      mst->endtime = endtime;
+    }
+  else
+    {
+      memmove ((char *)mst->datasamples + (msr->numsamples * samplesize),
+	       mst->datasamples, (size_t) (mst->numsamples * samplesize));
+      memcpy (mst->datasamples, msr->datasamples,
+	      (size_t) (msr->numsamples * samplesize));
+      
+      mst->starttime = msr->starttime;
+    }
+  
+  if ( mst->dataquality && msr->dataquality && mst->dataquality != msr->dataquality )
+    mst->dataquality = 0;
+  
+  mst->numsamples += msr->numsamples;
+  mst->samplecnt += msr->samplecnt;
+  
+  return 0;
+}  /* End of addsamples() */
+
+
+/***************************************************************************
+ * findtraceid:
+ * Find the source name of a MSRecord in a trace index, adding it with
+ * no traces if not found.  The hash table is doubled in size when the
+ * number of source names exceeds it.
+ *
+ * Returns a pointer to the source name entry or 0 on error.
+ ***************************************************************************/
+static struct traceid *
+findtraceid (struct traceindex *index, MSRecord *msr)
+{
+  struct traceid **table;
+  struct traceid *id;
+  struct traceid *next;
+  uint32_t hash = 2166136261u;
+  uint32_t size;
+  uint32_t idx;
+  const char *field[4];
+  const char *cp;
+  MSTrace *mst;
+  
+  field[0] = msr->network;
+  field[1] = msr->station;
+  field[2] = msr->location;
+  field[3] = msr->channel;
+  
+  /* FNV-1a hash of the source name, including the terminators */
+  for ( idx = 0; idx < 4; idx++ )
+    {
+      for ( cp = field[idx]; *cp; cp++ )
+	hash = (hash ^ (uint8_t) *cp) * 16777619u;
+      hash *= 16777619u;
+    }
+  
+  if ( index->table )
+    {
+      for ( id = index->table[hash & (index->size - 1)]; id; id = id->next )
+	{
+	  if ( id->hash != hash || ! id->numsegs )
+	    continue;
+	  
+	  mst = id->segs[0].mst;
+	  
+	  if ( ! strcmp (mst->station, msr->station) &&
+	       ! strcmp (mst->channel, msr->channel) &&
+	       ! strcmp (mst->location, msr->location) &&
+	       ! strcmp (mst->network, msr->network) )
+	    return id;
+	}
+    }
+  
+  /* Grow the hash table as needed */
+  if ( index->count >= index->size )
+    {
+      size = ( index->size ) ? index->size * 2 : 256;
+      
+      if ( ! (table = (struct traceid **) calloc (size, sizeof(struct traceid *))) )
+	return 0;
+      
+      for ( idx = 0; idx < index->size; idx++ )
+	{
+	  for ( id = index->table[idx]; id; id = next )
+	    {
+	      next = id->next;
+	      id->next = table[id->hash & (size - 1)];
+	      table[id->hash & (size - 1)] = id;
+	    }
+	}
+      
+      free (index->table);
+      index->table = table;
+      index->size = size;
+    }
+  
+  /* Add a source name without traces, linktrace() adds the first */
+  for ( id = index->table[hash & (index->size - 1)]; id; id = id->next )
+    if ( id->hash == hash && ! id->numsegs )
+      return id;
+  
+  if ( ! (id = (struct traceid *) calloc (1, sizeof(struct traceid))) )
+    return 0;
+  
+  id->hash = hash;
+  id->next = index->table[hash & (index->size - 1)];
+  index->table[hash & (index->size - 1)] = id;
+  index->count++;
+  
+  return id;
+}  /* End of findtraceid() */
+
+
+/***************************************************************************
+ * searchtraces:
+ * Search the traces of a source name sorted by start time, or by end
+ * time if byend is true, for the first trace at or after time.
+ *
+ * Returns the position of the trace in the order, or the number of
+ * traces if all are before time.
+ ***************************************************************************/
+static int
+searchtraces (struct traceid *id, flag byend, hptime_t time)
+{
+  int *order = ( byend ) ? id->byend : id->bystart;
+  int lo = 0;
+  int hi = id->numsegs;
+  int mid;
+  
+  while ( lo < hi )
+    {
+      mid = (lo + hi) / 2;
+      
+      if ( TRACETIME (id, order[mid], byend) < time )
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  
+  return lo;
+}  /* End of searchtraces() */
+
+
+/***************************************************************************
+ * reordertrace:
+ * Move the trace at position pos of the start time order, or of the
+ * end time order if byend is true, to its place in the order after
+ * its time has changed.
+ ***************************************************************************/
+static void
+reordertrace (struct traceid *id, flag byend, int pos)
+{
+  int *order = ( byend ) ? id->byend : id->bystart;
+  int idx = order[pos];
+  hptime_t time = TRACETIME (id, idx, byend);
+  
+  while ( pos > 0 && TRACETIME (id, order[pos-1], byend) > time )
+    {
+      order[pos] = order[pos-1];
+      pos--;
+    }
+  
+  while ( pos < id->numsegs - 1 && TRACETIME (id, order[pos+1], byend) < time )
+    {
+      order[pos] = order[pos+1];
+      pos++;
+    }
+  
+  order[pos] = idx;
+}  /* End of reordertrace() */
+
+
+/***************************************************************************
+ * linktrace:
+ * Add a trace to the end of a MSTraceGroup and to the traces of a
+ * source name in the trace index, inserting it in the start and end
+ * time orders.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+linktrace (struct traceindex *index, MSTraceGroup *mstg, struct traceid *id,
+	   MSTrace *mst)
+{
+  struct tracesegment *segs;
+  int *order;
+  int maxsegs;
+  int pos;
+  
+  if ( id->numsegs >= id->maxsegs )
+    {
+      maxsegs = ( id->maxsegs ) ? id->maxsegs * 2 : 4;
+      
+      if ( ! (segs = (struct tracesegment *) realloc (id->segs, maxsegs * sizeof(struct tracesegment))) )
+	return -1;
+      id->segs = segs;
+      
+      if ( ! (order = (int *) realloc (id->bystart, maxsegs * sizeof(int))) )
+	return -1;
+      id->bystart = order;
+      
+      if ( ! (order = (int *) realloc (id->byend, maxsegs * sizeof(int))) )
+	return -1;
+      id->byend = order;
+      
+      id->maxsegs = maxsegs;
+    }
+  
+  id->segs[id->numsegs].mst = mst;
+  id->segs[id->numsegs].maxsamples = mst->numsamples;
+  
+  pos = searchtraces (id, 0, mst->starttime);
+  memmove (&id->bystart[pos+1], &id->bystart[pos], (id->numsegs - pos) * sizeof(int));
+  id->bystart[pos] = id->numsegs;
+  
+  pos = searchtraces (id, 1, mst->endtime);
+  memmove (&id->byend[pos+1], &id->byend[pos], (id->numsegs - pos) * sizeof(int));
+  id->byend[pos] = id->numsegs;
+  
+  id->numsegs++;
+  
+  /* Link the trace at the end of the group */
+  mst->next = 0;
+  
+  if ( index->last )
+    index->last->next = mst;
+  else
+    mstg->traces = mst;
+  
+  index->last = mst;
+  mstg->numtraces++;
+  
+  return 0;
+}  /* End of linktrace() */
+
+
+/***************************************************************************
+ * freetraceindex:
+ * Free all memory of a trace index, but not the traces.
+ ***************************************************************************/
+static void
+freetraceindex (struct traceindex *index)
+{
+  struct traceid *id;
+  struct traceid *next;
+  uint32_t idx;
+  
+  for ( idx = 0; idx < index->size; idx++ )
+    {
+      for ( id = index->table[idx]; id; id = next )
+	{
+	  next = id->next;
+	  free (id->segs);
+	  free (id->bystart);
+	  free (id->byend);
+	  free (id);
+	}
+    }
+  
+  free (index->table);
+  memset (index, 0, sizeof(struct traceindex));
+}  /* End of freetraceindex() */
+
+
+/***************************************************************************
+ * gse2group:
+ * Read a GSE file and add data samples to a MSTraceGroup.  As the GSE
+ * is read in a MSRecord struct is used as a holder for the input
+ * information.
+ *
+ * If no output file was specified the packed records are written to a
+ * .mseed file for each input file.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+gse2group (struct convcontext *ctx, char *gsefile, MSTraceGroup *mstg)
+{
+  struct inputfile input;
+  struct blockbuffers *bb = &ctx->bb;
+  FILE *ofp;
+  char *lineptr;
+  char *inputend;
+  int retval = 0;
+  int error;
+  int rv;
+  
+  /* Map input file */
+  if ( mapinput (gsefile, &input) )
+    {
+      return -1;
+    }
+  
+  /* Open .mseed output file if needed, replacing .gse if present */
+  if ( ! outputfile && ! sdsdir )
+    {
+      char mseedoutputfile[1024];
+      int filelen;
+      strncpy (mseedoutputfile, gsefile, sizeof(mseedoutputfile)-6 );
+      filelen = strlen (mseedoutputfile);
+      
+      /* Truncate file name if .gse is at the end */
+      if ( filelen > 4 )
+	if ( (*(mseedoutputfile + filelen - 1) == 'e' || *(mseedoutputfile + filelen - 1) == 'E') &&
+	     (*(mseedoutputfile + filelen - 2) == 's' || *(mseedoutputfile + filelen - 2) == 'S') &&
+	     (*(mseedoutputfile + filelen - 3) == 'g' || *(mseedoutputfile + filelen - 3) == 'G') &&
+	     (*(mseedoutputfile + filelen - 4) == '.') )
+	  {
+	    *(mseedoutputfile + filelen - 4) = '\0';
+	  }
+
+      strcat (mseedoutputfile, ".mseed");
+      
+      if ( (ofp = fopen (mseedoutputfile, "wb")) == NULL )
+        {
+          convlog (ctx, "Cannot open output file: %s (%s)\n",
+		   mseedoutputfile, strerror(errno));
+          unmapinput (&input);
+          return -1;
+        }
+      
+      if ( openwriter (&ctx->out, ofp) )
+        {
+          fclose (ofp);
+          unmapinput (&input);
+          return -1;
+        }
+    }
+
+  lineptr = input.data;
+  inputend = input.data + input.size;
+  
+#if !defined(LMP_WIN)
+  /* Decode blocks concurrently if requested */
+  if ( ctx->blockthreads > 1 )
+    {
+      retval = convertblocks (ctx, gsefile, lineptr, inputend);
+    }
+  else
+#endif
+    {
+      while ( (rv = scanblock (ctx, gsefile, &lineptr, inputend)) > 0 )
+	emitblock (ctx, gsefile, mstg);
+  
+      if ( rv < 0 )
+	retval = -1;
+    }
+  
+  unmapinput (&input);
+  
+  /* Streams do not continue across per-input output files */
+  if ( streaming && ! outputfile && ! sdsdir )
+    flushstreams (ctx);
+  
+  if ( ! outputfile && ! sdsdir && (error = closewriter (&ctx->out)) )
+    {
+      convlog (ctx, "Error writing to output file: %s\n", strerror(error));
+      retval = -1;
+    }
+  
+  if ( bb->msr )
+    bb->msr->datasamples = 0;
+  
+  return retval;
+}  /* End of gse2group() */
+
+
+/***************************************************************************
+ * scanblock:
+ * Scan GSE lines starting at *lineptr until a complete block of data
+ * (WID2, STA2, DAT2 and CHK2 sections) has been read.  Samples are
+ * decoded and the checksum is verified as the lines are read.  The
+ * block header values are stored in the holder MSRecord and the
+ * samples in the sample buffer of the context block buffers.
+ *
+ * *lineptr is advanced past the lines scanned.  The state of the
+ * scanning is not carried between blocks, so a block can be scanned
+ * starting at any WID2 line that does not fall in data.
+ *
+ * Returns 1 when a block was read, 0 at the end of input and -1 on
+ * error.
+ ***************************************************************************/
+static int
+scanblock (struct convcontext *ctx, char *gsefile, char **lineptr, char *inputend)
+{
+  struct blockbuffers *bb = &ctx->bb;
+  MSRecord *msr;
+  char *line;
+  char *tptr;
+  int linesize;
+  
+  char timestr[25];
+  char sampstr[10];
+  char ratestr[15];
+  char chkstr[10];
+  
+  int expectdata = 0;
+  int intclamped = 0;
+  int32_t intcksum = 0;
+  int ochksum, cchksum;
+  int retval = 0;
+  int format = 0;  /* 1 = CM6, 2 = INT */
+  
+  if ( ! (msr = bb->msr = msr_init(bb->msr)) )
+    {
+      convlog (ctx, "Cannot initialize MSRecord strcture\n");
+      return -1;
+    }
+  
+  bb->intcount = 0;
+  
+  /* Scan the input for lines, each line is a view into the input
+   * including the terminating newline if present. */
+  while ( *lineptr < inputend )
+    {
+      line = *lineptr;
+  
+      if ( (tptr = memchr (line, '\n', inputend - line)) )
+	*lineptr = tptr + 1;
+      else
+	*lineptr = inputend;
+      
+      linesize = *lineptr - line;
+      
+      if ( linesize >= 4 && ! strncmp ("WID2", line, 4) && ! expectdata )
+	{
+	  if ( linesize < 68 ) 
+	    {
+	      convlog (ctx, "[%s] WID2 line is too short, only %d characters:\n%.*s\n",
+		       gsefile, linesize, linesize, line);
+	      retval = -1;
+	      break;
+	    }
+	  
+	  /* Extract values from WID2 line and populate the msr holder */
+	  strncpy (timestr, line + 5, 23); timestr[23] = '\0';
+	  msr->starttime = ms_timestr2hptime (timestr);
+	  
+	  ms_strncpclean (msr->network, forcenet, 2);
+	  ms_strncpclean (msr->station, line + 29, 5);
+	  ms_strncpclean (msr->location, line + 39, 2);
+	  ms_strncpclean (msr->channel, line + 35, 3);
+	  
+	  if ( forceloc )
+	    {
+	      ms_strncpclean (msr->location, forceloc, 2);
+	    }
+	  
+	  if ( ! strncmp (line + 44, "CM6", 3) )
+	    {
+	      format = 1;
+	    }
+	  else if ( ! strncmp (line + 44, "INT", 3) )
+	    {
+	      format = 2;
+	    }
+	  else
+	    {
+	      convlog (ctx, "[%s] %s %s: Only CM6 and INT formatted data are supported, not %.3s\n",
+		       gsefile, msr->station, msr->channel, line + 44);
+	      retval = -1;
+	      break;
+	    }
+	  
+	  ms_strncpclean (sampstr, line + 48, 8);
+	  msr->samplecnt = strtol (sampstr, NULL, 10);
+	  
+	  ms_strncpclean (ratestr, line + 57, 11);
+	  msr->samprate = strtod (ratestr, NULL);
+	  
+	  /* Size sample buffer using the sample count as a hint */
+	  if ( msr->samplecnt > 0 )
+	    {
+	      if ( growbuffer ((void **)&bb->intbuf, &bb->intalloc,
+			       (size_t) msr->samplecnt, sizeof(int32_t)) )
+		{
+		  convlog (ctx, "[%s] %s %s: Cannot allocate memory for %lld samples\n",
+			   gsefile, msr->station, msr->channel,
+			   (long long int) msr->samplecnt);
+		  retval = -1;
+		  break;
+		}
+	    }
+	}
+      
+      else if ( linesize >= 4 && ! strncmp ("STA2", line, 4) && ! expectdata )
+	{
+	  if ( linesize < 14 )
+	    {
+	      convlog (ctx, "[%s] %s %s: STA2 line is too short, only %d characters:\n%.*s\n",
+		       gsefile, msr->station, msr->channel, linesize, linesize, line);
+	      retval = -1;
+	      break;
+	    }
+
+	  if ( ! forcenet )
+	    {
+	      ms_strncpclean (msr->network, line + 5, 2);
+	    }
+	}
+      
+      else if ( linesize >= 4 && ! strncmp ("DAT2", line, 4) && ! expectdata )
+	{
+	  if ( format == 0 )
+	    {
+	      convlog (ctx, "[%s] DAT2 line read but data format is not yet known!\n",
+		       gsefile);
+	      retval = -1;
+	      break;
+	    }
+	  
+	  /* CM6 data is decoded line by line as it is read */
+	  if ( format == 1 )
+	    cm6init (&bb->cm6state, 2);
+	  
+	  expectdata = 1;
+	}
+      
+      else if ( linesize >= 5 && ! strncmp ("CHK2 ", line, 5) )
+	{
+	  if ( linesize < 6 )
+	    {
+	      convlog (ctx, "[%s] %s %s: CHK2 line is too short, only %d characters:\n%.*s\n",
+		       gsefile, msr->station, msr->channel, linesize, linesize, line);
+	      retval = -1;
+	      break;
+	    }
+	  
+	  /* Test that data was actually expected */
+	  if ( ! expectdata )
+	    {
+	      convlog (ctx, "[%s] %s %s: CHK2 was found but no DAT2 line indicated the start of data\n",
+		       gsefile, msr->station, msr->channel);
+	      retval = -1;
+	      break;
+	    }
+	  
+	  /* Parse original chksum from the line */
+	  ms_strncpclean (chkstr, line + 5, (linesize - 5 < 8) ? linesize - 5 : 8);
+	  ochksum = strtol (chkstr, NULL, 10);
+	  
+	  /* Finish CM6 decoding, completing any truncated sample */
+	  if ( format == 1 && bb->cm6state.cont )
+	    {
+	      if ( growbuffer ((void **)&bb->intbuf, &bb->intalloc,
+			       bb->intcount + 1, sizeof(int32_t)) )
+		{
+		  convlog (ctx, "[%s] %s %s: Cannot allocate memory for CM6 data\n",
+			   gsefile, msr->station, msr->channel);
+		  retval = -1;
+		  break;
+		}
+	      
+	      convlog (ctx, "[%s] %s %s: Truncated CM6 data\n",
+		       gsefile, msr->station, msr->channel);
+	      
+	      bb->intcount += cm6finish (&bb->cm6state, bb->intbuf + bb->intcount);
+	    }
+	  
+	  if ( intclamped )
+	    {
+	      convlog (ctx, "[%s] %s %s: %d INT sample(s) beyond 32-bit range clamped to range\n",
+		       gsefile, msr->station, msr->channel, intclamped);
+	      intclamped = 0;
+	    }
+	  
+	  if ( msr->samplecnt != (int64_t) bb->intcount )
+	    {
+	      convlog (ctx, "[%s] %s %s: Unpacked %d of %lld samples!\n",
+		       gsefile, msr->station, msr->channel, (int) bb->intcount,
+		       (long long int) msr->samplecnt);
+	      msr->samplecnt = bb->intcount;
+	    }
+	  
+	  if ( verbose >= 3 )
 	    {
-	      fprintf (stderr, "[%s] %s %s: CHK2 was found but no DAT2 line indicated the start of data\n",
+	      int tint;
+	      
+	      convlog (ctx, "[%s] %s %s: First 6 samples:\n",
 		       gsefile, msr->station, msr->channel);
-	      retval = -1;
-	      break;
+	      
+	      for ( tint = 0; tint < 6 && tint < msr->samplecnt; tint++ )
+		{
+		  convlog (ctx, "%10d ", *(bb->intbuf+tint));
+		}
+	      convlog (ctx, "\n");
 	    }
 	  
-	  /* Parse original chksum from the line */
-	  ms_strncpclean (chkstr, line + 5, 8);
-	  ochksum = strtol (chkstr, NULL, 10);
+	  /* Checksums are accumulated while decoding, compare */
+	  if ( format == 1 )
+	    cchksum = abs (bb->cm6state.cksum);
+	  else
+	    cchksum = abs (intcksum);
+	  
+	  if ( ochksum != cchksum )
+	    {
+	      convlog (ctx, "[%s] %s %s: Calculated chksum does not match chksum from CHK2 line\n",
+		       gsefile, msr->station, msr->channel);
+	      convlog (ctx, "Original: %d, Calculated: %d\n", ochksum, cchksum);
+	      
+	      if ( ! ignorecs )
+		{
+		  retval = -1;
+		  break;
+		}
+	    }
+	  
+	  /* Block is complete */
+	  retval = 1;
+	  break;
+	}
+      
+      /* Read in data lines */
+      else if ( expectdata )
+	{
+	  int datalinesize;
+	  char *lineend;
 	  
-	  /* Unpack CM6 */
+	  /* Process CM6 data */
 	  if ( format == 1 )
 	    {
-	      if ( (intbuf = unpackcm6 (cm6buf, cm6bufsize, intbuf, &intbufcount, -1, 2)) == NULL )
+	      /* Data ends at the first character not in the CM6 character
+	       * table, which must be a space, carriage return or newline */
+	      datalinesize = cm6span (line, linesize);
+	      
+	      if ( datalinesize < linesize &&
+		   line[datalinesize] != ' ' &&
+		   line[datalinesize] != '\r' &&
+		   line[datalinesize] != '\n' )
+		{
+		  while ( datalinesize < linesize &&
+			  line[datalinesize] != ' ' &&
+			  line[datalinesize] != '\r' &&
+			  line[datalinesize] != '\n' )
+		    datalinesize++;
+		  
+		  convlog (ctx, "[%s] %s %s: Expected a line with CM6 characters but got:\n'%.*s'\n",
+			   gsefile, msr->station, msr->channel, datalinesize, line);
+		  retval = -1;
+		  break;
+		}
+	      
+	      /* Skip empty lines */
+	      if ( datalinesize <= 0 )
+		{
+		  continue;
+		}
+	      
+	      /* Decode CM6 data directly into the sample buffer, samples
+	       * may continue from the previous line */
+	      tptr = line;
+	      lineend = line + datalinesize;
+	      
+	      while ( tptr < lineend )
+		{
+		  int32_t nint;
+		  
+		  if ( bb->intcount >= bb->intalloc &&
+		       growbuffer ((void **)&bb->intbuf, &bb->intalloc,
+				   bb->intcount + 1, sizeof(int32_t)) )
+		    {
+		      convlog (ctx, "[%s] %s %s: Cannot allocate memory for CM6 data\n",
+			       gsefile, msr->station, msr->channel);
+		      retval = -1;
+		      break;
+		    }
+		  
+		  tptr += cm6decode (&bb->cm6state, tptr, (int32_t) (lineend - tptr),
+				     bb->intbuf + bb->intcount,
+				     (int32_t) (bb->intalloc - bb->intcount), &nint);
+		  
+		  bb->intcount += nint;
+		}
+	      
+	      if ( retval )
+		break;
+	    }
+	  
+	  /* Process INT data, one to many ASCII integer(s) per line are possible */
+	  if ( format == 2 )
+	    {
+	      size_t linestart = bb->intcount;
+	      int overflow;
+	      
+	      /* Truncate at first newline or carriage return character */
+	      if ( (tptr = memchr (line, '\r', linesize)) )
+		datalinesize = tptr - line;
+	      else if ( line[linesize-1] == '\n' )
+		datalinesize = linesize - 1;
+	      else
+		datalinesize = linesize;
+	      
+	      tptr = line;
+	      lineend = line + datalinesize;
+	      
+	      /* Skip leading space character(s) */
+	      while ( tptr < lineend && GSESPACE (*tptr) )
+		{
+		  tptr++;
+		}
+	      
+	      /* Skip empty lines */
+	      if ( tptr >= lineend )
+		{
+		  continue;
+		}
+	      
+	      /* The sample buffer was sized for samplecnt samples from WID2 */
+	      while ( tptr < lineend )
+		{
+		  if ( (int64_t) (bb->intcount+1) > msr->samplecnt )
+		    {
+		      convlog (ctx, "[%s] %s %s: More than %lld INT samples found in input file\n",
+			       gsefile, msr->station, msr->channel,
+			       (long long int) msr->samplecnt);
+		      retval = -1;
+		      break;
+		    }
+		  
+		  tptr = (char *) parseint32 (tptr, lineend, inputend,
+					      bb->intbuf + bb->intcount, &overflow);
+		  
+		  if ( overflow )
+		    intclamped++;
+		  
+		  bb->intcount++;
+		  
+		  /* Skip to next space character and then to next non-space character */
+		  while ( tptr < lineend && ! GSESPACE (*tptr) )
+		    tptr++;
+		  while ( tptr < lineend && GSESPACE (*tptr) )
+		    tptr++;
+		}
+	      
+	      if ( retval )
+		break;
+	      
+	      intcksum = gsechksumadd (intcksum, bb->intbuf + linestart,
+				       (int32_t) (bb->intcount - linestart));
+	    }
+	}
+    }
+      
+  return retval;
+}  /* End of scanblock() */
+
+
+/***************************************************************************
+ * emitblock:
+ * Add the block read by scanblock() to a MSTraceGroup if buffering all
+ * data, add it to its stream if streaming, otherwise pack it directly
+ * from the sample buffer.
+ ***************************************************************************/
+static void
+emitblock (struct convcontext *ctx, char *gsefile, MSTraceGroup *mstg)
+{
+  struct blockbuffers *bb = &ctx->bb;
+  MSRecord *msr = bb->msr;
+  
+  msr->datasamples = bb->intbuf;
+  msr->numsamples = bb->intcount;
+  msr->sampletype = 'i';
+  
+  if ( verbose >= 1 )
+    {
+      convlog (ctx, "[%s] %lld samps @ %.6f Hz for N: '%s', S: '%s', L: '%s', C: '%s'\n",
+	       gsefile, (long long int) msr->numsamples, msr->samprate,
+	       msr->network, msr->station, msr->location, msr->channel);
+    }
+  
+  /* Unless buffering all files in memory pack the block now,
+   * directly from the sample buffer */
+  if ( bufferall )
+    {
+      if ( ! addtogroup (&ctx->groupindex, mstg, msr) )
+	{
+	  convlog (ctx, "[%s] Error adding samples to MSTraceGroup\n", gsefile);
+	}
+    }
+  else if ( msr_endtime (msr) == HPTERROR )
+    {
+      convlog (ctx, "[%s] Error calculating end time of block, skipping\n", gsefile);
+    }
+  else if ( streaming )
+    {
+      streamblock (ctx, msr);
+    }
+  else
+    {
+      packblock (ctx, msr);
+      ctx->packedtraces++;
+    }
+
+  /* Samples are not owned by the holder */
+  msr->datasamples = 0;
+  bb->intcount = 0;
+}  /* End of emitblock() */
+
+
+#if !defined(LMP_WIN)
+/***************************************************************************
+ * convertfiles:
+ * Convert all input files concurrently, see runjobs().
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+convertfiles (struct convcontext *ctx)
+{
+  struct workpool pool;
+  
+  memset (&pool, 0, sizeof(struct workpool));
+  pool.buffered = ( outputfile || sdsdir );
+  
+  return runjobs (ctx, &pool);
+}  /* End of convertfiles() */
+
+
+/***************************************************************************
+ * convertblocks:
+ * Decode and pack the blocks of a single GSE input concurrently, see
+ * runjobs() and readblocks().  The records and messages of the jobs
+ * are output in input order, stopping at the first job that fails as
+ * serial conversion does.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+convertblocks (struct convcontext *ctx, char *gsefile, char *input, char *inputend)
+{
+  struct workpool pool;
+  
+  memset (&pool, 0, sizeof(struct workpool));
+  pool.gsefile = gsefile;
+  pool.input = input;
+  pool.inputend = inputend;
+  pool.buffered = 1;
+  pool.stoponerror = 1;
+  
+  return runjobs (ctx, &pool);
+}  /* End of convertblocks() */
+
+
+/***************************************************************************
+ * runjobs:
+ * Run conversion jobs, whole files or blocks of a file, as a pipeline
+ * of stages connected by the job queue of a pool:
+ *
+ * 1) a reader thread queues jobs, see convreader(), reading ahead of
+ *    the workers,
+ * 2) worker threads claim queued jobs as they become free and decode,
+ *    verify and pack them, see convworker(),
+ * 3) the calling thread outputs the jobs in queue order.
+ *
+ * Workers collect the records and messages of each job in memory so
+ * the output is the same as serial conversion.  Per-input output files
+ * of file jobs are written directly by the workers.
+ *
+ * The input bytes of jobs queued but not yet output are limited to the
+ * memory budget, the reader waits for jobs to be output before queuing
+ * more.  As packed records are smaller than GSE input this also limits
+ * the memory used for collected records.
+ *
+ * If stoponerror is set in the pool no jobs are output after a job that
+ * failed.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+runjobs (struct convcontext *ctx, struct workpool *pool)
+{
+  struct convjob *job;
+  pthread_t reader;
+  pthread_t *tids;
+  int started;
+  int idx;
+  int rv;
+  int retval = 0;
+  
+  pool->budget = (size_t) memorybudget << 20;
+  
+  if ( ! (tids = (pthread_t *) malloc (threads * sizeof(pthread_t))) )
+    {
+      fprintf (stderr, "Cannot allocate memory for conversion threads\n");
+      return -1;
+    }
+  
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->queued, NULL);
+  pthread_cond_init (&pool->jobdone, NULL);
+  pthread_cond_init (&pool->written, NULL);
+  
+  if ( (rv = pthread_create (&reader, NULL, convreader, pool)) )
+    {
+      fprintf (stderr, "Cannot create reader thread: %s\n", strerror(rv));
+      started = 0;
+    }
+  else
+    {
+      for ( started = 0; started < threads; started++ )
+	{
+	  if ( (rv = pthread_create (&tids[started], NULL, convworker, pool)) )
+	    {
+	      fprintf (stderr, "Cannot create conversion thread: %s\n", strerror(rv));
+	      break;
+	    }
+	}
+  
+      if ( started == 0 )
+	{
+	  /* Stop the reader */
+	  pthread_mutex_lock (&pool->lock);
+	  pool->stop = 1;
+	  pthread_cond_broadcast (&pool->written);
+	  pthread_mutex_unlock (&pool->lock);
+	  pthread_join (reader, NULL);
+	}
+    }
+  
+  if ( started == 0 )
+    retval = -1;
+  
+  /* Output the messages and records of each job in order */
+  while ( started > 0 )
+    {
+      pthread_mutex_lock (&pool->lock);
+      while ( ! (pool->head && pool->head->done) && ! (pool->complete && ! pool->head) )
+	pthread_cond_wait (&pool->jobdone, &pool->lock);
+      job = pool->head;
+      pthread_mutex_unlock (&pool->lock);
+  
+      if ( ! job )
+	break;
+  
+      if ( job->msgsize > 0 )
+	fwrite (job->msgbuf, job->msgsize, 1, stderr);
+  
+      if ( job->recsize > 0 && outputrecords (ctx, job->recbuf, job->recsize) )
+	job->retval = -1;
+  
+      ctx->packedtraces += job->packedtraces;
+      ctx->packedsamples += job->packedsamples;
+      ctx->packedrecords += job->packedrecords;
+  
+      /* Remove the job from the queue, stopping after a failure if requested */
+      pthread_mutex_lock (&pool->lock);
+      pool->head = job->next;
+      if ( ! pool->head )
+	pool->tail = 0;
+      pool->inflight -= job->size;
+  
+      if ( pool->stoponerror && job->retval < 0 )
+	{
+	  pool->stop = 1;
+	  pthread_cond_broadcast (&pool->queued);
+	  retval = -1;
+	}
+  
+      /* Keep the job and its buffers for reuse by newjob() */
+      job->next = pool->spare;
+      pool->spare = job;
+  
+      pthread_cond_broadcast (&pool->written);
+      pthread_mutex_unlock (&pool->lock);
+  
+      if ( retval )
+	break;
+    }
+  
+  if ( started > 0 )
+    {
+      pthread_join (reader, NULL);
+  
+      for ( idx = 0; idx < started; idx++ )
+	pthread_join (tids[idx], NULL);
+    }
+  
+  /* Free any jobs discarded after a failure and the spare jobs */
+  while ( (job = pool->head) )
+    {
+      pool->head = job->next;
+      freejob (job);
+    }
+  
+  while ( (job = pool->spare) )
+    {
+      pool->spare = job->next;
+      freejob (job);
+    }
+  
+  pthread_cond_destroy (&pool->written);
+  pthread_cond_destroy (&pool->jobdone);
+  pthread_cond_destroy (&pool->queued);
+  pthread_mutex_destroy (&pool->lock);
+  
+  free (tids);
+  
+  return retval;
+}  /* End of runjobs() */
+
+
+/***************************************************************************
+ * queuejob:
+ * Add a job to the queue of a pool, waiting while the input bytes of
+ * queued jobs would exceed the memory budget.  A job is always queued
+ * when no other jobs are in flight, even if larger than the budget.
+ *
+ * Returns 0 on success, and -1 if the pool was stopped and the job was
+ * not queued
+ ***************************************************************************/
+static int
+queuejob (struct workpool *pool, struct convjob *job)
+{
+  pthread_mutex_lock (&pool->lock);
+  while ( ! pool->stop && pool->inflight > 0 &&
+	  pool->inflight + job->size > pool->budget )
+    pthread_cond_wait (&pool->written, &pool->lock);
+  
+  if ( pool->stop )
+    {
+      pthread_mutex_unlock (&pool->lock);
+      freejob (job);
+      return -1;
+    }
+  
+  if ( pool->tail )
+    pool->tail->next = job;
+  else
+    pool->head = job;
+  
+  pool->tail = job;
+  
+  if ( ! pool->claim )
+    pool->claim = job;
+  
+  pool->inflight += job->size;
+  
+  pthread_cond_signal (&pool->queued);
+  pthread_mutex_unlock (&pool->lock);
+  
+  return 0;
+}  /* End of queuejob() */
+
+
+/***************************************************************************
+ * newjob:
+ * Initialize a conversion job, reusing a spare job of the pool if
+ * available, otherwise allocating a new one.  The record and message
+ * buffers of a spare job are kept for the worker that claims it, see
+ * convworker(), so a long run of jobs allocates no memory once the
+ * buffers have grown to the job sizes.
+ *
+ * Returns a new job on success, and NULL on failure
+ ***************************************************************************/
+static struct convjob *
+newjob (struct workpool *pool, char *filename, char *start, char *end, size_t size)
+{
+  struct convjob *job;
+  char *recbuf;
+  char *msgbuf;
+  size_t recalloc;
+  size_t msgalloc;
+  
+  pthread_mutex_lock (&pool->lock);
+  if ( (job = pool->spare) )
+    pool->spare = job->next;
+  pthread_mutex_unlock (&pool->lock);
+  
+  if ( job )
+    {
+      recbuf = job->recbuf;
+      recalloc = job->recalloc;
+      msgbuf = job->msgbuf;
+      msgalloc = job->msgalloc;
+  
+      memset (job, 0, sizeof(struct convjob));
+  
+      job->recbuf = recbuf;
+      job->recalloc = recalloc;
+      job->msgbuf = msgbuf;
+      job->msgalloc = msgalloc;
+    }
+  else if ( ! (job = (struct convjob *) calloc (1, sizeof(struct convjob))) )
+    {
+      fprintf (stderr, "Cannot allocate memory for conversion job\n");
+      return NULL;
+    }
+  
+  job->filename = filename;
+  job->start = start;
+  job->end = end;
+  job->size = size;
+  
+  return job;
+}  /* End of newjob() */
+
+
+/***************************************************************************
+ * freejob:
+ * Free a conversion job and any output it holds.
+ ***************************************************************************/
+static void
+freejob (struct convjob *job)
+{
+  free (job->recbuf);
+  free (job->msgbuf);
+  free (job);
+}  /* End of freejob() */
+
+
+/***************************************************************************
+ * convreader:
+ * Reader thread of runjobs(), queues the jobs of a pool.
+ *
+ * For a pool of file jobs a job is queued for each input file and the
+ * kernel is advised to read the file ahead of its conversion.
+ *
+ * For a pool of block jobs the input is scanned for the start of each
+ * block, WID2 lines that are not within data, and divided into jobs of
+ * whole blocks, combining small blocks into jobs of at least
+ * BLOCKJOBSIZE bytes.  Any lines before the first block are part of
+ * the first job.  Scanning the input reads it into memory ahead of the
+ * workers.
+ ***************************************************************************/
+static void *
+convreader (void *arg)
+{
+  struct workpool *pool = (struct workpool *) arg;
+  struct convjob *job;
+  struct filelink *flp;
+  struct stat st;
+  char *jobstart;
+  char *lineptr;
+  char *line;
+  char *tptr;
+  int expectdata = 0;
+  int fd;
+  
+  if ( ! pool->gsefile )
+    {
+      for ( flp = filelist; flp; flp = flp->next )
+	{
+	  st.st_size = 0;
+  
+	  if ( (fd = open (flp->filename, O_RDONLY)) >= 0 )
+	    {
+	      if ( fstat (fd, &st) )
+		st.st_size = 0;
+#if defined(POSIX_FADV_WILLNEED)
+	      posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+	      close (fd);
+	    }
+  
+	  if ( ! (job = newjob (pool, flp->filename, 0, 0, (size_t) st.st_size)) ||
+	       queuejob (pool, job) )
+	    break;
+	}
+    }
+  else
+    {
+      jobstart = pool->input;
+      lineptr = pool->input;
+  
+      while ( lineptr < pool->inputend )
+	{
+	  line = lineptr;
+  
+	  if ( (tptr = memchr (lineptr, '\n', pool->inputend - lineptr)) )
+	    lineptr = tptr + 1;
+	  else
+	    lineptr = pool->inputend;
+  
+	  /* Track data sections as scanblock() does, errors are left to it */
+	  if ( (lineptr - line) >= 4 && ! strncmp ("WID2", line, 4) && ! expectdata )
+	    {
+	      /* Queue the current job unless it is still small */
+	      if ( line - jobstart >= BLOCKJOBSIZE )
 		{
-		  fprintf (stderr, "[%s] %s %s: Error unpacking CM6 compressed data\n",
-			   gsefile, msr->station, msr->channel);
-		  retval = -1;
-		  break;
+		  if ( ! (job = newjob (pool, pool->gsefile, jobstart, line, line - jobstart)) ||
+		       queuejob (pool, job) )
+		    {
+		      jobstart = 0;
+		      break;
+		    }
+  
+		  jobstart = line;
 		}
 	    }
-	  
-	  if ( msr->samplecnt != intbufcount )
+	  else if ( (lineptr - line) >= 4 && ! strncmp ("DAT2", line, 4) && ! expectdata )
 	    {
-	      fprintf (stderr, "[%s] %s %s: Unpacked %d of %lld samples!\n",
-		       gsefile, msr->station, msr->channel, intbufcount,
-		       (long long int) msr->samplecnt);
-	      msr->samplecnt = intbufcount;
+	      expectdata = 1;
 	    }
-	  
-	  if ( verbose >= 3 )
+	  else if ( (lineptr - line) >= 5 && ! strncmp ("CHK2 ", line, 5) )
 	    {
-	      int tint;
-	      
-	      fprintf (stderr, "[%s] %s %s: First 6 samples:\n",
-		       gsefile, msr->station, msr->channel);
-	      
-	      for ( tint = 0; tint < 6 && tint < msr->samplecnt; tint++ )
-		{
-		  fprintf (stderr, "%10d ", *(intbuf+tint));
-		}
-	      fprintf (stderr, "\n");
+	      expectdata = 0;
 	    }
+	}
+  
+      /* Queue the last job */
+      if ( jobstart && jobstart < pool->inputend )
+	{
+	  if ( (job = newjob (pool, pool->gsefile, jobstart, pool->inputend,
+			      pool->inputend - jobstart)) )
+	    queuejob (pool, job);
+	}
+    }
+  
+  /* Signal that all jobs are queued */
+  pthread_mutex_lock (&pool->lock);
+  pool->complete = 1;
+  pthread_cond_broadcast (&pool->queued);
+  pthread_cond_signal (&pool->jobdone);
+  pthread_mutex_unlock (&pool->lock);
+  
+  return NULL;
+}  /* End of convreader() */
+
+
+/***************************************************************************
+ * convworker:
+ * Worker thread of runjobs(), runs jobs claimed from the queue of the
+ * pool using a conversion context of its own until all jobs have been
+ * claimed or the pool is stopped.
+ ***************************************************************************/
+static void *
+convworker (void *arg)
+{
+  struct workpool *pool = (struct workpool *) arg;
+  struct convcontext wctx;
+  struct convjob *job;
+  char *lineptr;
+  int rv;
+  
+  memset (&wctx, 0, sizeof(struct convcontext));
+  wctx.buffered = pool->buffered;
+  wctx.bufferlog = 1;
+  
+  for (;;)
+    {
+      /* Claim the next job, waiting for the reader to queue one */
+      pthread_mutex_lock (&pool->lock);
+      while ( ! pool->claim && ! pool->complete && ! pool->stop )
+	pthread_cond_wait (&pool->queued, &pool->lock);
+  
+      if ( ! pool->claim || pool->stop )
+	{
+	  pthread_mutex_unlock (&pool->lock);
+	  break;
+	}
+  
+      job = pool->claim;
+      pool->claim = job->next;
+      pthread_mutex_unlock (&pool->lock);
+  
+      /* Collect into the buffers of a reused job, see newjob() */
+      wctx.recbuf = job->recbuf;
+      wctx.recalloc = job->recalloc;
+      wctx.msgbuf = job->msgbuf;
+      wctx.msgalloc = job->msgalloc;
+  
+      /* Convert a range of blocks or a whole file */
+      if ( job->start )
+	{
+	  lineptr = job->start;
+  
+	  while ( (rv = scanblock (&wctx, job->filename, &lineptr, job->end)) > 0 )
+	    emitblock (&wctx, job->filename, NULL);
+  
+	  if ( wctx.bb.msr )
+	    wctx.bb.msr->datasamples = 0;
+  
+	  job->retval = ( rv < 0 ) ? -1 : 0;
+	}
+      else
+	{
+	  if ( verbose )
+	    convlog (&wctx, "Reading %s\n", job->filename);
+  
+	  job->retval = gse2group (&wctx, job->filename, NULL);
+	}
+  
+      /* Hand the records, messages and counts over to the job */
+      pthread_mutex_lock (&pool->lock);
+      job->recbuf = wctx.recbuf;
+      job->recsize = wctx.recsize;
+      job->recalloc = wctx.recalloc;
+      job->msgbuf = wctx.msgbuf;
+      job->msgsize = wctx.msgsize;
+      job->msgalloc = wctx.msgalloc;
+      job->packedtraces = wctx.packedtraces;
+      job->packedsamples = wctx.packedsamples;
+      job->packedrecords = wctx.packedrecords;
+      job->done = 1;
+      pthread_cond_signal (&pool->jobdone);
+      pthread_mutex_unlock (&pool->lock);
+  
+      wctx.recbuf = 0;
+      wctx.recsize = 0;
+      wctx.recalloc = 0;
+      wctx.msgbuf = 0;
+      wctx.msgsize = 0;
+      wctx.msgalloc = 0;
+      wctx.packedtraces = 0;
+      wctx.packedsamples = 0;
+      wctx.packedrecords = 0;
+    }
+  
+  freeblockbuffers (&wctx.bb);
+  freewriter (&wctx.out);
+  
+  return NULL;
+}  /* End of convworker() */
+#endif
+
+
+/***************************************************************************
+ * mapinput:
+ * Map the contents of an input file into memory.  Where supported the
+ * file is memory mapped read-only, otherwise (or if mapping is not
+ * possible) the contents are read into an allocated buffer.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+mapinput (char *filename, struct inputfile *input)
+{
+  FILE *ifp;
+  size_t readsize;
+  size_t allocsize = 0;
+  
+  input->data = 0;
+  input->size = 0;
+  input->mapped = 0;
+  
+#if !defined(LMP_WIN)
+  {
+    struct stat st;
+    int fd;
+    
+    if ( (fd = open (filename, O_RDONLY)) < 0 )
+      {
+	fprintf (stderr, "Cannot open input file: %s (%s)\n",
+		 filename, strerror(errno));
+	return -1;
+      }
+    
+    if ( fstat (fd, &st) == 0 && S_ISREG (st.st_mode) )
+      {
+	/* Nothing to map for an empty file */
+	if ( st.st_size == 0 )
+	  {
+	    close (fd);
+	    return 0;
+	  }
+	
+	input->data = mmap (NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	
+	if ( input->data != MAP_FAILED )
+	  {
+	    input->size = (size_t) st.st_size;
+	    input->mapped = 1;
+	    
+#if defined(MADV_SEQUENTIAL)
+	    madvise (input->data, input->size, MADV_SEQUENTIAL);
+#endif
+	    
+	    close (fd);
+	    return 0;
+	  }
+	
+	input->data = 0;
+      }
+    
+    close (fd);
+  }
+#endif
+  
+  /* Otherwise read the entire file into memory */
+  if ( (ifp = fopen (filename, "rb")) == NULL )
+    {
+      fprintf (stderr, "Cannot open input file: %s (%s)\n",
+	       filename, strerror(errno));
+      return -1;
+    }
+  
+  do
+    {
+      if ( input->size == allocsize )
+	{
+	  allocsize = (allocsize) ? allocsize * 2 : 65536;
 	  
-	  /* Compute chksum and compare */
-	  cchksum = gsechksum (intbuf, intbufcount);
-	  
-	  if ( ochksum != cchksum )
+	  if ( (input->data = realloc (input->data, allocsize)) == NULL )
 	    {
-	      fprintf (stderr, "[%s] %s %s: Calculated chksum does not match chksum from CHK2 line\n",
-		       gsefile, msr->station, msr->channel);
-	      fprintf (stderr, "Original: %d, Calculated: %d\n", ochksum, cchksum);
-	      
-	      if ( ! ignorecs )
-		{
-		  retval = -1;
-		  break;
-		}
+	      fprintf (stderr, "Cannot allocate memory for input file: %s\n", filename);
+	      fclose (ifp);
+	      return -1;
 	    }
-	  
-	  blockend = 1;
-	  expectdata = 0;
-	  format = 0;
 	}
       
-      /* Read in data lines */
-      else if ( expectdata )
+      readsize = fread (input->data + input->size, 1, allocsize - input->size, ifp);
+      input->size += readsize;
+    } while ( readsize > 0 );
+  
+  if ( ferror (ifp) )
+    {
+      fprintf (stderr, "Error reading input file: %s (%s)\n",
+	       filename, strerror(errno));
+      fclose (ifp);
+      unmapinput (input);
+      return -1;
+    }
+  
+  fclose (ifp);
+  
+  return 0;
+}  /* End of mapinput() */
+
+
+/***************************************************************************
+ * unmapinput:
+ * Release the contents of an input file mapped with mapinput().
+ ***************************************************************************/
+static void
+unmapinput (struct inputfile *input)
+{
+#if !defined(LMP_WIN)
+  if ( input->mapped )
+    munmap (input->data, input->size);
+  else
+#endif
+  if ( input->data )
+    free (input->data);
+  
+  input->data = 0;
+  input->size = 0;
+  input->mapped = 0;
+}  /* End of unmapinput() */
+
+
+/***************************************************************************
+ * growbuffer:
+ * Make sure a buffer has space for at least 'needed' elements of
+ * 'size' bytes, (re)allocating it if needed.  Buffers grow at least
+ * by doubling so that repeated appends are amortized, the number of
+ * elements allocated is tracked in 'allocated'.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+growbuffer (void **buffer, size_t *allocated, size_t needed, size_t size)
+{
+  size_t newalloc;
+  void *newbuffer;
+  
+  if ( *buffer && needed <= *allocated )
+    return 0;
+  
+  newalloc = ( *buffer ) ? *allocated * 2 : 1024;
+  
+  if ( newalloc < needed )
+    newalloc = needed;
+  
+  if ( (newbuffer = realloc (*buffer, newalloc * size)) == NULL )
+    return -1;
+  
+  *buffer = newbuffer;
+  *allocated = newalloc;
+  
+  return 0;
+}  /* End of growbuffer() */
+
+
+/***************************************************************************
+ * freeblockbuffers:
+ * Free all memory associated with block buffers.
+ ***************************************************************************/
+static void
+freeblockbuffers (struct blockbuffers *bb)
+{
+  if ( bb->intbuf )
+    free (bb->intbuf);
+  
+  if ( bb->msr )
+    {
+      bb->msr->datasamples = 0;
+      msr_free (&bb->msr);
+    }
+  
+  if ( bb->packmsr )
+    msr_free (&bb->packmsr);
+  
+  memset (bb, 0, sizeof (struct blockbuffers));
+}  /* End of freeblockbuffers() */
+
+
+/***************************************************************************
+ * openwriter:
+ * Attach an output file to a record writer, allocating the output
+ * buffers and starting the writer thread if not yet done.  The writer
+ * is used for any number of files in turn, see closewriter().
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+openwriter (struct recwriter *w, FILE *fp)
+{
+  int idx;
+  
+  for ( idx = 0; idx < 2; idx++ )
+    {
+      if ( w->buffer[idx] )
+        continue;
+      
+#if !defined(LMP_WIN)
+      if ( posix_memalign ((void **) &w->buffer[idx], 4096, OUTBUFSIZE) )
+        w->buffer[idx] = 0;
+#else
+      w->buffer[idx] = (char *) malloc (OUTBUFSIZE);
+#endif
+      
+      if ( ! w->buffer[idx] )
+        {
+          fprintf (stderr, "Cannot allocate memory for output buffers\n");
+          return -1;
+        }
+    }
+  
+#if !defined(LMP_WIN)
+  if ( ! w->started )
+    {
+      int rv;
+      
+      pthread_mutex_init (&w->lock, NULL);
+      pthread_cond_init (&w->ready, NULL);
+      pthread_cond_init (&w->written, NULL);
+      w->stop = 0;
+      
+      if ( (rv = pthread_create (&w->thread, NULL, writerthread, w)) )
+        {
+          fprintf (stderr, "Cannot create output writer thread: %s\n", strerror(rv));
+          pthread_cond_destroy (&w->written);
+          pthread_cond_destroy (&w->ready);
+          pthread_mutex_destroy (&w->lock);
+          return -1;
+        }
+      
+      w->started = 1;
+    }
+  
+  /* Only regular files can be synchronized to storage */
+  {
+    struct stat st;
+    
+    w->syncdata = ( syncoutput && fstat (fileno (fp), &st) == 0 && S_ISREG (st.st_mode) );
+  }
+#endif
+  
+  /* Whole buffers are written, stdio buffering would only copy */
+  setvbuf (fp, NULL, _IONBF, 0);
+  
+  w->fp = fp;
+  w->current = 0;
+  w->fill = 0;
+  w->error = 0;
+  
+  return 0;
+}  /* End of openwriter() */
+
+
+/***************************************************************************
+ * writeoutput:
+ * Copy data to the output buffers of a record writer, handing each
+ * full buffer to the writer thread to be written while the other
+ * buffer is filled.
+ ***************************************************************************/
+static void
+writeoutput (struct recwriter *w, const char *data, size_t size)
+{
+  size_t count;
+  
+  while ( size > 0 )
+    {
+      count = OUTBUFSIZE - w->fill;
+      
+      if ( count > size )
+        count = size;
+      
+      memcpy (w->buffer[w->current] + w->fill, data, count);
+      w->fill += count;
+      data += count;
+      size -= count;
+      
+      if ( w->fill == OUTBUFSIZE )
+        handoffbuffer (w);
+    }
+}  /* End of writeoutput() */
+
+
+/***************************************************************************
+ * closewriter:
+ * Write any buffered data of a record writer, wait for all writing to
+ * complete and close the output file.  The buffers and writer thread
+ * are kept for the next file.
+ *
+ * Returns 0 on success, and an error number if writing failed
+ ***************************************************************************/
+static int
+closewriter (struct recwriter *w)
+{
+  int error;
+  
+  if ( ! w->fp )
+    return 0;
+  
+  if ( w->fill > 0 )
+    handoffbuffer (w);
+  
+#if !defined(LMP_WIN)
+  pthread_mutex_lock (&w->lock);
+  while ( w->pending )
+    pthread_cond_wait (&w->written, &w->lock);
+  pthread_mutex_unlock (&w->lock);
+#endif
+  
+  error = w->error;
+  
+  if ( fclose (w->fp) && ! error )
+    error = ( errno ) ? errno : EIO;
+  
+  w->fp = 0;
+  w->error = 0;
+  
+  return error;
+}  /* End of closewriter() */
+
+
+/***************************************************************************
+ * freewriter:
+ * Stop the writer thread and free the buffers of a record writer, any
+ * open output file must be closed with closewriter() first.
+ ***************************************************************************/
+static void
+freewriter (struct recwriter *w)
+{
+#if !defined(LMP_WIN)
+  if ( w->started )
+    {
+      pthread_mutex_lock (&w->lock);
+      w->stop = 1;
+      pthread_cond_signal (&w->ready);
+      pthread_mutex_unlock (&w->lock);
+      
+      pthread_join (w->thread, NULL);
+      
+      pthread_cond_destroy (&w->written);
+      pthread_cond_destroy (&w->ready);
+      pthread_mutex_destroy (&w->lock);
+      w->started = 0;
+    }
+#endif
+  
+  free (w->buffer[0]);
+  free (w->buffer[1]);
+  w->buffer[0] = 0;
+  w->buffer[1] = 0;
+}  /* End of freewriter() */
+
+
+/***************************************************************************
+ * handoffbuffer:
+ * Hand the current buffer of a record writer to the writer thread and
+ * continue with the other buffer, waiting for it to be written if
+ * needed.  Without threads the buffer is written directly.
+ ***************************************************************************/
+static void
+handoffbuffer (struct recwriter *w)
+{
+#if !defined(LMP_WIN)
+  pthread_mutex_lock (&w->lock);
+  while ( w->pending )
+    pthread_cond_wait (&w->written, &w->lock);
+  
+  w->pendingbuf = w->buffer[w->current];
+  w->pending = w->fill;
+  pthread_cond_signal (&w->ready);
+  pthread_mutex_unlock (&w->lock);
+  
+  w->current ^= 1;
+#else
+  writebuffer (w, w->buffer[w->current], w->fill);
+#endif
+  
+  w->fill = 0;
+}  /* End of handoffbuffer() */
+
+
+/***************************************************************************
+ * writebuffer:
+ * Write a buffer to the output file of a record writer, synchronizing
+ * the data to storage if requested.  Nothing more is written after a
+ * failure, the error number is kept for closewriter().
+ ***************************************************************************/
+static void
+writebuffer (struct recwriter *w, char *data, size_t size)
+{
+  if ( w->error )
+    return;
+  
+  errno = 0;
+  
+  if ( fwrite (data, size, 1, w->fp) != 1 )
+    {
+      w->error = ( errno ) ? errno : EIO;
+      return;
+    }
+  
+#if !defined(LMP_WIN)
+  if ( w->syncdata && fdatasync (fileno (w->fp)) )
+    w->error = errno;
+#endif
+}  /* End of writebuffer() */
+
+
+#if !defined(LMP_WIN)
+/***************************************************************************
+ * writerthread:
+ * Writer thread of a record writer, writes buffers handed over by
+ * handoffbuffer() until stopped by freewriter().
+ ***************************************************************************/
+static void *
+writerthread (void *arg)
+{
+  struct recwriter *w = (struct recwriter *) arg;
+  char *data;
+  size_t size;
+  
+  pthread_mutex_lock (&w->lock);
+  
+  for (;;)
+    {
+      while ( ! w->pending && ! w->stop )
+        pthread_cond_wait (&w->ready, &w->lock);
+      
+      if ( ! w->pending )
+        break;
+      
+      data = w->pendingbuf;
+      size = w->pending;
+      pthread_mutex_unlock (&w->lock);
+      
+      writebuffer (w, data, size);
+      
+      pthread_mutex_lock (&w->lock);
+      w->pending = 0;
+      pthread_cond_signal (&w->written);
+    }
+  
+  pthread_mutex_unlock (&w->lock);
+  
+  return NULL;
+}  /* End of writerthread() */
+#endif
+
+
+/***************************************************************************
+ * outputrecords:
+ * Output a buffer of packed records collected by a buffered conversion
+ * context to the output writer or SDS archive of a context.  Records
+ * are split for the SDS archive by the length in their headers.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+outputrecords (struct convcontext *ctx, char *records, size_t size)
+{
+  size_t offset;
+  size_t remaining;
+  int reclen;
+  
+  if ( ! ctx->sds )
+    {
+      writeoutput (&ctx->out, records, size);
+      return 0;
+    }
+  
+  for ( offset = 0; offset < size; offset += reclen )
+    {
+      remaining = size - offset;
+      reclen = ms_detect (records + offset, ( remaining < MAXRECLEN ) ? (int) remaining : MAXRECLEN);
+      
+      if ( reclen <= 0 || (size_t) reclen > remaining )
+	{
+	  fprintf (stderr, "Cannot determine length of packed record, not written to SDS archive\n");
+	  ctx->sds->error = 1;
+	  return -1;
+	}
+      
+      if ( sdswrite (ctx->sds, records + offset, reclen) )
+	return -1;
+    }
+  
+  return 0;
+}  /* End of outputrecords() */
+
+
+/***************************************************************************
+ * sdswrite:
+ * Write a record to the file of its channel and day in the SDS archive,
+ * the channel and day are read from the record header.  Files are
+ * appended to and kept open in a cache, see sdsopen().  A failure is
+ * also kept in the archive for sdsclose().
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+sdswrite (struct sdsarchive *sds, char *record, int reclen)
+{
+  struct fsdh_s *fsdh = (struct fsdh_s *) record;
+  struct sdsfile *file;
+  uint16_t year = fsdh->start_time.year;
+  uint16_t day = fsdh->start_time.day;
+  
+  if ( ! MS_ISVALIDYEARDAY (year, day) )
+    {
+      ms_gswap2 (&year);
+      ms_gswap2 (&day);
+    }
+  
+  /* Most records are for the same file as the previous record */
+  file = sds->mru;
+  
+  if ( ! file || file->year != year || file->day != day ||
+       memcmp (file->ident, fsdh->station, sizeof(file->ident)) )
+    {
+      if ( ! (file = sdsopen (sds, fsdh->station, year, day)) )
 	{
-	  int datalinesize = 0;
-	  int spanned;
-	  char *tptr;
-	  
-	  datalinesize = linesize;
-	  
-	  /* Truncate at first newline or carriage return character */
-	  if ( (spanned = strcspn (line, "\n\r")) != datalinesize )
-	    {
-	      line[spanned] = '\0';
-	      datalinesize = spanned;
-	    }
+	  sds->error = 1;
+	  return -1;
+	}
+    }
+  
+  if ( fwrite (record, reclen, 1, file->fp) != 1 )
+    {
+      fprintf (stderr, "Error writing to SDS file %s: %s\n", file->name, strerror(errno));
+      sds->error = 1;
+      return -1;
+    }
+  
+  return 0;
+}  /* End of sdswrite() */
+
+
+/***************************************************************************
+ * sdsopen:
+ * Find the open SDS file for a channel and day, opening it for
+ * appending if not open.  The channel is identified by the station,
+ * location, channel and network fields of a record header, in that
+ * order as 12 characters.
+ *
+ * Open files are kept in a hash table and a list ordered by use, when
+ * SDSMAXOPEN files are open the least recently used file is closed, a
+ * failure closing it is kept in the archive for sdsclose().
+ * Each file is written through a stdio buffer of SDSBUFSIZE bytes.
+ * Directories are created as needed.
+ *
+ * Returns the open file on success, and NULL on failure
+ ***************************************************************************/
+static struct sdsfile *
+sdsopen (struct sdsarchive *sds, const char *ident, uint16_t year, uint16_t day)
+{
+  struct sdsfile *file;
+  struct sdsfile **link;
+  char net[3], sta[6], loc[3], chan[4];
+  char path[1024];
+  uint32_t hash = 2166136261u;
+  int idx;
+  
+  /* FNV-1a hash of the channel and day */
+  for ( idx = 0; idx < 12; idx++ )
+    hash = (hash ^ (uint8_t) ident[idx]) * 16777619u;
+  hash = (hash ^ year) * 16777619u;
+  hash = (hash ^ day) * 16777619u;
+  hash %= SDSHASHSIZE;
+  
+  for ( file = sds->table[hash]; file; file = file->hashnext )
+    {
+      if ( file->year == year && file->day == day &&
+	   ! memcmp (file->ident, ident, sizeof(file->ident)) )
+	break;
+    }
+  
+  if ( ! file )
+    {
+      /* Close the least recently used file if needed, reusing it */
+      if ( sds->open >= SDSMAXOPEN )
+	{
+	  file = sds->lru;
+	  if ( sdsclosefile (sds, file) )
+	    sds->error = 1;
 	  
-	  /* Process CM6 data */
-	  if ( format == 1 )
-	    {
-	      /* Truncate at first space character */
-	      if ( (tptr = strchr (line, ' ')) )
-		{
-		  *tptr = '\0';
-		  datalinesize = tptr - line;
-		}
-	      
-	      /* Skip empty lines */
-	      if ( datalinesize <= 0 )
-		{
-		  continue;
-		}
-	      
-	      /* Make sure all characters are in the CM6 character table */
-	      if ( strspn(line, cm6table) != datalinesize )
-		{
-		  fprintf (stderr, "[%s] %s %s: Expected a line with CM6 characters but got:\n'%s'\n",
-			   gsefile, msr->station, msr->channel, line);
-		  retval = -1;
-		  break;
-		}
-	      
-	      /* Add new data to CM6 buffer */
-	      cm6buf = realloc (cm6buf, cm6bufsize + datalinesize);
-	      
-	      memcpy ((cm6buf + cm6bufsize), line, datalinesize);
-	      
-	      cm6bufsize += datalinesize;
-	    }
+	  for ( link = &sds->table[file->hash]; *link != file; link = &(*link)->hashnext );
+	  *link = file->hashnext;
 	  
-	  /* Process INT data, one to many ASCII integer(s) per line are possible */
-	  if ( format == 2 )
-	    {
-	      tptr = &line[0];
-	      
-	      /* Skip leading space character(s) */
-	      while ( isspace (*tptr) )
-		{
-		  tptr++;
-		  datalinesize--;
-		}
-	      
-	      /* Skip empty lines */
-	      if ( datalinesize <= 0 )
-		{
-		  continue;
-		}
-	      
-	      /* (Re)Allocate intbuf if needed */
-	      if ( intbufcount == 0 )
-		{
-		  intbuf = realloc (intbuf, sizeof(int32_t) * msr->samplecnt);
-		}
-	      
-	      if ( (intbufcount+1) > msr->samplecnt )
-		{
-		  fprintf (stderr, "[%s] %s %s: More than %lld INT samples found in input file\n",
-			   gsefile, msr->station, msr->channel,
-			   (long long int) msr->samplecnt);
-		  retval = -1;
-		  break;
-		}
-	      
-	      while ( *tptr )
-		{
-		  *(intbuf + intbufcount) = (int32_t) strtol (tptr, NULL, 10);
-		  
-		  intbufcount++;
-		  
-		  /* Skip to next space character and then to next non-space character */
-		  while ( *tptr && ! isspace (*tptr) )
-		    tptr++;
-		  while ( *tptr && isspace (*tptr) )
-		    tptr++;
-		}
-	    }
+	  sdsunlink (sds, file);
+	}
+      else if ( ! (file = (struct sdsfile *) calloc (1, sizeof(struct sdsfile))) )
+	{
+	  fprintf (stderr, "Cannot allocate memory for SDS file\n");
+	  return NULL;
 	}
       
-      if ( blockend )
+      memcpy (file->ident, ident, sizeof(file->ident));
+      file->year = year;
+      file->day = day;
+      file->hash = hash;
+      
+      ms_strncpclean (sta, ident, 5);
+      ms_strncpclean (loc, ident + 5, 2);
+      ms_strncpclean (chan, ident + 7, 3);
+      ms_strncpclean (net, ident + 10, 2);
+      
+      snprintf (file->name, sizeof(file->name), "%s.%s.%s.%s.D.%04d.%03d",
+		net, sta, loc, chan, year, day);
+      snprintf (path, sizeof(path), "%s/%04d/%s/%s/%s.D/%s",
+		sds->dir, year, net, sta, chan, file->name);
+      
+      if ( ! (file->fp = fopen (path, "ab")) && errno == ENOENT )
 	{
-	  /* Add data to MSTraceGroup */
-	  msr->datasamples = intbuf;
-	  msr->numsamples = intbufcount;
-	  msr->sampletype = 'i';
-	  
-	  if ( verbose >= 1 )
-	    {
-	      fprintf (stderr, "[%s] %lld samps @ %.6f Hz for N: '%s', S: '%s', L: '%s', C: '%s'\n",
-		       gsefile, (long long int) msr->numsamples, msr->samprate,
-		       msr->network, msr->station, msr->location, msr->channel);
-	    }
-	  
-	  if ( ! mst_addmsrtogroup (mstg, msr, 0, -1.0, -1.0) )
-	    {
-	      fprintf (stderr, "[%s] Error adding samples to MSTraceGroup\n", gsefile);
-	    }
-	  
-	  /* Unless buffering all files in memory pack any MSTraces now */
-          if ( ! bufferall )
-            {
-              packtraces (1);
-              packedtraces += mstg->numtraces;
-              mst_initgroup (mstg);
-            }
+	  sdsmkdirs (path);
+	  file->fp = fopen (path, "ab");
+	}
+      
+      if ( ! file->fp )
+	{
+	  fprintf (stderr, "Cannot open SDS file: %s (%s)\n", path, strerror(errno));
+	  free (file);
+	  return NULL;
+	}
+      
+      setvbuf (file->fp, NULL, _IOFBF, SDSBUFSIZE);
+      
+      file->hashnext = sds->table[hash];
+      sds->table[hash] = file;
+      sds->open++;
+    }
+  else
+    {
+      sdsunlink (sds, file);
+    }
+  
+  /* Insert as most recently used */
+  file->prev = 0;
+  file->next = sds->mru;
+  if ( sds->mru )
+    sds->mru->prev = file;
+  sds->mru = file;
+  if ( ! sds->lru )
+    sds->lru = file;
+  
+  return file;
+}  /* End of sdsopen() */
 
-	  /* Cleanup and reset state */
-	  msr->datasamples = 0;
-	  msr = msr_init (msr);
 
-	  cm6bufsize = 0;
-	  intbufcount = 0;
-	  ochksum = 0;
-	  blockend = 0;
-	}
+/***************************************************************************
+ * sdsunlink:
+ * Remove an SDS file from the list of open files ordered by use.
+ ***************************************************************************/
+static void
+sdsunlink (struct sdsarchive *sds, struct sdsfile *file)
+{
+  if ( file->prev )
+    file->prev->next = file->next;
+  else
+    sds->mru = file->next;
+  
+  if ( file->next )
+    file->next->prev = file->prev;
+  else
+    sds->lru = file->prev;
+  
+  file->prev = 0;
+  file->next = 0;
+}  /* End of sdsunlink() */
+
+
+/***************************************************************************
+ * sdsclosefile:
+ * Close an open SDS file, synchronizing it to storage if requested.
+ *
+ * Returns 0 on success, and -1 on failure
+ ***************************************************************************/
+static int
+sdsclosefile (struct sdsarchive *sds, struct sdsfile *file)
+{
+  int retval = 0;
+  
+  if ( fflush (file->fp) )
+    retval = -1;
+  
+#if !defined(LMP_WIN)
+  if ( ! retval && syncoutput && fdatasync (fileno (file->fp)) )
+    retval = -1;
+#endif
+  
+  if ( fclose (file->fp) )
+    retval = -1;
+  
+  if ( retval )
+    fprintf (stderr, "Error writing to SDS file %s: %s\n", file->name, strerror(errno));
+  
+  file->fp = 0;
+  sds->open--;
+  
+  return retval;
+}  /* End of sdsclosefile() */
+
+
+/***************************************************************************
+ * sdsclose:
+ * Close all open files of an SDS archive and free the cache.
+ *
+ * Returns 0 on success, and -1 if writing or closing any file failed
+ ***************************************************************************/
+static int
+sdsclose (struct sdsarchive *sds)
+{
+  struct sdsfile *file;
+  int retval = 0;
+  
+  while ( (file = sds->mru) )
+    {
+      sds->mru = file->next;
+      
+      if ( sdsclosefile (sds, file) )
+	retval = -1;
+      
+      free (file);
     }
+  
+  if ( sds->error )
+    retval = -1;
+  
+  memset (sds->table, 0, sizeof(sds->table));
+  sds->lru = 0;
+  sds->error = 0;
+  
+  return retval;
+}  /* End of sdsclose() */
 
-  fclose (ifp);
+
+/***************************************************************************
+ * sdsmkdirs:
+ * Create all directories leading to a file path, existing directories
+ * are ignored.
+ ***************************************************************************/
+static void
+sdsmkdirs (char *path)
+{
+  char *sep;
   
-  if ( ofp  && ! outputfile )
+  for ( sep = strchr (path + 1, '/'); sep; sep = strchr (sep + 1, '/') )
     {
-      fclose (ofp);
-      ofp = 0;
+      *sep = '\0';
+#if defined(LMP_WIN)
+      _mkdir (path);
+#else
+      mkdir (path, 0777);
+#endif
+      *sep = '/';
     }
+}  /* End of sdsmkdirs() */
+
 
-  if ( cm6buf )
-    free (cm6buf);
+/***************************************************************************
+ * daysplit:
+ * Calculate the number of samples of a series starting at starttime
+ * before the next day boundary, using the same sample time calculation
+ * as msr_pack().
+ *
+ * Returns the number of samples before the next day
+ ***************************************************************************/
+static int64_t
+daysplit (hptime_t starttime, double samprate)
+{
+  hptime_t nextday;
+  int64_t count;
   
-  if ( intbuf )
-    free (intbuf);
+  nextday = DAYSTART (starttime) + DAYLENGTH;
+  count = (int64_t) ((double) (nextday - starttime) / HPTMODULUS * samprate);
   
-  if ( msr )
-    msr_free (&msr);
-      
-  return retval;
-}  /* End of gse2group() */
+  while ( count > 0 && SAMPLETIME (starttime, count - 1, samprate) >= nextday )
+    count--;
+  while ( SAMPLETIME (starttime, count, samprate) < nextday )
+    count++;
+  
+  return count;
+}  /* End of daysplit() */
 
 
 /***************************************************************************
@@ -596,6 +3216,14 @@ parameter_proc (int argcount, char **argvec)
 	{
 	  bufferall = 1;
 	}
+      else if (strcmp (argvec[optind], "-c") == 0)
+	{
+	  streaming = 1;
+	}
+      else if (strcmp (argvec[optind], "-L") == 0)
+	{
+	  streamlatency = atof (getoptval(argcount, argvec, optind++));
+	}
       else if (strcmp (argvec[optind], "-n") == 0)
 	{
 	  forcenet = getoptval(argcount, argvec, optind++);
@@ -616,6 +3244,22 @@ parameter_proc (int argcount, char **argvec)
 	{
 	  byteorder = atoi (getoptval(argcount, argvec, optind++));
 	}
+      else if (strcmp (argvec[optind], "-t") == 0)
+	{
+	  threads = atoi (getoptval(argcount, argvec, optind++));
+	}
+      else if (strcmp (argvec[optind], "-m") == 0)
+	{
+	  memorybudget = atoi (getoptval(argcount, argvec, optind++));
+	}
+      else if (strcmp (argvec[optind], "-s") == 0)
+	{
+	  syncoutput = 1;
+	}
+      else if (strcmp (argvec[optind], "-SDS") == 0)
+	{
+	  sdsdir = getoptval(argcount, argvec, optind++);
+	}
       else if (strcmp (argvec[optind], "-o") == 0)
 	{
 	  outputfile = getoptval(argcount, argvec, optind++);
@@ -633,12 +3277,71 @@ parameter_proc (int argcount, char **argvec)
     }
   
   /* Make sure an output file is specified if buffering all */
-  if ( bufferall && ! outputfile )
+  if ( bufferall && ! outputfile && ! sdsdir )
     {
-      fprintf (stderr, "Need to specify output file with -o if using -B\n");
+      fprintf (stderr, "Need to specify output file with -o or -SDS if using -B\n");
       exit(1);
     }
   
+  /* Make sure streaming is not combined with buffering all */
+  if ( bufferall && streaming )
+    {
+      fprintf (stderr, "Cannot specify both buffering (-B) and streaming (-c)\n");
+      exit(1);
+    }
+  
+  /* Make sure a latency limit is only specified when streaming */
+  if ( streamlatency != 0.0 && ! streaming )
+    {
+      fprintf (stderr, "Latency limit (-L) requires streaming (-c)\n");
+      exit(1);
+    }
+  
+  if ( streamlatency < 0.0 )
+    {
+      fprintf (stderr, "Latency limit must not be negative\n");
+      exit(1);
+    }
+  
+  /* Make sure only one output is specified */
+  if ( outputfile && sdsdir )
+    {
+      fprintf (stderr, "Cannot specify both an output file (-o) and SDS archive (-SDS)\n");
+      exit(1);
+    }
+  
+  /* Make sure the number of threads is sane */
+  if ( threads < 1 )
+    {
+      fprintf (stderr, "Number of threads must be at least 1\n");
+      exit(1);
+    }
+  
+  /* Make sure the memory budget is sane */
+  if ( memorybudget < 1 )
+    {
+      fprintf (stderr, "Memory budget must be at least 1 MiB\n");
+      exit(1);
+    }
+  
+  /* Buffering all data in a single group requires serial conversion */
+  if ( bufferall && threads > 1 )
+    {
+      fprintf (stderr, "Conversion threads are not used with -B\n");
+      threads = 1;
+    }
+  
+  /* Streams continue across blocks and files in input order */
+  if ( streaming && threads > 1 )
+    {
+      fprintf (stderr, "Conversion threads are not used with -c\n");
+      threads = 1;
+    }
+  
+#if defined(LMP_WIN)
+  threads = 1;
+#endif
+  
   /* Make sure input files were specified */
   if ( filelist == 0 )
     {
@@ -656,11 +3359,14 @@ parameter_proc (int argcount, char **argvec)
    * remove them from the list and add the contained list */
   if ( filelist )
     {
-      struct filelink *prevlp, *lp;
+      struct filelink *prevlp, *lp, *nextlp;
       
-      prevlp = lp = filelist;
+      prevlp = 0;
+      lp = filelist;
       while ( lp != 0 )
 	{
+	  nextlp = lp->next;
+	  
 	  if ( *(lp->filename) == '@' )
 	    {
 	      /* Remove this node from the list */
@@ -669,9 +3375,18 @@ parameter_proc (int argcount, char **argvec)
 	      else
 		prevlp->next = lp->next;
 	      
+	      if ( lp == filelisttail )
+		filelisttail = prevlp;
+	      
+	      filecount--;
+	      
 	      /* Read list file, skip the '@' first character */
 	      readlistfile (lp->filename + 1);
 	      
+	      /* Continue with the node following the removed node,
+	       * possibly one of the files added from the list */
+	      nextlp = ( prevlp ) ? prevlp->next : filelist;
+	      
 	      /* Free memory for this node */
 	      free (lp->filename);
 	      free (lp);
@@ -681,7 +3396,7 @@ parameter_proc (int argcount, char **argvec)
 	      prevlp = lp;
 	    }
 	  
-	  lp = lp->next;
+	  lp = nextlp;
 	}
     }
   
@@ -817,7 +3532,7 @@ readlistfile (char *listfile)
 static void
 addfile (char *filename)
 {
-  struct filelink *lastlp, *newlp;
+  struct filelink *newlp;
   
   if ( filename == NULL )
     {
@@ -825,41 +3540,90 @@ addfile (char *filename)
       return;
     }
   
-  lastlp = filelist;
-  while ( lastlp != 0 )
-    {
-      if ( lastlp->next == 0 )
-        break;
-      
-      lastlp = lastlp->next;
-    }
-  
   newlp = (struct filelink *) malloc (sizeof (struct filelink));
   newlp->filename = strdup(filename);
   newlp->next = 0;
   
-  if ( lastlp == 0 )
+  /* The tail of the list is tracked to avoid walking long lists */
+  if ( filelist == 0 )
     filelist = newlp;
   else
-    lastlp->next = newlp;
+    filelisttail->next = newlp;
+  
+  filelisttail = newlp;
+  filecount++;
   
 }  /* End of addfile() */
 
 
 /***************************************************************************
  * record_handler:
- * Saves passed records to the output file.
+ * Saves passed records to the output writer or SDS archive of the
+ * conversion context or, if the context is buffered, to its record
+ * buffer.
  ***************************************************************************/
 static void
 record_handler (char *record, int reclen, void *handlerdata)
 {
-  if ( fwrite(record, reclen, 1, ofp) != 1 )
+  struct convcontext *ctx = (struct convcontext *) handlerdata;
+  
+  /* Collect records to be written later */
+  if ( ctx->buffered )
     {
-      fprintf (stderr, "Error writing to output file\n");
+      if ( growbuffer ((void **) &ctx->recbuf, &ctx->recalloc, ctx->recsize + reclen, 1) )
+        {
+          fprintf (stderr, "Cannot allocate memory for output records\n");
+          return;
+        }
+      
+      memcpy (ctx->recbuf + ctx->recsize, record, reclen);
+      ctx->recsize += reclen;
+      return;
     }
+  
+  if ( ctx->sds )
+    sdswrite (ctx->sds, record, reclen);
+  else
+    writeoutput (&ctx->out, record, reclen);
 }  /* End of record_handler() */
 
 
+/***************************************************************************
+ * convlog:
+ * Print a diagnostic message of a conversion context to stderr, or
+ * collect it in the message buffer of the context if it is buffering
+ * messages to be printed in input order.
+ ***************************************************************************/
+static void
+convlog (struct convcontext *ctx, const char *format, ...)
+{
+  va_list argptr;
+  int length;
+  
+  va_start (argptr, format);
+  
+  if ( ! ctx->bufferlog )
+    {
+      vfprintf (stderr, format, argptr);
+      va_end (argptr);
+      return;
+    }
+  
+  length = vsnprintf (NULL, 0, format, argptr);
+  va_end (argptr);
+  
+  if ( length <= 0 ||
+       growbuffer ((void **) &ctx->msgbuf, &ctx->msgalloc, ctx->msgsize + length + 1, 1) )
+    return;
+  
+  va_start (argptr, format);
+  vsnprintf (ctx->msgbuf + ctx->msgsize, length + 1, format, argptr);
+  va_end (argptr);
+  
+  ctx->msgsize += length;
+}  /* End of convlog() */
+
+
 /***************************************************************************
  * usage:
  * Print the usage message and exit.
@@ -879,12 +3643,18 @@ usage (void)
 	   " -v             Be more verbose, multiple flags can be used\n"
 	   " -i             Ignore GSE checksum mismatch, warn but continue\n"
 	   " -B             Buffer data before packing, default packs at end of each block\n"
+	   " -c             Stream data, keep partial records open across blocks and files\n"
+	   " -L seconds     Flush a stream when its buffered data span seconds with -c\n"
 	   " -n netcode     Specify the SEED network code\n"
 	   " -l locid       Specify the SEED location ID\n"
 	   " -r bytes       Specify record length in bytes for packing, default: 4096\n"
 	   " -e encoding    Specify SEED encoding format for packing, default: 11 (Steim2)\n"
 	   " -b byteorder   Specify byte order for packing, MSBF: 1 (default), LSBF: 0\n"
+	   " -t threads     Number of threads to convert files or blocks concurrently, default: 1\n"
+	   " -m megabytes   Memory budget for input in flight with -t or streams with -c, default: 256\n"
+	   " -s             Synchronize output to storage (fdatasync) after each buffer\n"
 	   " -o outfile     Specify the output file, default is <inputfile>.mseed\n"
+	   " -SDS dir       Write output to an SDS archive in dir, split at day boundaries\n"
 	   "\n"
 	   " file(s)        File(s) of GSE input data\n"
            "                  If a file is prefixed with an '@' it is assumed to contain\n"
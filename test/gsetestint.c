@@ -0,0 +1,497 @@
+/***************************************************************************
+ * gsetestint.c
+ *
+ * A program for testing and benchmarking the GSE INT sample parser,
+ * parseint32() in cm6.c, against the strtol(3) based parsing it
+ * replaced.
+ *
+ * modified 2026.290
+ ***************************************************************************/
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cm6.h"
+
+#define PACKAGE "gsetestint"
+
+/* White space as tested by gse2mseed, isspace() in the C locale */
+#define GSESPACE(c) ((c) == ' ' || ((c) >= '\t' && (c) <= '\r'))
+
+/* Data lines of INT blocks to benchmark, stored one after another
+ * with NULL terminators as gse2mseed scans lines in place */
+struct intlines {
+  char   *text;          /* All lines */
+  size_t  textsize;      /* Number of bytes in text */
+  size_t  textalloc;     /* Number of bytes allocated for text */
+  size_t *offset;        /* Offset of each line in text */
+  size_t *length;        /* Length of each line */
+  size_t  count;         /* Number of lines */
+  size_t  alloc;         /* Number of lines allocated */
+  size_t  samples;       /* Number of samples in all lines */
+};
+
+static int parsevalues (int argc, char **argv);
+static int compare (long count);
+static int benchmark (int argc, char **argv);
+static int readlines (struct intlines *lines, const char *gsefile);
+static int addline (struct intlines *lines, const char *line, size_t length);
+static void synthlines (struct intlines *lines);
+static int64_t parsestrtol (struct intlines *lines, int32_t *intbuf);
+static int64_t parseswar (struct intlines *lines, int32_t *intbuf);
+static double nanoseconds (void);
+static uint64_t xorshift (uint64_t *state);
+static void usage (void);
+
+
+int
+main (int argc, char **argv)
+{
+  if ( argc >= 2 && ! strcmp (argv[1], "-p") )
+    return parsevalues (argc - 2, argv + 2);
+  
+  if ( argc == 3 && ! strcmp (argv[1], "-c") )
+    return compare (atol (argv[2]));
+  
+  if ( argc >= 2 && ! strcmp (argv[1], "-b") )
+    return benchmark (argc - 2, argv + 2);
+  
+  usage ();
+  return 1;
+}  /* End of main() */
+
+
+/***************************************************************************
+ * parsevalues:
+ * Parse each argument with parseint32() and print the value, the
+ * number of characters used and whether the value was clamped.
+ *
+ * Returns 0.
+ ***************************************************************************/
+static int
+parsevalues (int argc, char **argv)
+{
+  const char *end;
+  int32_t value;
+  int overflow;
+  int idx;
+  
+  for ( idx = 0; idx < argc; idx++ )
+    {
+      end = parseint32 (argv[idx], argv[idx] + strlen (argv[idx]),
+			argv[idx] + strlen (argv[idx]), &value, &overflow);
+  
+      printf ("%s: %d, %d characters%s\n", argv[idx], value,
+	      (int) (end - argv[idx]), (overflow) ? ", clamped" : "");
+    }
+  
+  return 0;
+}  /* End of parsevalues() */
+
+
+/***************************************************************************
+ * compare:
+ * Compare parseint32() with strtoll(3) clamped to the 32-bit range on
+ * random inputs: an optional sign, up to 20 digits often with leading
+ * zeros and a following character that may be a digit beyond the end
+ * of the input.  Inputs are parsed both at the end of readable memory
+ * and with readable characters following them.
+ *
+ * Returns 0 if all inputs match and 1 otherwise.
+ ***************************************************************************/
+static int
+compare (long count)
+{
+  static const char tail[] = " \t-+x09";
+  uint64_t state = 88172645463325252ULL;
+  char buf[64];
+  char input[32];
+  char *strend;
+  const char *end;
+  long long expect;
+  int32_t value;
+  int overflow;
+  int length;
+  int ndigits;
+  int pos;
+  int padded;
+  long differ = 0;
+  long idx;
+  
+  for ( idx = 0; idx < count; idx++ )
+    {
+      length = 0;
+  
+      switch ( xorshift (&state) % 4 )
+	{
+	case 0: input[length++] = '-'; break;
+	case 1: input[length++] = '+'; break;
+	}
+  
+      ndigits = 1 + (int) (xorshift (&state) % 20);
+  
+      for ( pos = 0; pos < ndigits; pos++ )
+	{
+	  if ( pos < 3 && xorshift (&state) % 4 == 0 )
+	    input[length++] = '0';
+	  else
+	    input[length++] = (char) ('0' + xorshift (&state) % 10);
+	}
+  
+      input[length] = '\0';
+  
+      /* Expected value and end from the input alone */
+      expect = strtoll (input, &strend, 10);
+  
+      if ( expect > INT32_MAX )
+	expect = INT32_MAX;
+      else if ( expect < INT32_MIN )
+	expect = INT32_MIN;
+  
+      for ( padded = 0; padded <= 1; padded++ )
+	{
+	  memcpy (buf, input, length);
+	  buf[length] = tail[xorshift (&state) % (sizeof(tail) - 1)];
+  
+	  end = parseint32 (buf, buf + length, (padded) ? buf + sizeof(buf) : buf + length,
+			    &value, &overflow);
+  
+	  if ( value != expect || end - buf != strend - input ||
+	       overflow != (value != strtoll (input, NULL, 10)) )
+	    {
+	      if ( differ < 10 )
+		printf ("Differ for '%s'%s: %d, %d characters, expected %lld, %d characters\n",
+			input, (padded) ? " (padded)" : "", value, (int) (end - buf),
+			expect, (int) (strend - input));
+	      differ++;
+	    }
+	}
+    }
+  
+  printf ("Compared %ld inputs, %ld differ\n", count, differ);
+  
+  return ( differ ) ? 1 : 0;
+}  /* End of compare() */
+
+
+/***************************************************************************
+ * benchmark:
+ * Time parsing the data lines of the INT blocks of GSE files, or of
+ * synthetic lines of 8 samples of up to 4 digits if no files are
+ * given, with the strtol(3) loop gse2mseed used before and with
+ * parseint32().  The minimum of repeated runs is reported.
+ *
+ * Returns 0 on success and 1 on error.
+ ***************************************************************************/
+static int
+benchmark (int argc, char **argv)
+{
+  struct intlines lines;
+  int32_t *intbuf;
+  double start;
+  double best[2] = { 0, 0 };
+  double elapsed;
+  int64_t sum[2] = { 0, 0 };
+  int run;
+  int idx;
+  
+  memset (&lines, 0, sizeof(lines));
+  
+  if ( argc == 0 )
+    synthlines (&lines);
+  
+  for ( idx = 0; idx < argc; idx++ )
+    if ( readlines (&lines, argv[idx]) )
+      return 1;
+  
+  if ( ! lines.samples )
+    {
+      fprintf (stderr, "No INT samples found\n");
+      return 1;
+    }
+  
+  if ( ! (intbuf = (int32_t *) malloc (lines.samples * sizeof(int32_t))) )
+    return 1;
+  
+  /* Repeat each over at least 10 million samples */
+  for ( run = 0; run < 5; run++ )
+    {
+      for ( idx = 0; idx < 2; idx++ )
+	{
+	  int repeat = 0;
+  
+	  start = nanoseconds ();
+  
+	  do
+	    sum[idx] = ( idx ) ? parseswar (&lines, intbuf) : parsestrtol (&lines, intbuf);
+	  while ( ++repeat * lines.samples < 10000000 );
+  
+	  elapsed = (nanoseconds () - start) / ((double) repeat * lines.samples);
+  
+	  if ( run == 0 || elapsed < best[idx] )
+	    best[idx] = elapsed;
+	}
+    }
+  
+  printf ("%lu lines, %lu samples, %.1f samples/line\n",
+	  (unsigned long) lines.count, (unsigned long) lines.samples,
+	  (double) lines.samples / lines.count);
+  printf ("strtol:     %6.1f ns/sample\n", best[0]);
+  printf ("parseint32: %6.1f ns/sample (%.1fx)\n", best[1], best[0] / best[1]);
+  
+  if ( sum[0] != sum[1] )
+    {
+      fprintf (stderr, "Sums of samples differ, %lld and %lld\n",
+	       (long long) sum[0], (long long) sum[1]);
+      return 1;
+    }
+  
+  return 0;
+}  /* End of benchmark() */
+
+
+/***************************************************************************
+ * readlines:
+ * Add the data lines of the INT blocks of a GSE file, between a DAT2
+ * line following a WID2 line for INT data and the CHK2 line.
+ *
+ * Returns 0 on success and 1 on error.
+ ***************************************************************************/
+static int
+readlines (struct intlines *lines, const char *gsefile)
+{
+  FILE *fp;
+  char line[1025];
+  size_t length;
+  int isint = 0;
+  int indata = 0;
+  
+  if ( ! (fp = fopen (gsefile, "rb")) )
+    {
+      fprintf (stderr, "Cannot open %s: %s\n", gsefile, strerror (errno));
+      return 1;
+    }
+  
+  while ( fgets (line, sizeof(line), fp) )
+    {
+      length = strlen (line);
+  
+      while ( length > 0 && (line[length-1] == '\n' || line[length-1] == '\r') )
+	line[--length] = '\0';
+  
+      if ( ! strncmp (line, "WID2", 4) )
+	isint = ( length >= 47 && ! strncmp (line + 44, "INT", 3) );
+      else if ( ! strncmp (line, "DAT2", 4) )
+	indata = isint;
+      else if ( ! strncmp (line, "CHK2", 4) )
+	indata = 0;
+      else if ( indata && addline (lines, line, length) )
+	{
+	  fclose (fp);
+	  return 1;
+	}
+    }
+  
+  fclose (fp);
+  
+  return 0;
+}  /* End of readlines() */
+
+
+/***************************************************************************
+ * addline:
+ * Add a copy of a data line to the text, counting its samples.
+ *
+ * Returns 0 on success and 1 on error.
+ ***************************************************************************/
+static int
+addline (struct intlines *lines, const char *line, size_t length)
+{
+  size_t idx;
+  
+  if ( lines->count >= lines->alloc )
+    {
+      lines->alloc = ( lines->alloc ) ? lines->alloc * 2 : 1024;
+  
+      if ( ! (lines->offset = (size_t *) realloc (lines->offset, lines->alloc * sizeof(size_t))) ||
+	   ! (lines->length = (size_t *) realloc (lines->length, lines->alloc * sizeof(size_t))) )
+	return 1;
+    }
+  
+  if ( lines->textsize + length + 1 > lines->textalloc )
+    {
+      lines->textalloc = ( lines->textalloc ) ? lines->textalloc * 2 : 65536;
+  
+      if ( lines->textsize + length + 1 > lines->textalloc )
+	lines->textalloc = lines->textsize + length + 1;
+  
+      if ( ! (lines->text = (char *) realloc (lines->text, lines->textalloc)) )
+	return 1;
+    }
+  
+  memcpy (lines->text + lines->textsize, line, length + 1);
+  lines->offset[lines->count] = lines->textsize;
+  lines->length[lines->count] = length;
+  lines->textsize += length + 1;
+  lines->count++;
+  
+  for ( idx = 0; idx < length; idx++ )
+    if ( ! GSESPACE (line[idx]) && (idx == 0 || GSESPACE (line[idx-1])) )
+      lines->samples++;
+  
+  return 0;
+}  /* End of addline() */
+
+
+/***************************************************************************
+ * synthlines:
+ * Add 100000 synthetic data lines of 8 samples of up to 4 digits.
+ ***************************************************************************/
+static void
+synthlines (struct intlines *lines)
+{
+  uint64_t state = 2463534242ULL;
+  char line[128];
+  int length;
+  int count;
+  int idx;
+  
+  for ( count = 0; count < 100000; count++ )
+    {
+      length = 0;
+  
+      for ( idx = 0; idx < 8; idx++ )
+	length += sprintf (line + length, " %d", (int) (xorshift (&state) % 19999) - 9999);
+  
+      if ( addline (lines, line, length) )
+	return;
+    }
+}  /* End of synthlines() */
+
+
+/***************************************************************************
+ * parsestrtol:
+ * Parse all lines with the strtol(3) and isspace(3) loop gse2mseed
+ * used before parseint32().
+ *
+ * Returns the sum of the samples.
+ ***************************************************************************/
+static int64_t
+parsestrtol (struct intlines *lines, int32_t *intbuf)
+{
+  int64_t sum = 0;
+  size_t count = 0;
+  size_t idx;
+  char *tptr;
+  
+  for ( idx = 0; idx < lines->count; idx++ )
+    {
+      tptr = lines->text + lines->offset[idx];
+  
+      while ( isspace (*tptr) )
+	tptr++;
+  
+      while ( *tptr )
+	{
+	  intbuf[count] = (int32_t) strtol (tptr, NULL, 10);
+	  sum += intbuf[count++];
+  
+	  while ( *tptr && ! isspace (*tptr) )
+	    tptr++;
+	  while ( *tptr && isspace (*tptr) )
+	    tptr++;
+	}
+    }
+  
+  return sum;
+}  /* End of parsestrtol() */
+
+
+/***************************************************************************
+ * parseswar:
+ * Parse all lines with parseint32() as gse2mseed does.
+ *
+ * Returns the sum of the samples.
+ ***************************************************************************/
+static int64_t
+parseswar (struct intlines *lines, int32_t *intbuf)
+{
+  int64_t sum = 0;
+  size_t count = 0;
+  size_t idx;
+  const char *tptr;
+  const char *lineend;
+  const char *bufend = lines->text + lines->textsize;
+  int overflow;
+  
+  for ( idx = 0; idx < lines->count; idx++ )
+    {
+      tptr = lines->text + lines->offset[idx];
+      lineend = tptr + lines->length[idx];
+  
+      while ( tptr < lineend && GSESPACE (*tptr) )
+	tptr++;
+  
+      while ( tptr < lineend )
+	{
+	  tptr = parseint32 (tptr, lineend, bufend, intbuf + count, &overflow);
+	  sum += intbuf[count++];
+  
+	  while ( tptr < lineend && ! GSESPACE (*tptr) )
+	    tptr++;
+	  while ( tptr < lineend && GSESPACE (*tptr) )
+	    tptr++;
+	}
+    }
+  
+  return sum;
+}  /* End of parseswar() */
+
+
+/***************************************************************************
+ * nanoseconds:
+ * Returns a monotonic time in nanoseconds.
+ ***************************************************************************/
+static double
+nanoseconds (void)
+{
+  struct timespec ts;
+  
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  
+  return (double) ts.tv_sec * 1e9 + ts.tv_nsec;
+}  /* End of nanoseconds() */
+
+
+/***************************************************************************
+ * xorshift:
+ * Returns the next value of a xorshift64 generator, so random inputs
+ * are the same on all platforms.
+ ***************************************************************************/
+static uint64_t
+xorshift (uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  
+  return *state;
+}  /* End of xorshift() */
+
+
+/***************************************************************************
+ * usage:
+ * Print the usage message.
+ ***************************************************************************/
+static void
+usage (void)
+{
+  fprintf (stderr, "Usage: %s -p value [value ...]   Parse values with parseint32()\n", PACKAGE);
+  fprintf (stderr, "       %s -c count               Compare with strtoll() on random inputs\n", PACKAGE);
+  fprintf (stderr, "       %s -b [gsefile ...]       Benchmark against strtol() on INT data lines\n", PACKAGE);
+}  /* End of usage() */